@@ -0,0 +1,680 @@
+#include <algorithm>  // For std::sort, std::min
+#include <chrono>	  // For std::chrono::steady_clock
+#include <cstdint>	  // For std::uint64_t
+#include <cstdio>	  // For std::snprintf, fflush
+#include <cstdlib>	  // For setenv, getenv, std::strtod
+#include <filesystem> // For all path and directory operations (Requires C++17)
+#include <fstream>	  // For std::ofstream, std::ifstream
+#include <functional> // For std::function
+#include <iomanip>	  // For std::setw, std::setprecision
+#include <iostream>	  // For std::cout, std::cerr
+#include <map>		  // For std::map (compare mode)
+#include <sstream>	  // For std::ostringstream
+#include <string>	  // For std::string
+#include <vector>	  // For std::vector
+
+#include <fcntl.h>	// For open, O_WRONLY
+#include <unistd.h> // For dup, dup2, close
+
+#include "../catlr.hpp"
+
+// catlr benchmarks: a deterministic generator of synthetic trees, microbenchmarks of the
+// matcher, .gitignore loader, tree printer and walker, and end-to-end runs of the command line,
+// all in-process against libcatlr. Results are written as JSON lines for --compare.
+//
+// Build (from the repository root):
+//   g++ -O2 -std=c++17 -pthread -o catlr_bench bench/catlr_bench.cpp catlr.cpp
+
+namespace fs = std::filesystem;
+
+// --- Corpus Generation ---
+
+// Bump when a generator changes, so stale corpora are rebuilt
+const int CORPUS_VERSION = 1;
+
+/**
+ * @brief splitmix64: the same sequence on every platform and standard library.
+ */
+class Rng
+{
+public:
+	explicit Rng(std::uint64_t seed) : state_(seed) {}
+
+	std::uint64_t next()
+	{
+		std::uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	/**
+	 * @brief A value in [low, high].
+	 */
+	std::uint64_t between(std::uint64_t low, std::uint64_t high)
+	{
+		return low + next() % (high - low + 1);
+	}
+
+private:
+	std::uint64_t state_;
+};
+
+/**
+ * @brief Writes `size` bytes of source-like text: lines of lowercase words.
+ */
+void write_text_file(const fs::path &path, std::uint64_t size, Rng &rng)
+{
+	std::string text;
+	text.reserve(size);
+	while (text.size() < size)
+	{
+		size_t line_length = static_cast<size_t>(rng.between(8, 72));
+		for (size_t i = 0; i < line_length && text.size() + 1 < size; ++i)
+		{
+			std::uint64_t r = rng.next();
+			text += (r % 7 == 0) ? ' ' : static_cast<char>('a' + r % 26);
+		}
+		text += '\n';
+	}
+	text.resize(size);
+	std::ofstream(path, std::ios::binary).write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+/**
+ * @brief Writes a large file from one repeated 64 KiB block (generating every byte would
+ * dominate the setup time).
+ */
+void write_huge_file(const fs::path &path, std::uint64_t size, Rng &rng)
+{
+	fs::path block_path = path.string() + ".block";
+	write_text_file(block_path, 64 * 1024, rng);
+	std::string block;
+	{
+		std::ifstream in(block_path, std::ios::binary);
+		block.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	fs::remove(block_path);
+	std::ofstream out(path, std::ios::binary);
+	for (std::uint64_t written = 0; written < size; written += block.size())
+	{
+		out.write(block.data(), static_cast<std::streamsize>(std::min<std::uint64_t>(block.size(), size - written)));
+	}
+}
+
+std::string numbered(const char *prefix, std::uint64_t n, const char *suffix = "")
+{
+	char name[64];
+	std::snprintf(name, sizeof(name), "%s%04llu%s", prefix, static_cast<unsigned long long>(n), suffix);
+	return name;
+}
+
+/**
+ * @brief One directory holding many small files.
+ */
+void generate_wide(const fs::path &root, int scale, Rng &rng)
+{
+	for (std::uint64_t i = 0; i < 20000ULL * scale; ++i)
+	{
+		write_text_file(root / numbered("file", i, ".txt"), rng.between(64, 512), rng);
+	}
+}
+
+/**
+ * @brief A long chain of nested directories, each with a few files and a side branch.
+ */
+void generate_deep(const fs::path &root, int scale, Rng &rng)
+{
+	fs::path dir = root;
+	for (std::uint64_t depth = 0; depth < 256ULL * scale; ++depth)
+	{
+		dir /= numbered("d", depth);
+		fs::create_directories(dir / "side");
+		for (int i = 0; i < 4; ++i)
+		{
+			write_text_file(dir / numbered("f", static_cast<std::uint64_t>(i), ".c"), rng.between(128, 2048), rng);
+		}
+		write_text_file(dir / "side" / "notes.md", rng.between(64, 256), rng);
+	}
+}
+
+/**
+ * @brief A JavaScript project: a small src/ next to a large, .gitignore'd node_modules/ with
+ * nested dependencies.
+ */
+void generate_node_modules(const fs::path &root, int scale, Rng &rng)
+{
+	std::ofstream(root / ".gitignore") << "node_modules/\n*.log\ndist/\n";
+	for (std::uint64_t d = 0; d < 20; ++d)
+	{
+		fs::path dir = root / "src" / numbered("module", d);
+		fs::create_directories(dir);
+		for (std::uint64_t f = 0; f < 10; ++f)
+		{
+			write_text_file(dir / numbered("component", f, ".js"), rng.between(256, 4096), rng);
+		}
+	}
+	fs::create_directories(root / "dist");
+	write_text_file(root / "dist" / "bundle.js", 200000, rng);
+	write_text_file(root / "debug.log", 4096, rng);
+	for (std::uint64_t p = 0; p < 150ULL * scale; ++p)
+	{
+		fs::path package = root / "node_modules" / numbered("pkg-", p);
+		fs::create_directories(package / "lib");
+		write_text_file(package / "package.json", rng.between(200, 800), rng);
+		write_text_file(package / "README.md", rng.between(500, 3000), rng);
+		write_text_file(package / "index.js", rng.between(100, 1000), rng);
+		for (std::uint64_t f = 0; f < 8; ++f)
+		{
+			write_text_file(package / "lib" / numbered("part", f, ".js"), rng.between(200, 6000), rng);
+		}
+		for (std::uint64_t n = 0; n < 2; ++n)
+		{
+			fs::path nested = package / "node_modules" / numbered("dep-", rng.between(0, 999));
+			fs::create_directories(nested);
+			write_text_file(nested / "package.json", rng.between(200, 800), rng);
+			write_text_file(nested / "index.js", rng.between(100, 1000), rng);
+			write_text_file(nested / "index.d.ts", rng.between(100, 1000), rng);
+		}
+	}
+}
+
+/**
+ * @brief Many directories of many small files.
+ */
+void generate_small_files(const fs::path &root, int scale, Rng &rng)
+{
+	for (std::uint64_t d = 0; d < 100ULL * scale; ++d)
+	{
+		fs::path dir = root / numbered("pkg", d);
+		fs::create_directories(dir);
+		for (std::uint64_t f = 0; f < 200; ++f)
+		{
+			write_text_file(dir / numbered("src", f, f % 3 == 0 ? ".h" : ".cpp"), rng.between(16, 1024), rng);
+		}
+	}
+}
+
+/**
+ * @brief A few huge files next to a handful of small ones.
+ */
+void generate_huge_files(const fs::path &root, int scale, Rng &rng)
+{
+	for (std::uint64_t i = 0; i < 4; ++i)
+	{
+		write_huge_file(root / numbered("huge", i, ".log"), (16ULL << 20) * scale, rng);
+	}
+	for (std::uint64_t i = 0; i < 10; ++i)
+	{
+		write_text_file(root / numbered("small", i, ".txt"), rng.between(100, 1000), rng);
+	}
+}
+
+/**
+ * @brief A tree under a .gitignore with 1500 patterns of every kind the matcher knows
+ * (suffix, prefix, contains, directory, exact name, full path); about half the files match.
+ */
+void generate_gitignore_heavy(const fs::path &root, int scale, Rng &rng)
+{
+	std::ofstream gitignore(root / ".gitignore");
+	gitignore << "# Generated\n";
+	for (std::uint64_t i = 0; i < 300; ++i)
+	{
+		gitignore << "*.ext" << i << '\n'
+				  << "build" << i << "/\n"
+				  << "tmp" << i << "*\n"
+				  << "*cache" << i << "*\n"
+				  << "dir" << (i % 40) << "/gen" << i << ".txt\n";
+	}
+	gitignore.close();
+	for (std::uint64_t d = 0; d < 40ULL * scale; ++d)
+	{
+		fs::path dir = root / numbered("dir", d % 40, "") / (d < 40 ? "" : numbered("sub", d));
+		fs::create_directories(dir);
+		for (std::uint64_t f = 0; f < 100; ++f)
+		{
+			std::uint64_t kind = rng.between(0, 9);
+			std::uint64_t n = rng.between(0, 599); // Half of the numbers have patterns
+			std::string name = kind == 0	 ? numbered("file", f, (".ext" + std::to_string(n)).c_str())
+							   : kind == 1	 ? "tmp" + std::to_string(n) + "_" + std::to_string(f)
+							   : kind == 2	 ? "x_cache" + std::to_string(n) + "_" + std::to_string(f) + ".bin"
+							   : kind == 3	 ? "gen" + std::to_string(n) + ".txt"
+											 : numbered("keep", f, ".cpp");
+			write_text_file(dir / name, rng.between(64, 1024), rng);
+		}
+		fs::create_directories(dir / ("build" + std::to_string(d % 600)));
+		write_text_file(dir / ("build" + std::to_string(d % 600)) / "out.o", 512, rng);
+	}
+}
+
+struct Corpus
+{
+	const char *name;
+	void (*generate)(const fs::path &root, int scale, Rng &rng);
+};
+
+const Corpus CORPORA[] = {
+	{"wide", generate_wide},
+	{"deep", generate_deep},
+	{"node_modules", generate_node_modules},
+	{"small_files", generate_small_files},
+	{"huge_files", generate_huge_files},
+	{"gitignore_heavy", generate_gitignore_heavy},
+};
+
+/**
+ * @brief Generates a corpus under `work_dir` unless an identical one (same generator version
+ * and scale) is already there.
+ */
+fs::path ensure_corpus(const fs::path &work_dir, const Corpus &corpus, int scale)
+{
+	fs::path root = work_dir / corpus.name;
+	fs::path stamp_path = work_dir / (std::string(corpus.name) + ".stamp");
+	std::string stamp = std::to_string(CORPUS_VERSION) + " " + std::to_string(scale);
+	std::string existing;
+	std::getline(std::ifstream(stamp_path) >> std::ws, existing);
+	if (existing == stamp && fs::is_directory(root))
+	{
+		return root;
+	}
+	std::cerr << "Info: Generating corpus '" << corpus.name << "' (scale " << scale << ")..." << std::endl;
+	fs::remove_all(root);
+	fs::create_directories(root);
+	Rng rng(0xca71c0de ^ std::hash<std::string>()(corpus.name)); // Seeded per corpus: independent of order
+	corpus.generate(root, scale, rng);
+	std::ofstream(stamp_path) << stamp << '\n';
+	return root;
+}
+
+// --- Measurement ---
+
+struct BenchResult
+{
+	std::string name;
+	std::uint64_t ops;		// Operations per sample
+	size_t samples;
+	double ns_per_op;		// Median over samples
+	double min_ns_per_op;
+};
+
+struct BenchOptions
+{
+	fs::path work_dir;
+	int scale = 1;
+	std::string filter;
+	double min_time = 0.5; // Seconds of samples per benchmark
+	size_t min_samples = 5;
+	std::string out_file;
+};
+
+// Results feed this, so the optimizer cannot drop the measured work
+volatile std::uint64_t benchmark_guard = 0;
+
+/**
+ * @brief Sink that discards everything (the output side is not what is measured).
+ */
+class NullSink : public catlr::OutputSink
+{
+public:
+	bool write(const char *, size_t length) override
+	{
+		benchmark_guard = benchmark_guard + length;
+		return true;
+	}
+};
+
+/**
+ * @brief Runs `body` (which performs `ops` operations) once to warm up, then until both
+ * min_samples samples and min_time seconds are collected.
+ */
+BenchResult measure(const BenchOptions &options, const std::string &name, std::uint64_t ops, const std::function<void()> &body)
+{
+	using clock = std::chrono::steady_clock;
+	body();
+	std::vector<double> samples;
+	auto started = clock::now();
+	while (samples.size() < options.min_samples ||
+		   (std::chrono::duration<double>(clock::now() - started).count() < options.min_time && samples.size() < 1000))
+	{
+		auto sample_start = clock::now();
+		body();
+		double ns = std::chrono::duration<double, std::nano>(clock::now() - sample_start).count();
+		samples.push_back(ns / static_cast<double>(ops));
+	}
+	std::sort(samples.begin(), samples.end());
+	return {name, ops, samples.size(), samples[samples.size() / 2], samples.front()};
+}
+
+/**
+ * @brief Runs the catlr command line in-process with stdout sent to /dev/null.
+ */
+int run_cli_quietly(std::vector<std::string> args)
+{
+	std::cout.flush();
+	int saved_stdout = dup(STDOUT_FILENO);
+	int null_fd = open("/dev/null", O_WRONLY);
+	dup2(null_fd, STDOUT_FILENO);
+	close(null_fd);
+
+	std::vector<char *> argv;
+	for (auto &arg : args)
+	{
+		argv.push_back(&arg[0]);
+	}
+	argv.push_back(nullptr);
+	int status = catlr::cli_main(static_cast<int>(args.size()), argv.data());
+
+	std::cout.flush();
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	return status;
+}
+
+// --- Benchmarks ---
+
+/**
+ * @brief Paths relative to `root`, '/'-separated, with their file names.
+ */
+std::vector<std::pair<std::string, std::string>> relative_paths(const fs::path &root)
+{
+	std::vector<std::pair<std::string, std::string>> paths;
+	for (const auto &entry : catlr::walk(root, catlr::Filters()))
+	{
+		paths.push_back({entry.relative.generic_string(), entry.path.filename().string()});
+	}
+	return paths;
+}
+
+void run_benchmarks(const BenchOptions &options, std::vector<BenchResult> &results)
+{
+	auto wanted = [&options](const std::string &name)
+	{ return options.filter.empty() || name.find(options.filter) != std::string::npos; };
+	auto add = [&](const std::string &name, std::uint64_t ops, const std::function<void()> &body)
+	{
+		if (!wanted(name))
+		{
+			return;
+		}
+		results.push_back(measure(options, name, ops, body));
+		const BenchResult &result = results.back();
+		std::cerr << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(1)
+				  << std::setw(14) << result.ns_per_op << " ns/op" << std::setw(14) << result.min_ns_per_op << " min"
+				  << std::setw(6) << result.samples << " samples" << std::endl;
+	};
+
+	std::map<std::string, fs::path> roots;
+	for (const auto &corpus : CORPORA)
+	{
+		roots[corpus.name] = ensure_corpus(options.work_dir, corpus, options.scale);
+	}
+
+	// --- Matcher ---
+	auto paths = relative_paths(roots["node_modules"]);
+	const std::pair<const char *, const char *> patterns[] = {
+		{"suffix", "*.js"},
+		{"prefix", "node_modules*"},
+		{"contains", "*lib*"},
+		{"directory", "node_modules/"},
+		{"name", "package.json"},
+		{"full_path", "src/module0001/component0001.js"},
+	};
+	for (const auto &pattern : patterns)
+	{
+		add(std::string("pattern_matches/") + pattern.first, paths.size(), [&paths, &pattern]()
+			{
+				std::uint64_t hits = 0;
+				for (const auto &path : paths)
+					hits += catlr::pattern_matches(path.first, path.second, pattern.second);
+				benchmark_guard = benchmark_guard + hits; });
+	}
+
+	fs::path heavy_root = roots["gitignore_heavy"];
+	catlr::Filters heavy_filters = catlr::target_filters(catlr::Filters(), heavy_root, true);
+	auto heavy_paths = relative_paths(heavy_root);
+	add("matches_filters_rel/gitignore_heavy", heavy_paths.size(), [&]()
+		{
+			std::uint64_t kept = 0;
+			for (const auto &path : heavy_paths)
+				kept += catlr::matches_filters_rel(path.first, path.second, heavy_filters.print_includes, heavy_filters.print_excludes);
+			benchmark_guard = benchmark_guard + kept; });
+
+	catlr::Filters node_filters = catlr::target_filters(catlr::Filters(), roots["node_modules"], true);
+	std::vector<fs::path> full_paths;
+	for (const auto &path : paths)
+	{
+		full_paths.push_back(roots["node_modules"] / path.first);
+	}
+	add("matches_filters/node_modules", full_paths.size(), [&]()
+		{
+			std::uint64_t kept = 0;
+			for (const auto &path : full_paths)
+				kept += catlr::matches_filters(path, roots["node_modules"], node_filters.list_includes, node_filters.list_excludes);
+			benchmark_guard = benchmark_guard + kept; });
+
+	add("parse_gitignore/gitignore_heavy", 1, [&]()
+		{ benchmark_guard = benchmark_guard + catlr::parse_gitignore(heavy_root / ".gitignore").size(); });
+
+	// --- Tree, Walk and End-to-End ---
+	for (const auto &corpus : CORPORA)
+	{
+		fs::path root = roots[corpus.name];
+		catlr::Filters filters = catlr::target_filters(catlr::Filters(), root, true);
+		add(std::string("print_tree_native/") + corpus.name, 1, [&]()
+			{
+				NullSink sink;
+				catlr::print_tree(root, filters, sink); });
+		add(std::string("walk/") + corpus.name, 1, [&]()
+			{
+				std::uint64_t entries = 0;
+				for (const auto &entry : catlr::walk(root, filters))
+					entries += entry.depth + 1;
+				benchmark_guard = benchmark_guard + entries; });
+		add(std::string("end_to_end/") + corpus.name, 1, [&]()
+			{ run_cli_quietly({"catlr", root.string()}); });
+	}
+}
+
+// --- Results ---
+
+void write_results(std::ostream &out, const BenchOptions &options, const std::vector<BenchResult> &results)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\"bench\":\"catlr\",\"corpus_version\":" << CORPUS_VERSION << ",\"scale\":" << options.scale << "}\n";
+	for (const auto &result : results)
+	{
+		out << "{\"name\":\"" << result.name << "\",\"ops\":" << result.ops << ",\"samples\":" << result.samples
+			<< ",\"ns_per_op\":" << result.ns_per_op << ",\"min_ns_per_op\":" << result.min_ns_per_op << "}\n";
+	}
+}
+
+/**
+ * @brief Reads name -> ns_per_op from a file written by write_results.
+ */
+std::map<std::string, double> read_results(const fs::path &path)
+{
+	std::map<std::string, double> results;
+	std::ifstream in(path);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		size_t name_at = line.find("\"name\":\"");
+		size_t value_at = line.find("\"ns_per_op\":");
+		if (name_at == std::string::npos || value_at == std::string::npos)
+		{
+			continue;
+		}
+		name_at += 8;
+		std::string name = line.substr(name_at, line.find('"', name_at) - name_at);
+		results[name] = std::strtod(line.c_str() + value_at + 12, nullptr);
+	}
+	return results;
+}
+
+/**
+ * @brief Prints the change of every benchmark present in both files.
+ * @return 1 if any got slower by more than `threshold` percent, else 0.
+ */
+int compare_results(const fs::path &base_path, const fs::path &new_path, double threshold)
+{
+	std::map<std::string, double> base = read_results(base_path);
+	std::map<std::string, double> current = read_results(new_path);
+	if (base.empty() || current.empty())
+	{
+		std::cerr << "Error: No results in '" << (base.empty() ? base_path : new_path).string() << "'." << std::endl;
+		return 2;
+	}
+	int status = 0;
+	std::cout << std::fixed << std::setprecision(1);
+	for (const auto &item : current)
+	{
+		auto old = base.find(item.first);
+		if (old == base.end() || old->second <= 0)
+		{
+			continue;
+		}
+		double change = (item.second / old->second - 1) * 100;
+		bool regressed = change > threshold;
+		status |= regressed ? 1 : 0;
+		std::cout << std::left << std::setw(40) << item.first << std::right << std::setw(14) << old->second
+				  << std::setw(14) << item.second << std::setw(9) << std::showpos << change << std::noshowpos << "%"
+				  << (regressed ? "  REGRESSION" : "") << '\n';
+	}
+	return status;
+}
+
+// --- Listing ---
+
+/**
+ * @brief Prints the relative path of every file a default catlr run would print, for
+ * comparing the walker and .gitignore handling with other tools (bench/compare_tools.sh).
+ */
+int list_files(const fs::path &root)
+{
+	if (!fs::is_directory(root))
+	{
+		std::cerr << "Error: '" << root.string() << "' is not a directory." << std::endl;
+		return 1;
+	}
+	std::string out;
+	catlr::Filters filters = catlr::target_filters(catlr::Filters(), root, true);
+	for (const auto &entry : catlr::walk(root, filters))
+	{
+		if (entry.type == catlr::DirEntryType::Regular)
+		{
+			out += entry.relative.generic_string();
+			out += '\n';
+		}
+	}
+	return catlr::write_all(STDOUT_FILENO, out.data(), out.size()) ? 0 : 1;
+}
+
+// --- Entry Point ---
+
+void show_usage(const char *prog_name)
+{
+	std::cerr << "Usage: " << prog_name << " [options]" << std::endl;
+	std::cerr << "       " << prog_name << " --compare <base.json> <new.json> [--threshold <percent>]" << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "  --dir <path>       : Where corpora are generated (default: $TMPDIR/catlr-bench)." << std::endl;
+	std::cerr << "  --scale <n>        : Corpus size multiplier (default: 1)." << std::endl;
+	std::cerr << "  --filter <text>    : Only run benchmarks whose name contains <text>." << std::endl;
+	std::cerr << "  --min-time <s>     : Seconds of samples per benchmark (default: 0.5)." << std::endl;
+	std::cerr << "  --out <file>       : Write JSON-lines results to <file> instead of stdout." << std::endl;
+	std::cerr << "  --generate-only    : Generate the corpora and exit." << std::endl;
+	std::cerr << "  --list <dir>       : Print the files catlr would print under <dir> (with its .gitignore), one per line." << std::endl;
+	std::cerr << "  --compare          : Compare two result files; exits 1 if one benchmark got slower than the threshold (default 10%)." << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	BenchOptions options;
+	const char *tmp = getenv("TMPDIR");
+	options.work_dir = fs::path(tmp != nullptr && tmp[0] != '\0' ? tmp : "/tmp") / "catlr-bench";
+	bool generate_only = false;
+	std::string list_dir;
+	std::vector<std::string> compare_files;
+	double threshold = 10;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "-h" || arg == "--help")
+		{
+			show_usage(argv[0]);
+			return 0;
+		}
+		else if (arg == "--dir" && has_value)
+			options.work_dir = argv[++i];
+		else if (arg == "--scale" && has_value)
+			options.scale = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--filter" && has_value)
+			options.filter = argv[++i];
+		else if (arg == "--min-time" && has_value)
+			options.min_time = std::strtod(argv[++i], nullptr);
+		else if (arg == "--out" && has_value)
+			options.out_file = argv[++i];
+		else if (arg == "--threshold" && has_value)
+			threshold = std::strtod(argv[++i], nullptr);
+		else if (arg == "--generate-only")
+			generate_only = true;
+		else if (arg == "--list" && has_value)
+			list_dir = argv[++i];
+		else if (arg == "--compare" && i + 2 < argc)
+		{
+			compare_files = {argv[i + 1], argv[i + 2]};
+			i += 2;
+		}
+		else
+		{
+			std::cerr << "Error: Unknown or incomplete option '" << arg << "'." << std::endl;
+			show_usage(argv[0]);
+			return 2;
+		}
+	}
+	if (!compare_files.empty())
+	{
+		return compare_results(compare_files[0], compare_files[1], threshold);
+	}
+
+	if (!list_dir.empty())
+	{
+		return list_files(list_dir);
+	}
+
+	fs::create_directories(options.work_dir);
+	if (generate_only)
+	{
+		for (const auto &corpus : CORPORA)
+		{
+			std::cout << ensure_corpus(options.work_dir, corpus, options.scale).string() << std::endl;
+		}
+		return 0;
+	}
+
+	// End-to-end runs use the built-in tree and printer with a default config, so they
+	// measure catlr rather than whatever tree/bat/cat this machine has
+	fs::path home = options.work_dir / "home";
+	fs::create_directories(home);
+	setenv("HOME", home.c_str(), 1);
+	setenv("PATH", "", 1);
+
+	std::vector<BenchResult> results;
+	run_benchmarks(options, results);
+
+	if (options.out_file.empty())
+	{
+		write_results(std::cout, options, results);
+	}
+	else
+	{
+		std::ofstream out(options.out_file);
+		write_results(out, options, results);
+		if (!out)
+		{
+			std::cerr << "Error: Could not write '" << options.out_file << "'." << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,1335 @@
+#include <algorithm>  // For std::min
+#include <cerrno>	  // For errno, ESRCH
+#include <chrono>	  // For std::chrono::hours, std::chrono::steady_clock
+#include <cstdio>	  // For std::sscanf, std::clearerr
+#include <csignal>	  // For kill, SIGKILL
+#include <cstdlib>	  // For setenv, getenv, std::system, std::atol, posix_openpt
+#include <cstring>	  // For std::strcpy
+#include <filesystem> // For all path and directory operations (Requires C++17)
+#include <fstream>	  // For std::ofstream, std::ifstream
+#include <iostream>	  // For std::cout, std::cerr
+#include <sstream>	  // For std::istringstream
+#include <string>	  // For std::string
+#include <vector>	  // For std::vector
+
+#include <fcntl.h>	   // For open, O_RDONLY, O_WRONLY
+#include <sys/socket.h> // For socket, connect (--serve checks)
+#include <sys/un.h>	   // For sockaddr_un
+#include <sys/wait.h> // For waitpid, WIFEXITED
+#include <unistd.h>   // For dup, dup2, close, fork, pipe
+
+#ifdef CATLR_USE_ZLIB
+#include <zlib.h> // For inflate (--compress checks)
+#endif
+
+#include "../catlr.hpp"
+
+// catlr behaviour checks: small fixture trees built under a temp directory and run in-process
+// through libcatlr and its command line, with the output checked against what each option
+// promises. Prints every failed check and exits with status 1 if any failed.
+//
+// Build (from the repository root):
+//   g++ -O2 -std=c++17 -pthread -DCATLR_USE_ZLIB -o catlr_test bench/catlr_test.cpp catlr.cpp -lz
+//
+// Without -DCATLR_USE_ZLIB the --rev checks are skipped, and without git on PATH so are the
+// checks that need a repository.
+
+namespace fs = std::filesystem;
+
+// --- Harness ---
+
+/**
+ * @brief Where the fixtures live, and the tally of checks.
+ */
+struct TestContext
+{
+	fs::path work_dir;
+	std::string tool_path; // PATH for git; catlr itself runs with an empty PATH
+	bool has_git = false;
+	std::string test;	   // The running test, for failure messages
+	int checks = 0;
+	int failures = 0;
+
+	void check(bool passed, const std::string &what, const std::string &detail = "")
+	{
+		++checks;
+		if (!passed)
+		{
+			++failures;
+			std::cerr << "FAIL " << test << ": " << what << std::endl;
+			if (!detail.empty())
+			{
+				std::cerr << "---- output ----" << std::endl
+						  << detail.substr(0, 4000) << (detail.size() > 4000 ? "\n[...]" : "") << std::endl
+						  << "----------------" << std::endl;
+			}
+		}
+	}
+};
+
+void write_file(const fs::path &path, const std::string &text)
+{
+	fs::create_directories(path.parent_path());
+	std::ofstream(path, std::ios::binary) << text;
+}
+
+std::string read_file(const fs::path &path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+bool has(const std::string &text, const std::string &needle)
+{
+	return text.find(needle) != std::string::npos;
+}
+
+size_t count(const std::string &text, const std::string &needle)
+{
+	size_t found = 0;
+	for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + needle.length()))
+	{
+		++found;
+	}
+	return found;
+}
+
+/**
+ * @brief True if both occur and `first` occurs before `second`.
+ */
+bool before(const std::string &text, const std::string &first, const std::string &second)
+{
+	size_t a = text.find(first);
+	size_t b = text.find(second);
+	return a != std::string::npos && b != std::string::npos && a < b;
+}
+
+/**
+ * @brief A fresh, empty fixture directory.
+ */
+fs::path fixture(const TestContext &context, const std::string &name)
+{
+	fs::path dir = context.work_dir / name;
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	return dir;
+}
+
+/**
+ * @brief The names at the top level of the first built-in tree in `out`.
+ */
+std::vector<std::string> tree_names(const std::string &out)
+{
+	std::vector<std::string> names;
+	std::istringstream lines(out);
+	for (std::string line; std::getline(lines, line) && line.rfind("--- File Contents", 0) != 0;)
+	{
+		for (const char *branch : {"├── ", "└── "})
+		{
+			if (line.rfind(branch, 0) == 0)
+			{
+				names.push_back(line.substr(std::string(branch).length()));
+			}
+		}
+	}
+	return names;
+}
+
+std::string joined(const std::vector<std::string> &names)
+{
+	std::string text;
+	for (const auto &name : names)
+	{
+		text += name + "\n";
+	}
+	return text;
+}
+
+/**
+ * @brief One number from a --stats report, e.g. stats_value(err, "output: %*s %*s in %ld writes").
+ * @return -1 if the report has no such line.
+ */
+long stats_value(const std::string &report, const char *format)
+{
+	long value = -1;
+	std::string label(format, std::string(format).find(' ') + 1);
+	size_t at = report.find("\n" + label);
+	if (at != std::string::npos)
+	{
+		std::sscanf(report.c_str() + at + 1, format, &value);
+	}
+	return value;
+}
+
+struct CliRun
+{
+	int status;
+	std::string out;
+	std::string err;
+};
+
+/**
+ * @brief Runs the catlr command line in-process, with stdout and stderr captured.
+ * @param input Sent to its stdin.
+ * @param stdout_path Where stdout goes instead (a file in a listed tree, a terminal); it is
+ * read back only if it is a regular file.
+ */
+CliRun run_cli(const TestContext &context, std::vector<std::string> args, const std::string &input = "",
+			   fs::path out_path = fs::path())
+{
+	fs::path in_path = context.work_dir / "stdin";
+	if (out_path.empty())
+	{
+		out_path = context.work_dir / "stdout";
+	}
+	fs::path err_path = context.work_dir / "stderr";
+	write_file(in_path, input);
+	std::cout.flush();
+	std::cerr.flush();
+	int saved_stdin = dup(STDIN_FILENO);
+	int saved_stdout = dup(STDOUT_FILENO);
+	int saved_stderr = dup(STDERR_FILENO);
+	int in_fd = open(in_path.c_str(), O_RDONLY);
+	int out_fd = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY, 0644);
+	int err_fd = open(err_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	dup2(in_fd, STDIN_FILENO);
+	dup2(out_fd, STDOUT_FILENO);
+	dup2(err_fd, STDERR_FILENO);
+	close(in_fd);
+	close(out_fd);
+	close(err_fd);
+
+	args.insert(args.begin(), "catlr");
+	std::vector<char *> argv;
+	for (auto &arg : args)
+	{
+		argv.push_back(&arg[0]);
+	}
+	argv.push_back(nullptr);
+	int status = catlr::cli_main(static_cast<int>(args.size()), argv.data());
+
+	std::cout.flush();
+	std::cerr.flush();
+	std::cin.clear(); // Reaching the end of this input must not end the next one
+	std::clearerr(stdin);
+	dup2(saved_stdin, STDIN_FILENO);
+	dup2(saved_stdout, STDOUT_FILENO);
+	dup2(saved_stderr, STDERR_FILENO);
+	close(saved_stdin);
+	close(saved_stdout);
+	close(saved_stderr);
+	return {status, fs::is_regular_file(out_path) ? read_file(out_path) : "", read_file(err_path)};
+}
+
+/**
+ * @brief Runs a git command in `repo`, quietly and with a fixed identity.
+ */
+bool git(const TestContext &context, const fs::path &repo, const std::string &command)
+{
+	std::string line = "PATH='" + context.tool_path + "' git -C '" + repo.string() +
+					   "' -c user.name=catlr -c user.email=catlr@example.com -c init.defaultBranch=main " + command + " >/dev/null 2>&1";
+	return std::system(line.c_str()) == 0;
+}
+
+/**
+ * @brief The standard output of a git command in `repo`.
+ */
+std::string git_output(const TestContext &context, const fs::path &repo, const std::string &command)
+{
+	fs::path out_path = context.work_dir / "git_output";
+	std::string line = "PATH='" + context.tool_path + "' git -C '" + repo.string() + "' " + command + " >'" + out_path.string() + "' 2>/dev/null";
+	if (std::system(line.c_str()) != 0)
+	{
+		return "";
+	}
+	return read_file(out_path);
+}
+
+/**
+ * @brief The format version in a repository's .git/index header.
+ */
+int index_version(const fs::path &repo)
+{
+	std::string header = read_file(repo / ".git" / "index").substr(0, 8);
+	return header.size() == 8 ? static_cast<unsigned char>(header[7]) : 0;
+}
+
+// --- Tests ---
+
+/**
+ * @brief --index and --index-file, read back by --extract, and dumps whose index is damaged.
+ */
+void test_dump_index(TestContext &context)
+{
+	fs::path dir = fixture(context, "index");
+	write_file(dir / "tree" / "a.txt", "alpha\n");
+	write_file(dir / "tree" / "sub" / "b.txt", "beta\n");
+
+	CliRun dump = run_cli(context, {(dir / "tree").string(), "--index"});
+	write_file(dir / "dump.txt", dump.out);
+	context.check(dump.status == 0 && has(dump.out, "--- catlr index at "), "--index writes a trailer", dump.out);
+
+	CliRun extracted = run_cli(context, {"--extract", (dir / "dump.txt").string(), "sub/b.txt"});
+	context.check(extracted.status == 0 && extracted.out == "beta\n", "--extract finds a path through the trailer", extracted.out + extracted.err);
+	extracted = run_cli(context, {"--extract", (dir / "dump.txt").string(), "tree/a.txt"});
+	context.check(extracted.status == 0 && extracted.out == "alpha\n", "--extract takes target/path", extracted.out + extracted.err);
+	extracted = run_cli(context, {"--extract", (dir / "dump.txt").string(), "missing.txt"});
+	context.check(extracted.status == 1 && extracted.out.empty(), "--extract of an unknown path fails", extracted.out + extracted.err);
+
+	fs::path sidecar = dir / "plain.txt.idx";
+	CliRun plain = run_cli(context, {(dir / "tree").string(), "--index-file", sidecar.string()});
+	write_file(dir / "plain.txt", plain.out);
+	context.check(!has(plain.out, "--- catlr index at ") && fs::exists(sidecar), "--index-file writes a sidecar instead", plain.out);
+	extracted = run_cli(context, {"--extract", (dir / "plain.txt").string(), "sub/b.txt"});
+	context.check(extracted.status == 0 && extracted.out == "beta\n", "--extract finds a path through the sidecar", extracted.out + extracted.err);
+
+	// One digit of the footer's offset replaced: no crash, and the sidecar is used if present
+	std::string damaged = dump.out;
+	size_t digit = damaged.find_last_of("0123456789");
+	damaged[digit - 1] = 'x';
+	write_file(dir / "damaged.txt", damaged);
+	extracted = run_cli(context, {"--extract", (dir / "damaged.txt").string(), "sub/b.txt"});
+	context.check(extracted.status == 1 && has(extracted.err, "has no index"), "--extract reports a damaged footer", extracted.out + extracted.err);
+	fs::copy_file(sidecar, dir / "damaged.txt.idx");
+	extracted = run_cli(context, {"--extract", (dir / "damaged.txt").string(), "sub/b.txt"});
+	context.check(extracted.status == 0 && extracted.out == "beta\n", "--extract falls back to the sidecar", extracted.out + extracted.err);
+}
+
+/**
+ * @brief --compress=gzip: output over several 256 KiB blocks decompresses to the plain output.
+ */
+void test_compress(TestContext &context)
+{
+#ifndef CATLR_USE_ZLIB
+	std::cerr << "Skipping " << context.test << ": built without -DCATLR_USE_ZLIB." << std::endl;
+	return;
+#else
+	fs::path dir = fixture(context, "compress");
+	std::string text;
+	for (int i = 0; text.size() < 1200 * 1024; ++i)
+	{
+		text += "line " + std::to_string(i) + " " + std::to_string(i * 2654435761u) + "\n";
+	}
+	write_file(dir / "big.txt", text);
+	write_file(dir / "small.txt", "small\n");
+
+	CliRun plain = run_cli(context, {dir.string()});
+	CliRun compressed = run_cli(context, {dir.string(), "--compress=gzip"});
+	context.check(compressed.status == 0 && compressed.out.size() > 2 && compressed.out.compare(0, 2, "\x1f\x8b") == 0,
+				  "--compress=gzip writes gzip", compressed.err);
+
+	// Each block is its own gzip member, so inflate member after member
+	std::string inflated;
+	size_t members = 0;
+	z_stream stream{};
+	inflateInit2(&stream, 16 + MAX_WBITS);
+	stream.next_in = reinterpret_cast<Bytef *>(&compressed.out[0]);
+	stream.avail_in = static_cast<uInt>(compressed.out.size());
+	int result = Z_OK;
+	while (stream.avail_in > 0 && (result == Z_OK || result == Z_STREAM_END))
+	{
+		char chunk[65536];
+		stream.next_out = reinterpret_cast<Bytef *>(chunk);
+		stream.avail_out = sizeof(chunk);
+		result = inflate(&stream, Z_NO_FLUSH);
+		inflated.append(chunk, sizeof(chunk) - stream.avail_out);
+		if (result == Z_STREAM_END)
+		{
+			++members;
+			inflateReset(&stream);
+		}
+	}
+	inflateEnd(&stream);
+	context.check(result == Z_STREAM_END && inflated == plain.out, "the gzip stream decompresses to the plain output");
+	context.check(members > 1, "output over one block is split into several members", std::to_string(members));
+#endif
+}
+
+/**
+ * @brief --dedup prints each content once, and a reference for copies and hardlinks.
+ */
+void test_dedup(TestContext &context)
+{
+	fs::path dir = fixture(context, "dedup");
+	write_file(dir / "a.txt", "same content\n");
+	write_file(dir / "sub" / "b.txt", "same content\n");
+	write_file(dir / "c.txt", "same size!!!\n"); // Same size, other content
+	fs::create_hard_link(dir / "c.txt", dir / "sub" / "link.txt");
+
+	CliRun run = run_cli(context, {dir.string(), "--dedup"});
+	context.check(run.status == 0, "--dedup succeeds", run.err);
+	context.check(count(run.out, "same content\n") == 1 && count(run.out, "same size!!!\n") == 1, "each content is printed once", run.out);
+	context.check(count(run.out, "[identical to ") == 2, "copies and hardlinks print a reference", run.out);
+
+	run = run_cli(context, {dir.string()});
+	context.check(count(run.out, "same content\n") == 2 && !has(run.out, "[identical to "), "without --dedup every file is printed", run.out);
+}
+
+/**
+ * @brief --binary=summary|skip|print, with files classified from their first 4 KiB block.
+ */
+void test_binary(TestContext &context)
+{
+	fs::path dir = fixture(context, "binary");
+	write_file(dir / "image.png", std::string("\x89PNG\r\n\x1a\n", 8) + "0123456789");
+	write_file(dir / "nul.dat", std::string("abc\0def", 7));
+	write_file(dir / "latin1.txt", "h\xe9llo w\xf6rld \xff\xfe\xfd\xfc");
+	write_file(dir / "utf8.txt", "h\xc3\xa9llo w\xc3\xb6rld \xe2\x9c\x93\n");
+	write_file(dir / "late_nul.txt", std::string(5000, 'a') + std::string(1, '\0') + "\n"); // Past the first block
+
+	CliRun run = run_cli(context, {dir.string()});
+	context.check(has(run.out, "--- image.png ---\n[binary, 18 B]\n") && has(run.out, "--- nul.dat ---\n[binary, 7 B]\n") &&
+					  has(run.out, "--- latin1.txt ---\n[binary, "),
+				  "binary files are summarised by default", run.out);
+	context.check(has(run.out, "--- utf8.txt ---\nh\xc3\xa9llo") && has(run.out, "--- late_nul.txt ---\naaaa"),
+				  "UTF-8 text and text with a NUL past the first block are printed", run.out);
+
+	run = run_cli(context, {dir.string(), "--binary=skip"});
+	context.check(!has(run.out, "image.png ---") && !has(run.out, "nul.dat ---") && !has(run.out, "latin1.txt ---") &&
+					  has(run.out, "--- utf8.txt ---"),
+				  "--binary=skip leaves binary files out", run.out);
+	context.check(has(run.out, "├── image.png") || has(run.out, "└── image.png"), "--binary=skip keeps them in the tree", run.out);
+
+	run = run_cli(context, {dir.string(), "--binary=print"});
+	context.check(has(run.out, std::string("--- nul.dat ---\nabc\0def", 23)) && !has(run.out, "[binary, "), "--binary=print prints them", run.out);
+}
+
+/**
+ * @brief --max-file-bytes keeps the head and tail of a file; --max-total-bytes stops reading.
+ */
+void test_budgets(TestContext &context)
+{
+	fs::path dir = fixture(context, "budgets");
+	std::string lines;
+	for (int i = 0; i < 2000; ++i)
+	{
+		lines += "line " + std::to_string(i) + "\n";
+	}
+	write_file(dir / "big.txt", lines);
+	write_file(dir / "small.txt", "small\n");
+
+	CliRun run = run_cli(context, {dir.string(), "--max-file-bytes", "200"});
+	context.check(run.status == 0 && has(run.out, "[truncated: "), "--max-file-bytes marks the cut", run.out);
+	context.check(has(run.out, "\nline 0\n") && has(run.out, "\nline 1999\n") && !has(run.out, "\nline 1000\n"),
+				  "--max-file-bytes keeps the head and the tail", run.out);
+	context.check(run.out.size() < lines.size() / 10 && has(run.out, "small\n"), "--max-file-bytes leaves small files whole", run.out);
+
+	run = run_cli(context, {dir.string(), "--max-total-bytes", "10"});
+	context.check(has(run.out, "--max-total-bytes budget") && !has(run.out, "line 1999"), "--max-total-bytes stops reading", run.out);
+	context.check(has(run.out, "--- End of Listing ---"), "--max-total-bytes still ends the listing", run.out);
+
+	for (const char *count : {"-1", " 100", "+100", "", "K", "12X", "0", "99999999999G", "18446744073709551616"})
+	{
+		run = run_cli(context, {dir.string(), "--max-file-bytes", count});
+		context.check(run.status == 1 && has(run.err, "requires a positive byte count") && run.out.empty(),
+					  std::string("--max-file-bytes rejects '") + count + "'", run.out + run.err);
+	}
+	run = run_cli(context, {dir.string(), "--max-file-bytes", "1k"});
+	context.check(run.status == 0 && has(run.out, "[truncated: "), "--max-file-bytes accepts a K suffix", run.err);
+}
+
+/**
+ * @brief Runs the command line in a child process whose stdout is a pipe that is closed after
+ * `keep` bytes, as with `catlr | head -c keep`.
+ * @return The child's wait status, or -1 if it had not exited after 20 s (it is killed then).
+ */
+int run_into_closed_pipe(const TestContext &context, std::vector<std::string> args, const fs::path &home, size_t keep, std::string &err)
+{
+	fs::path err_path = context.work_dir / "stderr";
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		return -1;
+	}
+	std::cout.flush();
+	std::cerr.flush();
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[1]);
+		int err_fd = open(err_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		dup2(err_fd, STDERR_FILENO);
+		close(err_fd);
+		setenv("HOME", home.c_str(), 1);
+		args.insert(args.begin(), "catlr");
+		std::vector<char *> argv;
+		for (auto &arg : args)
+		{
+			argv.push_back(&arg[0]);
+		}
+		argv.push_back(nullptr);
+		_exit(catlr::cli_main(static_cast<int>(args.size()), argv.data()));
+	}
+	close(fds[1]);
+	char chunk[4096];
+	size_t received = 0;
+	while (received < keep)
+	{
+		ssize_t n = read(fds[0], chunk, std::min(sizeof(chunk), keep - received));
+		if (n <= 0)
+		{
+			break;
+		}
+		received += static_cast<size_t>(n);
+	}
+	close(fds[0]);
+
+	int status = -1;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+	while (waitpid(pid, &status, WNOHANG) == 0)
+	{
+		if (std::chrono::steady_clock::now() > deadline)
+		{
+			kill(pid, SIGKILL);
+			waitpid(pid, nullptr, 0);
+			status = -1;
+			break;
+		}
+		usleep(10000);
+	}
+	err = read_file(err_path);
+	return status;
+}
+
+/**
+ * @brief Runs the catlr command line in a child whose stdout is a non-blocking pipe, read only
+ * after a pause so the pipe fills up first.
+ * @return The child's wait status.
+ */
+int run_into_slow_pipe(const TestContext &context, std::vector<std::string> args, std::string &out, std::string &err)
+{
+	fs::path err_path = context.work_dir / "slow_pipe_stderr";
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		return -1;
+	}
+	std::cout.flush();
+	std::cerr.flush();
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		close(fds[0]);
+		fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[1]);
+		int err_fd = open(err_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		dup2(err_fd, STDERR_FILENO);
+		close(err_fd);
+		args.insert(args.begin(), "catlr");
+		std::vector<char *> argv;
+		for (auto &arg : args)
+		{
+			argv.push_back(&arg[0]);
+		}
+		argv.push_back(nullptr);
+		_exit(catlr::cli_main(static_cast<int>(args.size()), argv.data()));
+	}
+	close(fds[1]);
+	usleep(200000);
+	out.clear();
+	char chunk[4096];
+	ssize_t n;
+	while ((n = read(fds[0], chunk, sizeof(chunk))) > 0)
+	{
+		out.append(chunk, static_cast<size_t>(n));
+	}
+	close(fds[0]);
+	int status = -1;
+	waitpid(pid, &status, 0);
+	err = read_file(err_path);
+	return status;
+}
+
+/**
+ * @brief A closed output pipe stops the walk early, kills a piped printer, and exits with 0.
+ */
+void test_closed_pipe(TestContext &context)
+{
+	fs::path dir = fixture(context, "closed_pipe");
+	fs::path tree = dir / "tree";
+	std::string content(16 * 1024, 'x');
+	for (int i = 0; i < 500; ++i)
+	{
+		write_file(tree / ("file" + std::to_string(i) + ".txt"), content + "\n");
+	}
+
+	std::string err;
+	int status = run_into_closed_pipe(context, {tree.string(), "--stats"}, context.work_dir / "home", 64 * 1024, err);
+	context.check(status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0, "a closed pipe ends the run quietly, with status 0", err);
+	long opened = -1;
+	size_t at = err.find("files: ");
+	if (at != std::string::npos)
+	{
+		std::sscanf(err.c_str() + at, "files: %ld opened", &opened);
+	}
+	context.check(opened >= 0 && opened < 100, "the walk stops soon after the pipe closes", err);
+
+	// A printer that never ends, piped back through catlr (--index captures children)
+	fs::path home = dir / "home";
+	fs::path printer = dir / "endless";
+	fs::path pid_file = dir / "printer.pid";
+	write_file(printer, "#!/bin/sh\necho $$ > '" + pid_file.string() + "'\nwhile :; do echo endless; done\n");
+	fs::permissions(printer, fs::perms::owner_all);
+	write_file(home / ".config" / "catlr" / "catlr.conf", "filePrintCommand = " + printer.string() + "\n");
+	status = run_into_closed_pipe(context, {tree.string(), "--index"}, home, 64 * 1024, err);
+	context.check(status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0, "a closed pipe ends a run with a piped printer", err);
+	// sh -c may run the printer as a grandchild, which then ends on SIGPIPE rather than SIGTERM
+	pid_t printer_pid = static_cast<pid_t>(std::atol(read_file(pid_file).c_str()));
+	bool printer_ended = false;
+	for (int wait = 0; printer_pid > 0 && wait < 500 && !printer_ended; ++wait)
+	{
+		printer_ended = kill(printer_pid, 0) != 0 && errno == ESRCH;
+		usleep(10000);
+	}
+	context.check(printer_ended, "the piped printer ends with the run", read_file(pid_file));
+}
+
+/**
+ * @brief --git-tracked reads the file set from index versions 2, 3 (extended flags) and 4
+ * (prefix-compressed paths).
+ */
+void test_git_index(TestContext &context)
+{
+	if (!context.has_git)
+	{
+		std::cerr << "Skipping " << context.test << ": git is not installed." << std::endl;
+		return;
+	}
+	fs::path repo = fixture(context, "git_index");
+	write_file(repo / "README", "readme\n");
+	write_file(repo / "src" / "lib" / "alpha.c", "alpha\n");
+	write_file(repo / "src" / "lib" / "alphabet.c", "alphabet\n");
+	write_file(repo / "src" / "lib2" / "beta.c", "beta\n");
+	write_file(repo / "src" / "main.c", "main\n");
+	context.check(git(context, repo, "init -q") && git(context, repo, "add ."), "git add");
+	write_file(repo / "untracked.txt", "untracked\n");
+
+	std::vector<std::string> tracked = {"--- README ---", "--- src/lib/alpha.c ---", "--- src/lib/alphabet.c ---",
+										"--- src/lib2/beta.c ---", "--- src/main.c ---"};
+	std::string previous;
+	for (int version : {2, 3, 4})
+	{
+		if (version == 3)
+		{
+			// An intent-to-add entry needs an extended flag, which needs version 3
+			write_file(repo / "src" / "intent.c", "intent\n");
+			git(context, repo, "add -N src/intent.c");
+			tracked.push_back("--- src/intent.c ---");
+		}
+		git(context, repo, "update-index --index-version " + std::to_string(version));
+		std::string label = "index v" + std::to_string(version);
+		context.check(index_version(repo) == version, label + " is written");
+
+		CliRun run = run_cli(context, {repo.string(), "--git-tracked"});
+		context.check(run.status == 0 && has(run.out, "Info: Listing files tracked in the git index."), label + ": read", run.out + run.err);
+		bool all_listed = true;
+		for (const auto &header : tracked)
+		{
+			all_listed = all_listed && count(run.out, header) == 1;
+		}
+		context.check(all_listed, label + ": every tracked file is printed once", run.out);
+		context.check(!has(run.out, "untracked"), label + ": untracked files are left out", run.out);
+		if (version == 4)
+		{
+			context.check(run.out == previous, "index v4 lists what v3 lists", run.out);
+		}
+		previous = run.out;
+	}
+
+	CliRun run = run_cli(context, {repo.string(), "--git-tracked", "-ip", ".c", "-le", "src/lib2/"});
+	context.check(has(run.out, "--- src/main.c ---") && !has(run.out, "--- README ---") && !has(run.out, "beta"),
+				  "--git-tracked applies the filters", run.out);
+
+	// The tree from the index is written in buffer-sized writes, not a write per line. The
+	// --stats counters are kept for the whole process, so each run is measured as a difference.
+	for (int i = 0; i < 300; ++i)
+	{
+		write_file(repo / "many" / ("file" + std::to_string(i) + ".c"), "x\n");
+	}
+	git(context, repo, "add many");
+	const char *writes = "output: %*s %*s in %ld writes";
+	long before_walk = stats_value(run_cli(context, {repo.string(), "--stats"}).err, writes);
+	long after_walk = stats_value(run_cli(context, {repo.string(), "-pi", ".none", "--stats"}).err, writes);
+	long after_index = stats_value(run_cli(context, {repo.string(), "--git-tracked", "-pi", ".none", "--stats"}).err, writes);
+	context.check(before_walk >= 0 && after_index - after_walk <= after_walk - before_walk + 2,
+				  "the tree from the index takes no more writes than the walked tree",
+				  std::to_string(after_walk - before_walk) + " walked, " + std::to_string(after_index - after_walk) + " from the index");
+}
+
+/**
+ * @brief --rev reads loose objects, and packs with offset and ref deltas; bad revisions are
+ * reported rather than aborting.
+ */
+void test_revision(TestContext &context)
+{
+#ifndef CATLR_USE_ZLIB
+	std::cerr << "Skipping " << context.test << ": built without -DCATLR_USE_ZLIB." << std::endl;
+	return;
+#else
+	if (!context.has_git)
+	{
+		std::cerr << "Skipping " << context.test << ": git is not installed." << std::endl;
+		return;
+	}
+	fs::path repo = fixture(context, "revision");
+	std::string first, second;
+	for (int i = 0; i < 400; ++i)
+	{
+		first += "line " + std::to_string(i) + "\n";
+		second += "line " + std::to_string(i) + (i == 200 ? " changed\n" : "\n");
+	}
+	write_file(repo / "big.txt", first);
+	write_file(repo / "sub" / "same.txt", "unchanged\n");
+	context.check(git(context, repo, "init -q") && git(context, repo, "add .") && git(context, repo, "commit -q -m one") &&
+					  git(context, repo, "tag -a v1 -m v1"),
+				  "first commit");
+	write_file(repo / "big.txt", second);
+	context.check(git(context, repo, "commit -q -a -m two"), "second commit");
+	write_file(repo / "big.txt", "work tree only\n");
+	std::string head = git_output(context, repo, "rev-parse HEAD").substr(0, 12);
+
+	auto check_revisions = [&](const std::string &storage)
+	{
+		CliRun run = run_cli(context, {repo.string(), "--rev", "HEAD"});
+		context.check(run.status == 0 && has(run.out, "\nline 200 changed\n") && has(run.out, "\nline 399\n") && has(run.out, "unchanged\n"),
+					  storage + ": --rev HEAD prints the commit", run.out + run.err);
+		context.check(!has(run.out, "work tree only"), storage + ": --rev ignores the work tree", run.out);
+		run = run_cli(context, {repo.string(), "--rev", head});
+		context.check(has(run.out, "\nline 200 changed\n"), storage + ": --rev takes an abbreviated id", run.out + run.err);
+		for (const char *revision : {"HEAD~1", "HEAD^", "v1"})
+		{
+			run = run_cli(context, {repo.string(), "--rev", revision});
+			context.check(run.status == 0 && has(run.out, "\nline 200\n") && !has(run.out, " changed\n"),
+						  storage + ": --rev " + revision + " prints the first commit", run.out + run.err);
+		}
+	};
+	check_revisions("loose objects");
+	git(context, repo, "repack -a -d -f -q");
+	context.check(git_output(context, repo, "count-objects -v").rfind("count: 0\n", 0) == 0, "repack leaves no loose objects");
+	std::string pack_index = (repo / ".git" / "objects" / "pack").string() + "/*.idx";
+	context.check(has(git_output(context, repo, "verify-pack -s " + pack_index), "chain length"), "the pack holds deltas");
+	check_revisions("offset deltas");
+	git(context, repo, "-c repack.useDeltaBaseOffset=false repack -a -d -f -q");
+	check_revisions("ref deltas");
+
+	CliRun run = run_cli(context, {repo.string(), "--rev", "HEAD^0"});
+	context.check(run.status == 0 && has(run.out, "\nline 200 changed\n"), "--rev HEAD^0 is HEAD", run.out + run.err);
+	run = run_cli(context, {repo.string(), "--rev", "HEAD~~"});
+	context.check(has(run.err, "past the root commit"), "--rev HEAD~~ takes two steps", run.err);
+	for (const char *revision : {"HEAD~1x", "HEAD^{tree}", "HEAD~1:big.txt", "HEAD:big.txt", "HEAD^2"})
+	{
+		run = run_cli(context, {repo.string(), "--rev", revision});
+		context.check(!has(run.out, "--- big.txt ---") && (has(run.err, "unknown or ambiguous revision") || has(run.err, "only first-parent steps")),
+					  std::string("--rev ") + revision + " is rejected", run.out + run.err);
+	}
+
+	run = run_cli(context, {repo.string(), "--rev", "HEAD~99999999999"});
+	context.check(has(run.err, "step count out of range"), "--rev with a huge step count is an error", run.err);
+	run = run_cli(context, {repo.string(), "--rev", "HEAD~5"});
+	context.check(!has(run.out, "--- big.txt ---") && !run.err.empty(), "--rev past the first commit is an error", run.out + run.err);
+	run = run_cli(context, {repo.string(), "--rev", "no-such-branch"});
+	context.check(has(run.err, "unknown or ambiguous revision 'no-such-branch'"), "--rev with an unknown name is an error", run.err);
+
+	// A corrupt pack index: large-offset references past its end, then a fanout that decreases
+	fs::path index_path;
+	for (const auto &entry : fs::directory_iterator(repo / ".git" / "objects" / "pack"))
+	{
+		if (entry.path().extension() == ".idx")
+		{
+			index_path = entry.path();
+		}
+	}
+	std::string index = read_file(index_path);
+	size_t objects = (static_cast<unsigned char>(index[8 + 255 * 4 + 2]) << 8) | static_cast<unsigned char>(index[8 + 255 * 4 + 3]);
+	std::string corrupt = index;
+	corrupt.replace(8 + 256 * 4 + objects * 24, objects * 4, std::string(objects * 4, '\xff'));
+	fs::permissions(index_path, fs::perms::owner_read | fs::perms::owner_write);
+	write_file(index_path, corrupt);
+	run = run_cli(context, {repo.string(), "--rev", "HEAD"});
+	context.check(!has(run.out, "--- big.txt ---") && has(run.err, "Error: --rev:"), "--rev rejects large offsets past the index", run.out + run.err);
+	corrupt = index;
+	corrupt.replace(8, 4, "\xff\xff\xff\xff");
+	write_file(index_path, corrupt);
+	run = run_cli(context, {repo.string(), "--rev", "HEAD"});
+	context.check(!has(run.out, "--- big.txt ---") && has(run.err, "Error: --rev:"), "--rev rejects a corrupt fanout", run.out + run.err);
+#endif
+}
+
+/**
+ * @brief --write-manifest, read back by --changed-since: unchanged files are left out, changed
+ * and new ones printed, and malformed manifest lines ignored.
+ */
+void test_manifest(TestContext &context)
+{
+	fs::path dir = fixture(context, "manifest");
+	fs::path tree = dir / "tree";
+	fs::path manifest = dir / "manifest";
+	write_file(tree / "a.txt", "alpha\n");
+	write_file(tree / "sub" / "b.txt", "beta\n");
+
+	CliRun run = run_cli(context, {tree.string(), "--write-manifest", manifest.string()});
+	std::string saved = read_file(manifest);
+	context.check(run.status == 0 && saved.rfind("catlr-manifest 1 ", 0) == 0 && count(saved, "\n") == 3, "--write-manifest records every file", saved);
+
+	run = run_cli(context, {tree.string(), "--changed-since", manifest.string()});
+	context.check(run.status == 0 && !has(run.out, "--- a.txt ---") && !has(run.out, "--- sub/b.txt ---"), "unchanged files are left out", run.out + run.err);
+
+	write_file(tree / "sub" / "b.txt", "beta, longer\n");
+	write_file(tree / "c.txt", "new\n");
+	run = run_cli(context, {tree.string(), "--changed-since", manifest.string()});
+	context.check(!has(run.out, "--- a.txt ---") && has(run.out, "beta, longer\n") && has(run.out, "--- c.txt ---"),
+				  "changed and new files are printed", run.out + run.err);
+
+	// A hash field that is not hex: the line is ignored, so a.txt counts as new
+	std::string broken;
+	std::istringstream lines(saved);
+	for (std::string line; std::getline(lines, line);)
+	{
+		if (has(line, "\ta.txt\t"))
+		{
+			line = line.substr(0, line.rfind(' ') + 1) + "zz";
+		}
+		broken += line + "\n";
+	}
+	write_file(manifest, broken + "tree\tgarbage\n");
+	run = run_cli(context, {tree.string(), "--changed-since", manifest.string()});
+	context.check(run.status == 0 && has(run.out, "--- a.txt ---") && has(run.out, "--- End of Listing ---"),
+				  "a malformed manifest line is ignored", run.out + run.err);
+
+#ifdef CATLR_USE_ZLIB
+	if (!context.has_git)
+	{
+		return;
+	}
+	fs::path repo = fixture(context, "manifest_git");
+	write_file(repo / "kept.txt", "kept\n");
+	write_file(repo / "edited.txt", "before\n");
+	git(context, repo, "init -q");
+	git(context, repo, "add .");
+	git(context, repo, "commit -q -m one");
+	write_file(repo / "edited.txt", "after, longer\n");
+	run = run_cli(context, {repo.string(), "--changed-since", "HEAD"});
+	context.check(run.status == 0 && has(run.out, "after, longer\n") && !has(run.out, "--- kept.txt ---"),
+				  "--changed-since HEAD prints only edited files", run.out + run.err);
+#endif
+}
+
+/**
+ * @brief --cache replays unchanged directories from the snapshot, re-reads changed ones, and
+ * ignores a damaged snapshot.
+ */
+void test_cache(TestContext &context)
+{
+	fs::path tree = fixture(context, "cache") / "tree";
+	write_file(tree / "top.txt", "top\n");
+	write_file(tree / "a" / "b" / "deep.txt", "deep\n");
+	write_file(tree / "c" / "gone.txt", "gone\n");
+	// Directories changed in the second the snapshot is written are never replayed
+	auto past = fs::file_time_type::clock::now() - std::chrono::hours(1);
+	for (const fs::path &dir : {tree, tree / "a", tree / "a" / "b", tree / "c"})
+	{
+		fs::last_write_time(dir, past);
+	}
+
+	// The --stats counters are kept for the whole process, so each run is measured as a difference
+	long read = 0, replayed = 0, newly_read = 0, newly_replayed = 0;
+	auto stats_run = [&](bool use_cache)
+	{
+		std::vector<std::string> args = {tree.string(), "--stats"};
+		if (use_cache)
+		{
+			args.push_back("--cache");
+		}
+		CliRun run = run_cli(context, args);
+		long total_read = -1, total_replayed = -1;
+		size_t at = run.err.find("directories: ");
+		if (at != std::string::npos)
+		{
+			std::sscanf(run.err.c_str() + at, "directories: %ld read, %ld from cache", &total_read, &total_replayed);
+		}
+		newly_read = total_read - read;
+		newly_replayed = total_replayed - replayed;
+		read = total_read;
+		replayed = total_replayed;
+		return run;
+	};
+	std::string expected = run_cli(context, {tree.string()}).out;
+	stats_run(false);
+
+	CliRun run = stats_run(true);
+	context.check(run.status == 0 && run.out == expected, "the first --cache run prints what a plain run prints", run.out);
+	context.check(newly_read == 4 && newly_replayed == 0, "the first --cache run reads every directory", run.err);
+	run = stats_run(true);
+	context.check(run.out == expected, "a replayed run prints what a plain run prints", run.out);
+	context.check(newly_read == 0 && newly_replayed == 4, "unchanged directories are replayed", run.err);
+
+	write_file(tree / "a" / "new.txt", "new\n");
+	fs::remove(tree / "c" / "gone.txt");
+	run = stats_run(true);
+	expected = run_cli(context, {tree.string()}).out;
+	context.check(run.out == expected && has(run.out, "--- a/new.txt ---") && !has(run.out, "gone"), "changed directories are read again", run.out);
+	context.check(newly_read == 2 && newly_replayed == 2, "only changed directories are read", run.err);
+
+	// Every truncation of the snapshot must be rejected or read within bounds
+	fs::path snapshot;
+	for (const auto &entry : fs::directory_iterator(context.work_dir / "home" / ".cache" / "catlr"))
+	{
+		snapshot = entry.path();
+	}
+	std::string saved = read_file(snapshot);
+	context.check(saved.rfind(std::string("CATLRDC\0", 8), 0) == 0, "the snapshot is written", snapshot.string());
+	bool all_intact = true;
+	for (size_t length = 0; length < saved.size(); length += 1 + saved.size() / 40)
+	{
+		write_file(snapshot, saved.substr(0, length));
+		run = run_cli(context, {tree.string(), "--cache"});
+		all_intact = all_intact && run.out == expected;
+	}
+	context.check(all_intact, "a truncated snapshot is ignored", run.out);
+}
+
+/**
+ * @brief --cache-output replays an unchanged tree's output, stores it again after an edit,
+ * evicts the least recently used output past outputCacheSize, and replays into a full pipe.
+ */
+void test_output_cache(TestContext &context)
+{
+	fs::path dir = fixture(context, "output_cache");
+	fs::path home = dir / "home";
+	fs::path outputs = home / ".cache" / "catlr" / "output";
+	setenv("HOME", home.c_str(), 1);
+	setenv("XDG_CACHE_HOME", (home / ".cache").c_str(), 1);
+	auto past = fs::file_time_type::clock::now() - std::chrono::hours(1);
+	auto make_tree = [&](const std::string &name, size_t size)
+	{
+		fs::path tree = dir / name;
+		write_file(tree / "data.txt", std::string(size, 'x') + "\n");
+		fs::last_write_time(tree / "data.txt", past);
+		fs::last_write_time(tree, past);
+		return tree;
+	};
+	auto stored = [&]()
+	{
+		size_t files = 0;
+		std::error_code ec;
+		for (auto it = fs::directory_iterator(outputs, ec); !ec && it != fs::directory_iterator(); ++it)
+		{
+			files += it->path().extension() == ".out";
+		}
+		return files;
+	};
+
+	// A hit opens no files, so the --stats counters measure it as a difference
+	long opened = 0;
+	auto opened_by = [&](const fs::path &tree, CliRun &run)
+	{
+		run = run_cli(context, {tree.string(), "--cache-output", "--stats"});
+		long total = stats_value(run.err, "files: %ld opened");
+		long newly = total - opened;
+		opened = total;
+		return newly;
+	};
+
+	fs::path big = make_tree("big", 300 * 1024);
+	std::string expected = run_cli(context, {big.string()}).out;
+	CliRun run;
+	opened_by(big, run);
+	context.check(run.status == 0 && run.out == expected && stored() == 1, "a miss prints the output and stores it", run.out + run.err);
+	long newly = opened_by(big, run);
+	context.check(run.status == 0 && run.out == expected && newly == 0, "an unchanged tree is replayed", run.err);
+
+	std::string out, err;
+	int status = run_into_slow_pipe(context, {big.string(), "--cache-output"}, out, err);
+	context.check(status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && out == expected,
+				  "a replay into a full non-blocking pipe waits for it to drain", err + " (" + std::to_string(out.size()) + " bytes)");
+
+	write_file(big / "data.txt", "edited\n");
+	fs::last_write_time(big / "data.txt", past - std::chrono::minutes(1));
+	newly = opened_by(big, run);
+	context.check(run.status == 0 && has(run.out, "\nedited\n") && !has(run.out, "xxx") && newly > 0, "an edited tree misses", run.out + run.err);
+	newly = opened_by(big, run);
+	context.check(has(run.out, "\nedited\n") && newly == 0, "the edited tree's output is stored again", run.err);
+
+	// Room for two of these outputs: a replay refreshes the first, so the second is evicted
+	write_file(home / ".config" / "catlr" / "catlr.conf", "outputCacheSize = 25K\n");
+	fs::remove_all(outputs);
+	fs::path first = make_tree("first", 10 * 1024);
+	fs::path second = make_tree("second", 10 * 1024);
+	fs::path third = make_tree("third", 10 * 1024);
+	opened_by(first, run);
+	opened_by(second, run);
+	newly = opened_by(first, run);
+	context.check(newly == 0 && stored() == 2, "two outputs fit under outputCacheSize", run.err);
+	opened_by(third, run);
+	context.check(stored() == 2, "storing a third output evicts one", std::to_string(stored()));
+	long first_opened = opened_by(first, run);
+	long third_opened = opened_by(third, run);
+	long second_opened = opened_by(second, run);
+	context.check(first_opened == 0 && third_opened == 0 && second_opened > 0, "the least recently used output is the one evicted",
+				  std::to_string(first_opened) + " " + std::to_string(third_opened) + " " + std::to_string(second_opened));
+
+	setenv("HOME", (context.work_dir / "home").c_str(), 1);
+	setenv("XDG_CACHE_HOME", (context.work_dir / "home" / ".cache").c_str(), 1);
+}
+
+/**
+ * @brief --connect answers through a --serve server with the client's stdout checks intact (the
+ * terminal refusal, the I/O loop skip), even while another client holds a silent connection.
+ */
+void test_serve(TestContext &context)
+{
+	fs::path dir = fixture(context, "serve");
+	fs::path tree = dir / "tree";
+	write_file(tree / "a.txt", "alpha\n");
+	write_file(tree / "sub" / "b.txt", "beta\n");
+	fs::path socket_path = dir / "catlr.sock";
+	std::string connect_arg = "--connect=" + socket_path.string();
+
+	// The server's printer marks what it prints, which tells a served answer from a local one
+	fs::path server_home = dir / "home";
+	fs::path printer = dir / "printer";
+	write_file(printer, "#!/bin/sh\necho served\n");
+	fs::permissions(printer, fs::perms::owner_all);
+	write_file(server_home / ".config" / "catlr" / "catlr.conf", "filePrintCommand = " + printer.string() + "\n");
+	std::cout.flush();
+	std::cerr.flush();
+	pid_t server = fork();
+	if (server == 0)
+	{
+		int null_fd = open("/dev/null", O_WRONLY);
+		dup2(null_fd, STDOUT_FILENO);
+		dup2(null_fd, STDERR_FILENO);
+		close(null_fd);
+		setenv("HOME", server_home.c_str(), 1);
+		std::string serve = "--serve=" + socket_path.string();
+		char *argv[] = {const_cast<char *>("catlr"), &serve[0], nullptr};
+		_exit(catlr::cli_main(2, argv));
+	}
+
+	struct sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, socket_path.c_str());
+	int silent_fd = -1;
+	for (int wait = 0; wait < 500 && silent_fd < 0; ++wait)
+	{
+		silent_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (connect(silent_fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)
+		{
+			close(silent_fd);
+			silent_fd = -1;
+			usleep(10000);
+		}
+	}
+	context.check(silent_fd >= 0, "the server listens", socket_path.string());
+
+	// A client that connects and sends nothing must not hold up the next one for good
+	pid_t client = fork();
+	if (client == 0)
+	{
+		CliRun run = run_cli(context, {tree.string(), connect_arg});
+		_exit(run.status == 0 && has(run.out, "--- sub/b.txt ---\nserved\n") ? 0 : 1);
+	}
+	int status = -1;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+	while (waitpid(client, &status, WNOHANG) == 0)
+	{
+		if (std::chrono::steady_clock::now() > deadline)
+		{
+			kill(client, SIGKILL);
+			waitpid(client, nullptr, 0);
+			status = -1;
+			break;
+		}
+		usleep(10000);
+	}
+	context.check(status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0, "a silent client does not block the server", read_file(context.work_dir / "stdout"));
+	if (silent_fd >= 0)
+	{
+		close(silent_fd);
+	}
+
+	CliRun run = run_cli(context, {tree.string(), connect_arg});
+	context.check(run.status == 0 && has(run.out, "--- a.txt ---\nserved\n"), "--connect is answered by the server", run.out + run.err);
+
+	fs::path listing = tree / "listing.txt";
+	run = run_cli(context, {tree.string(), connect_arg}, "", listing);
+	context.check(has(run.err, "--- listing.txt ---\n[Warning: Skipping file to avoid I/O loop") && has(run.out, "--- a.txt ---\nserved\n"),
+				  "a served query skips the client's output file", run.out + run.err);
+	fs::remove(listing);
+
+#ifdef CATLR_USE_ZLIB
+	int terminal = posix_openpt(O_RDWR | O_NOCTTY);
+	if (terminal >= 0 && grantpt(terminal) == 0 && unlockpt(terminal) == 0)
+	{
+		run = run_cli(context, {tree.string(), "--compress=gzip", connect_arg}, "", ptsname(terminal));
+		context.check(run.status == 1 && has(run.err, "Refusing to write compressed data to a terminal"),
+					  "a served query refuses compressed output to the client's terminal", run.err);
+	}
+	if (terminal >= 0)
+	{
+		close(terminal);
+	}
+#endif
+
+	kill(server, SIGTERM);
+	waitpid(server, nullptr, 0);
+}
+
+/**
+ * @brief A directory over --sort-memory, sorted in spilled runs and merged, prints what the
+ * in-memory sort prints, in every order and with a cap.
+ */
+void test_external_sort(TestContext &context)
+{
+	fs::path dir = fixture(context, "external_sort");
+	const char *prefixes[] = {"file", "File", "FILE_", "a", "Z"};
+	for (int i = 0; i < 3000; ++i)
+	{
+		std::string name = prefixes[i % 5] + std::to_string(i * 7919 % 5000) + (i % 7 == 0 ? "b" : "") + ".txt";
+		if (i % 100 == 0)
+		{
+			fs::create_directories(dir / ("dir" + std::to_string(i)));
+			write_file(dir / ("dir" + std::to_string(i)) / "inner.txt", "x");
+		}
+		else
+		{
+			write_file(dir / name, "");
+		}
+	}
+
+	CliRun run = run_cli(context, {dir.string(), "--sort-memory", "1K", "--stats"});
+	long streamed = 0, spilled = 0;
+	size_t at = run.err.find("streamed: ");
+	if (at != std::string::npos)
+	{
+		std::sscanf(run.err.c_str() + at, "streamed: %ld directories over --sort-memory, %ld sorted runs spilled", &streamed, &spilled);
+	}
+	context.check(streamed >= 1 && spilled > 1, "a large directory is sorted in spilled runs", run.err);
+
+	for (const char *order : {"--sort=bytes", "--sort=natural", "--sort=icase"})
+	{
+		for (const char *cap : {"", "50"})
+		{
+			std::vector<std::string> args = {dir.string(), order};
+			if (cap[0] != '\0')
+			{
+				args.insert(args.end(), {"--max-entries-per-dir", cap});
+			}
+			std::string in_memory = run_cli(context, args).out;
+			args.insert(args.end(), {"--sort-memory", "1K"});
+			run = run_cli(context, args);
+			context.check(run.status == 0 && run.out == in_memory,
+						  std::string(order) + (cap[0] != '\0' ? " with a cap" : "") + ": the merged order matches the in-memory sort", run.out + run.err);
+		}
+	}
+}
+
+/**
+ * @brief --sort=bytes|natural|icase order names as promised, including names that only differ
+ * past a prefix every name in the directory shares, and digit runs past 64 bits.
+ */
+void test_sort_keys(TestContext &context)
+{
+	fs::path mixed = fixture(context, "sort_keys") / "mixed";
+	std::vector<std::string> bytes = {"File3", "README", "Zeta", "alpha", "common_prefix_name_a10", "common_prefix_name_a9",
+									  "common_prefix_name_b", "file02", "file1", "file10", "file2", "file9x",
+									  "n18446744073709551615", "n18446744073709551616", "n99999999999999999999999", "readme.txt"};
+	std::vector<std::string> natural = {"File3", "README", "Zeta", "alpha", "common_prefix_name_a9", "common_prefix_name_a10",
+										"common_prefix_name_b", "file1", "file02", "file2", "file9x", "file10",
+										"n18446744073709551615", "n18446744073709551616", "n99999999999999999999999", "readme.txt"};
+	std::vector<std::string> icase = {"alpha", "common_prefix_name_a10", "common_prefix_name_a9", "common_prefix_name_b", "file02",
+									  "file1", "file10", "file2", "File3", "file9x", "n18446744073709551615",
+									  "n18446744073709551616", "n99999999999999999999999", "README", "readme.txt", "Zeta"};
+	for (const auto &name : bytes)
+	{
+		write_file(mixed / name, "");
+	}
+	fs::path shared = context.work_dir / "sort_keys" / "shared";
+	for (const char *name : {"same_long_prefix_item9", "same_long_prefix_item10", "same_long_prefix_itemB", "same_long_prefix_itema"})
+	{
+		write_file(shared / name, "");
+	}
+
+	const struct
+	{
+		const char *flag;
+		std::vector<std::string> mixed;
+		std::vector<std::string> shared;
+	} orders[] = {
+		{"--sort=bytes", bytes, {"same_long_prefix_item10", "same_long_prefix_item9", "same_long_prefix_itemB", "same_long_prefix_itema"}},
+		{"--sort=natural", natural, {"same_long_prefix_item9", "same_long_prefix_item10", "same_long_prefix_itemB", "same_long_prefix_itema"}},
+		{"--sort=icase", icase, {"same_long_prefix_item10", "same_long_prefix_item9", "same_long_prefix_itema", "same_long_prefix_itemB"}},
+	};
+	for (const auto &order : orders)
+	{
+		CliRun run = run_cli(context, {mixed.string(), order.flag});
+		context.check(run.status == 0 && tree_names(run.out) == order.mixed, std::string(order.flag) + " orders mixed names",
+					  joined(tree_names(run.out)) + run.err);
+		run = run_cli(context, {shared.string(), order.flag});
+		context.check(tree_names(run.out) == order.shared, std::string(order.flag) + " orders names past a shared prefix",
+					  joined(tree_names(run.out)) + run.err);
+	}
+	CliRun run = run_cli(context, {mixed.string()});
+	context.check(tree_names(run.out) == bytes, "byte order is the default", joined(tree_names(run.out)));
+	catlr::StringSink sink;
+	context.check(catlr::print_tree(mixed, catlr::Filters(), sink) && tree_names(sink.text) == bytes, "the library's print_tree sorts by bytes", sink.text);
+	run = run_cli(context, {mixed.string(), "--sort=size"});
+	context.check(has(run.err, "Warning: Unknown sort order 'size'") && tree_names(run.out) == bytes, "an unknown order warns and keeps byte order", run.err);
+}
+
+/**
+ * @brief Several targets: printed in argument order, repeats and targets the outer listing
+ * reaches skipped, and a target the outer .gitignore hides listed with its own.
+ */
+void test_targets(TestContext &context)
+{
+	fs::path dir = fixture(context, "targets");
+	fs::path tree = dir / "tree";
+	write_file(tree / ".gitignore", "build/\n");
+	write_file(tree / "top.txt", "top\n");
+	write_file(tree / "build" / ".gitignore", "*.tmp\n");
+	write_file(tree / "build" / "o.o", "object\n");
+	write_file(tree / "build" / "x.tmp", "temporary\n");
+	write_file(dir / "other" / "other.txt", "other\n");
+
+	write_file(tree / "src" / "deep" / "main.c", "int main;\n");
+
+	CliRun run = run_cli(context, {tree.string(), (tree / "src" / "deep").string()});
+	context.check(run.status == 0 && has(run.err, "Warning: Skipping '" + (tree / "src" / "deep").string() + "': it is inside"),
+				  "a nested target the outer listing reaches is skipped", run.err);
+	context.check(count(run.out, "--- Directory Tree for: ") == 1 && count(run.out, "int main;") == 1, "a skipped nested target is listed once", run.out);
+	run = run_cli(context, {(tree / "src" / "deep").string(), (tree / "src" / ".." / "src").string(), tree.string()});
+	context.check(count(run.err, "it is inside") == 2 && count(run.out, "--- Directory Tree for: ") == 1 && count(run.out, "int main;") == 1,
+				  "nested targets are skipped whatever their order", run.out + run.err);
+	run = run_cli(context, {tree.string(), (tree / "src").string(), "-le", "src"});
+	context.check(!has(run.err, "Skipping") && count(run.out, "--- Directory Tree for: ") == 2, "a nested target the outer filters exclude is listed",
+				  run.out + run.err);
+
+	run = run_cli(context, {tree.string(), (tree / "build").string()});
+	context.check(run.status == 0 && !has(run.err, "Skipping"), "a nested target the outer .gitignore hides is not skipped", run.err);
+	context.check(before(run.out, "--- Directory Tree for: tree ---", "--- Directory Tree for: build ---") && has(run.out, "--- o.o ---\nobject\n"),
+				  "a nested target the outer .gitignore hides is listed on its own", run.out);
+	context.check(!has(run.out, "temporary") && !has(run.out, "--- build/o.o ---"), "each target keeps its own .gitignore", run.out);
+
+	run = run_cli(context, {tree.string(), (tree / "build" / "..").string(), (dir / "other").string(), tree.string() + "/"});
+	context.check(count(run.err, "is the same directory as") == 2 && count(run.out, "--- Directory Tree for: tree ---") == 1,
+				  "repeats of a target are skipped", run.out + run.err);
+	context.check(before(run.out, "--- Directory Tree for: tree ---", "--- Directory Tree for: other ---"), "targets are listed in argument order", run.out);
+
+	// However the targets are scheduled, the output is each target's own listing, in order
+	std::string first = run_cli(context, {(dir / "other").string()}).out;
+	std::string second = run_cli(context, {(tree / "build").string()}).out;
+	std::string end = "--- End of Listing ---\n";
+	run = run_cli(context, {(dir / "other").string(), (tree / "build").string()});
+	context.check(first.size() > end.size() && run.out == first.substr(0, first.size() - end.size()) + second,
+				  "several targets print their listings back to back", run.out);
+}
+
+/**
+ * @brief --files-from takes NUL- or newline-separated lists, from a file or stdin, and still
+ * applies the filters.
+ */
+void test_files_from(TestContext &context)
+{
+	fs::path dir = fixture(context, "files_from");
+	fs::path tree = fs::canonical(dir) / "tree";
+	write_file(tree / "a.txt", "alpha\n");
+	write_file(tree / "sub" / "b.txt", "beta\n");
+	write_file(tree / "sub" / "c.log", "log\n");
+	write_file(tree / "unlisted.txt", "unlisted\n");
+	fs::path list = dir / "list";
+
+	write_file(list, "a.txt\nsub/b.txt\nsub/c.log\n");
+	CliRun expected = run_cli(context, {tree.string(), "--files-from", list.string()});
+	context.check(expected.status == 0 && has(expected.out, "--- a.txt ---\nalpha\n") && has(expected.out, "--- sub/b.txt ---") &&
+					  has(expected.out, "--- sub/c.log ---") && !has(expected.out, "unlisted"),
+				  "a newline-separated list gives the file set", expected.out + expected.err);
+
+	const struct
+	{
+		const char *what;
+		std::string list;
+	} lists[] = {
+		{"NUL-separated", std::string("a.txt\0sub/b.txt\0sub/c.log\0", 26)},
+		{"CRLF-separated", "a.txt\r\nsub/b.txt\r\nsub/c.log\r\n"},
+		{"unterminated", "sub/c.log\na.txt\nsub/b.txt"},
+		{"absolute and ./", (tree / "a.txt").string() + "\n./sub/b.txt\nsub//c.log\n\n"},
+		{"directory", "a.txt\nsub/\nsub/b.txt\nsub/c.log\n"},
+	};
+	for (const auto &entry : lists)
+	{
+		write_file(list, entry.list);
+		CliRun run = run_cli(context, {tree.string(), "--files-from", list.string()});
+		context.check(run.out == expected.out && run.err == expected.err, std::string("a ") + entry.what + " list gives the same listing", run.out + run.err);
+	}
+
+	write_file(list, "a.txt\n../outside.txt\n" + (dir / "elsewhere").string() + "\nsub/b.txt\nsub/c.log\n");
+	CliRun run = run_cli(context, {tree.string(), "--files-from", list.string()});
+	context.check(run.out == expected.out && has(run.err, "Skipped 2 path(s) outside"), "paths outside the target are skipped with a warning", run.out + run.err);
+
+	run = run_cli(context, {tree.string(), "--files-from", "-"}, std::string("sub/b.txt\0a.txt\0", 16));
+	context.check(has(run.out, "--- a.txt ---") && has(run.out, "--- sub/b.txt ---") && !has(run.out, "c.log") && has(run.out, "from stdin"),
+				  "--files-from - reads stdin", run.out + run.err);
+
+	write_file(list, "a.txt\nsub/b.txt\nsub/c.log\n");
+	run = run_cli(context, {tree.string(), "--files-from", list.string(), "-pe", ".log"});
+	context.check(has(run.out, "--- sub/b.txt ---") && !has(run.out, "--- sub/c.log ---"), "the filters still apply", run.out);
+	run = run_cli(context, {tree.string(), dir.string(), "--files-from", list.string()});
+	context.check(run.status == 1 && has(run.err, "single target"), "--files-from takes one target", run.err);
+}
+
+int main(int argc, char *argv[])
+{
+	TestContext context;
+	const char *tmp = getenv("TMPDIR");
+	context.work_dir = fs::path(tmp != nullptr && tmp[0] != '\0' ? tmp : "/tmp") / "catlr-test";
+	if (argc > 1)
+	{
+		context.work_dir = argv[1];
+	}
+	fs::remove_all(context.work_dir);
+	fs::create_directories(context.work_dir / "home");
+
+	// Runs use the built-in tree and printer with a default config and cache directory, so
+	// the output does not depend on this machine's tree/bat/cat or ~/.config/catlr
+	const char *path = getenv("PATH");
+	context.tool_path = path != nullptr ? path : "";
+	context.has_git = std::system(("PATH='" + context.tool_path + "' git --version >/dev/null 2>&1").c_str()) == 0;
+	setenv("HOME", (context.work_dir / "home").c_str(), 1);
+	setenv("XDG_CACHE_HOME", (context.work_dir / "home" / ".cache").c_str(), 1);
+	setenv("PATH", "", 1);
+
+	const struct
+	{
+		const char *name;
+		void (*run)(TestContext &);
+	} tests[] = {
+		{"dump_index", test_dump_index},
+		{"compress", test_compress},
+		{"dedup", test_dedup},
+		{"binary", test_binary},
+		{"budgets", test_budgets},
+		{"closed_pipe", test_closed_pipe},
+		{"git_index", test_git_index},
+		{"revision", test_revision},
+		{"manifest", test_manifest},
+		{"cache", test_cache},
+		{"output_cache", test_output_cache},
+		{"external_sort", test_external_sort},
+		{"sort_keys", test_sort_keys},
+		{"targets", test_targets},
+		{"files_from", test_files_from},
+		{"serve", test_serve},
+	};
+	for (const auto &test : tests)
+	{
+		context.test = test.name;
+		test.run(context);
+	}
+
+	std::cerr << context.checks - context.failures << " of " << context.checks << " checks passed." << std::endl;
+	return context.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#!/usr/bin/env bash
+# Head-to-head: catlr's walker and .gitignore engine against git ls-files, fd, tree and find
+# on the corpora of catlr_bench, warm and (when the page cache can be dropped) cold.
+#
+# For every tool it reports files/second, and for the tools that honour .gitignore whether
+# their file set agrees with `git check-ignore`. Results are JSON lines; the exit status is 1
+# if any file set disagrees.
+#
+#   g++ -O2 -std=c++17 -pthread -o catlr_bench bench/catlr_bench.cpp catlr.cpp
+#   bench/compare_tools.sh --bench ./catlr_bench --out tools.json
+
+set -u
+
+BENCH=./catlr_bench
+WORK_DIR="${TMPDIR:-/tmp}/catlr-bench"
+SCALE=1
+RUNS=5
+OUT=/dev/stdout
+CORPORA="wide deep node_modules small_files huge_files gitignore_heavy"
+
+usage()
+{
+	echo "Usage: $0 [--bench <catlr_bench>] [--dir <path>] [--scale <n>] [--runs <n>] [--corpus <name>] [--out <file>]" >&2
+}
+
+while [ $# -gt 0 ]; do
+	case "$1" in
+	--bench) BENCH="$2"; shift 2 ;;
+	--dir) WORK_DIR="$2"; shift 2 ;;
+	--scale) SCALE="$2"; shift 2 ;;
+	--runs) RUNS="$2"; shift 2 ;;
+	--corpus) CORPORA="$2"; shift 2 ;;
+	--out) OUT="$2"; shift 2 ;;
+	-h | --help) usage; exit 0 ;;
+	*) echo "Error: Unknown option '$1'." >&2; usage; exit 2 ;;
+	esac
+done
+
+if [ ! -x "$BENCH" ]; then
+	echo "Error: '$BENCH' is not executable. Build it first (see the top of this script)." >&2
+	exit 2
+fi
+"$BENCH" --dir "$WORK_DIR" --scale "$SCALE" --generate-only > /dev/null || exit 2
+
+FD=$(command -v fd || command -v fdfind)
+TREE=$(command -v tree)
+if [ -n "$TREE" ] && ! "$TREE" --gitignore -d "$WORK_DIR" > /dev/null 2>&1; then
+	echo "Info: 'tree' is older than 2.0 (no --gitignore); timing it without agreement check." >&2
+	TREE_IGNORES=0
+else
+	TREE_IGNORES=1
+fi
+[ -z "$FD" ] && echo "Info: 'fd' not found; skipping it." >&2
+[ -z "$TREE" ] && echo "Info: 'tree' not found; skipping it." >&2
+
+COLD=0
+if sync && (echo 3 > /proc/sys/vm/drop_caches) 2> /dev/null; then
+	COLD=1
+else
+	echo "Info: Cannot drop the page cache (needs root); measuring warm runs only." >&2
+fi
+
+SCRATCH=$(mktemp -d)
+trap 'rm -rf "$SCRATCH"' EXIT
+STATUS=0
+
+# Each tool prints the files it selects, relative to the corpus root, one per line
+list_catlr() { "$BENCH" --list "$1"; }
+list_git() { git --git-dir="$GIT_DIR_PATH" --work-tree="$1" ls-files; }
+list_fd() { (cd "$1" && "$FD" --type f --hidden --no-require-git . | sed 's|^\./||'); }
+list_tree()
+{
+	# -f prints paths from the root argument; -i drops the indentation; directories end in '/'
+	(cd "$1" && "$TREE" -a -f -i -F --noreport $([ "$TREE_IGNORES" = 1 ] && echo --gitignore) . |
+		sed -e '1d' -e 's|^\./||' -e '/\/$/d' -e 's/[*@|=]$//')
+}
+list_find() { (cd "$1" && find . -type f | sed 's|^\./||'); }
+
+now_ns() { date +%s%N; }
+
+# Prints the median wall time in seconds of RUNS runs of `list_<tool> <root>`
+time_tool()
+{
+	local tool=$1 root=$2 cold=$3 times=() i start
+	for ((i = 0; i < RUNS; ++i)); do
+		[ "$cold" = 1 ] && sync && echo 3 > /proc/sys/vm/drop_caches
+		start=$(now_ns)
+		"list_$tool" "$root" > /dev/null
+		times+=($(($(now_ns) - start)))
+	done
+	printf '%s\n' "${times[@]}" | sort -n | awk '{ t[NR] = $1 } END { printf "%.6f", t[int((NR + 1) / 2)] / 1e9 }'
+}
+
+for corpus in $CORPORA; do
+	root="$WORK_DIR/$corpus"
+	if [ ! -d "$root" ]; then
+		echo "Error: No corpus '$corpus' in '$WORK_DIR'." >&2
+		STATUS=1
+		continue
+	fi
+
+	# git keeps its repository beside the corpus, so the corpus itself has no .git
+	GIT_DIR_PATH="$WORK_DIR/git/$corpus.git"
+	if ! cmp -s "$WORK_DIR/$corpus.stamp" "$GIT_DIR_PATH/catlr-bench.stamp"; then
+		rm -rf "$GIT_DIR_PATH"
+		git init -q --bare "$GIT_DIR_PATH" &&
+			git --git-dir="$GIT_DIR_PATH" --work-tree="$root" add -A &&
+			cp "$WORK_DIR/$corpus.stamp" "$GIT_DIR_PATH/catlr-bench.stamp"
+	fi
+
+	# Reference: every file, minus those git says are ignored
+	list_find "$root" | sort > "$SCRATCH/all"
+	git --git-dir="$GIT_DIR_PATH" --work-tree="$root" -C "$root" check-ignore --no-index --stdin < "$SCRATCH/all" |
+		sort > "$SCRATCH/ignored"
+	comm -23 "$SCRATCH/all" "$SCRATCH/ignored" > "$SCRATCH/expected"
+
+	for tool in catlr git fd tree find; do
+		case "$tool" in
+		fd) [ -z "$FD" ] && continue ;;
+		tree) [ -z "$TREE" ] && continue ;;
+		esac
+
+		"list_$tool" "$root" | sort > "$SCRATCH/got"
+		files=$(wc -l < "$SCRATCH/got")
+		if [ "$tool" = find ] || { [ "$tool" = tree ] && [ "$TREE_IGNORES" = 0 ]; }; then
+			agrees=null # No .gitignore support: timed only
+		else
+			missing=$(comm -23 "$SCRATCH/expected" "$SCRATCH/got" | wc -l)
+			extra=$(comm -13 "$SCRATCH/expected" "$SCRATCH/got" | wc -l)
+			if [ "$missing" = 0 ] && [ "$extra" = 0 ]; then
+				agrees=true
+			else
+				agrees=false
+				STATUS=1
+				echo "Warning: $tool disagrees with git check-ignore on '$corpus': $missing missing, $extra extra, e.g.:" >&2
+				{ comm -23 "$SCRATCH/expected" "$SCRATCH/got" | sed 's/^/  missing /'; comm -13 "$SCRATCH/expected" "$SCRATCH/got" | sed 's/^/  extra   /'; } | head -5 >&2
+			fi
+		fi
+
+		for cache in warm cold; do
+			[ "$cache" = cold ] && [ "$COLD" = 0 ] && continue
+			seconds=$(time_tool "$tool" "$root" $([ "$cache" = cold ] && echo 1 || echo 0))
+			rate=$(awk -v f="$files" -v s="$seconds" 'BEGIN { printf "%.0f", (s > 0 ? f / s : 0) }')
+			printf '%-16s %-6s %-5s %8s files %10.4f s %12s files/s\n' "$corpus" "$tool" "$cache" "$files" "$seconds" "$rate" >&2
+			printf '{"corpus":"%s","tool":"%s","cache":"%s","files":%s,"seconds":%s,"files_per_sec":%s,"agrees":%s}\n' \
+				"$corpus" "$tool" "$cache" "$files" "$seconds" "$rate" "$agrees"
+		done
+	done
+done > "$OUT"
+
+exit $STATUS
@@ -0,0 +1,8005 @@
+#include <algorithm>			 // For std::sort, std::find_if, std::replace
+#include <atomic>				 // For std::atomic (run statistics)
+#include <cctype>				 // For std::isdigit, std::tolower
+#include <cerrno>				 // For errno, EINTR
+#include <charconv>			 // For std::from_chars
+#include <chrono>				 // For std::chrono (watch debouncing)
+#include <condition_variable> // For std::condition_variable (thread pool)
+#include <csignal>				 // For std::sig_atomic_t, SIGPIPE
+#include <cstdint>				 // For std::uint64_t
+#include <cstdio>				 // For popen(), pclose(), fread()
+#include <cstdlib>				 // For system() and getenv()
+#include <cstring>				 // For std::memcpy
+#include <ctime>				 // For std::time (manifest and snapshot timestamps)
+#include <deque>				 // For std::deque (in-flight compression blocks)
+#include <filesystem>			 // For all path and directory operations (Requires C++17)
+#include <fstream>				 // For std::ifstream (reading files)
+#include <functional>			 // For std::function
+#include <future>				 // For std::future, std::packaged_task
+#include <iomanip>				 // For std::setprecision
+#include <iostream>				 // For std::cout, std::cerr, std::endl
+#include <limits>				 // For std::numeric_limits
+#include <list>					 // For std::list (LRU caches)
+#include <map>					 // For std::map (config storage)
+#include <memory>				 // For std::unique_ptr, std::shared_ptr
+#include <mutex>				 // For std::mutex
+#include <queue>				 // For std::queue
+#include <set>					 // For std::set (watch batches)
+#include <sstream>				 // For std::stringstream
+#include <stdexcept>			 // For std::exception
+#include <string>				 // For std::string
+#include <string_view>			 // For std::string_view (interned names)
+#include <thread>				 // For std::thread
+#include <unordered_map>		 // For std::unordered_map (directory cache)
+#include <unordered_set>		 // For std::unordered_set (oversized directories)
+#include <vector>				 // For std::vector
+
+// POSIX headers for checking stdout (I/O loop detection)
+#include <dirent.h>	  // For opendir, readdir
+#include <fcntl.h>	  // For open, O_RDONLY
+#include <signal.h>	  // For sigaction, kill
+#include <poll.h>	  // For poll (watch mode, non-blocking stdout)
+#include <sys/mman.h> // For mmap (git packfiles, directory snapshots)
+#include <sys/resource.h> // For getrusage (--stats)
+#ifdef __linux__
+#include <linux/perf_event.h> // For perf_event_attr (--stats=hw)
+#include <sys/inotify.h>  // For inotify (watch mode)
+#include <sys/ioctl.h>	  // For ioctl (enabling perf events)
+#include <sys/sendfile.h> // For sendfile (replaying cached outputs)
+#include <sys/syscall.h>  // For syscall(SYS_perf_event_open)
+#endif
+#include <sys/socket.h> // For socket, connect (server mode)
+#include <sys/stat.h> // For struct stat, S_ISREG
+#include <sys/un.h>	  // For sockaddr_un (server mode)
+#include <sys/wait.h> // For waitpid, WIFSIGNALED
+#include <unistd.h>	  // For isatty, STDOUT_FILENO, fstat
+
+// For Windows, this would require #include <io.h> and _isatty, _fstat, etc.
+
+// Optional compression backends, enabled at build time (see README):
+//   -DCATLR_USE_ZLIB -lz     for --compress=gzip and --rev (git objects are zlib-compressed)
+//   -DCATLR_USE_ZSTD -lzstd  for --compress=zstd
+#ifdef CATLR_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CATLR_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "catlr.hpp"
+
+namespace catlr
+{
+
+// --- Configuration Structs ---
+
+/**
+ * @brief Holds the configuration for which external commands to use.
+ */
+struct Config
+{
+	std::string tree_command;
+	std::string file_command;
+	std::string output_cache_size; // --cache-output size limit, e.g. "256M" (empty = default)
+
+	// Set defaults
+	Config() : tree_command("tree"), file_command("bat") {}
+};
+
+/**
+ * @brief One record of the dump index: where a printed file's content lives in the output.
+ */
+struct IndexEntry
+{
+	std::uint64_t offset; // Byte offset of the content, right after its "--- path ---" header
+	std::uint64_t length; // Byte length of the content, excluding the trailing separator
+	std::string target;	  // Name of the target directory the file was found in
+	std::string path;	  // Path relative to the target, using '/' separators
+};
+
+// --- Tracing ---
+
+/**
+ * @brief Escapes a string for a JSON string literal.
+ */
+std::string json_escape(const std::string &text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (unsigned char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += static_cast<char>(c);
+		}
+		else if (c < 0x20)
+		{
+			char code[8];
+			std::snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		}
+		else
+		{
+			escaped += static_cast<char>(c);
+		}
+	}
+	return escaped;
+}
+
+class TraceLog;
+
+// The trace being recorded, if --trace was given. Spans check it once when they start.
+TraceLog *active_trace = nullptr;
+
+/**
+ * @brief The --trace recording: complete ("X") events in Chrome trace-event format, for
+ * chrome://tracing or ui.perfetto.dev. Events are kept in memory and written when the log is
+ * destroyed at the end of the run. Threads are numbered in order of appearance, main first.
+ */
+class TraceLog
+{
+public:
+	explicit TraceLog(const fs::path &path)
+		: path_(path), start_(std::chrono::steady_clock::now())
+	{
+		thread_ids_[std::this_thread::get_id()] = 1;
+	}
+
+	~TraceLog()
+	{
+		if (active_trace == this)
+		{
+			active_trace = nullptr;
+		}
+		if (!write())
+		{
+			std::cerr << "Error: Could not write trace file '" << path_.string() << "'." << std::endl;
+		}
+	}
+
+	/**
+	 * @brief Microseconds since the trace started.
+	 */
+	double now_us() const
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_).count();
+	}
+
+	/**
+	 * @param args The members of the event's "args" object, already JSON-encoded.
+	 */
+	void add(const char *category, const char *name, double start_us, double end_us, const std::string &args)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto id = thread_ids_.emplace(std::this_thread::get_id(), static_cast<int>(thread_ids_.size()) + 1).first->second;
+		events_.push_back({category, name, start_us, end_us - start_us, id, args});
+	}
+
+private:
+	struct Event
+	{
+		const char *category;
+		const char *name;
+		double start_us;
+		double duration_us;
+		int thread;
+		std::string args;
+	};
+
+	bool write() const
+	{
+		std::ofstream file(path_);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		int pid = static_cast<int>(getpid());
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		for (const auto &thread : thread_ids_)
+		{
+			file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << thread.second
+				 << ",\"args\":{\"name\":\"" << (thread.second == 1 ? "main" : "worker") << "\"}},\n";
+		}
+		for (size_t i = 0; i < events_.size(); ++i)
+		{
+			const Event &event = events_[i];
+			file << "{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"ts\":"
+				 << event.start_us << ",\"dur\":" << event.duration_us << ",\"pid\":" << pid << ",\"tid\":" << event.thread
+				 << ",\"args\":{" << event.args << "}}" << (i + 1 < events_.size() ? ",\n" : "\n");
+		}
+		file << "]}\n";
+		return static_cast<bool>(file.flush());
+	}
+
+	fs::path path_;
+	std::chrono::steady_clock::time_point start_;
+	std::mutex mutex_;
+	std::map<std::thread::id, int> thread_ids_;
+	std::vector<Event> events_;
+};
+
+/**
+ * @brief Records one event from construction to destruction (or end()) in the active trace.
+ * arg() values are only formatted while a trace is being recorded.
+ */
+class TraceSpan
+{
+public:
+	/**
+	 * @param name A string literal; nullptr records nothing.
+	 */
+	TraceSpan(const char *category, const char *name)
+		: log_(name != nullptr ? active_trace : nullptr), category_(category), name_(name),
+		  start_us_(log_ != nullptr ? log_->now_us() : 0) {}
+
+	~TraceSpan() { end(); }
+
+	bool active() const { return log_ != nullptr; }
+
+	void arg(const char *key, const std::string &value)
+	{
+		if (log_ != nullptr)
+		{
+			append_key(key);
+			args_ += '"' + json_escape(value) + '"';
+		}
+	}
+
+	void arg(const char *key, const fs::path &value)
+	{
+		if (log_ != nullptr)
+		{
+			arg(key, value.string());
+		}
+	}
+
+	void arg(const char *key, std::uint64_t value)
+	{
+		if (log_ != nullptr)
+		{
+			append_key(key);
+			args_ += std::to_string(value);
+		}
+	}
+
+	void end()
+	{
+		if (log_ != nullptr)
+		{
+			log_->add(category_, name_, start_us_, log_->now_us(), args_);
+			log_ = nullptr;
+		}
+	}
+
+private:
+	void append_key(const char *key)
+	{
+		if (!args_.empty())
+		{
+			args_ += ',';
+		}
+		args_ += '"';
+		args_ += key;
+		args_ += "\":";
+	}
+
+	TraceLog *log_;
+	const char *category_;
+	const char *name_;
+	double start_us_;
+	std::string args_;
+};
+
+// --- Run Statistics ---
+
+/**
+ * @brief The --stats=hw counters: cycles, instructions, cache misses and branch misses of the
+ * main thread in user space, read as one perf_event_open group. Events the CPU or kernel does
+ * not offer (common in VMs) are left out; if none opens, error() says why.
+ */
+class HardwareCounters
+{
+public:
+	static constexpr int COUNT = 4;
+
+	struct Reading
+	{
+		std::uint64_t values[COUNT] = {};
+	};
+
+	static const char *name(int counter)
+	{
+		static const char *const names[COUNT] = {"cycles", "instructions", "cache misses", "branch misses"};
+		return names[counter];
+	}
+
+	HardwareCounters()
+	{
+		std::fill(fds_, fds_ + COUNT, -1);
+#ifdef __linux__
+		const std::uint64_t configs[COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+											  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+		for (int i = 0; i < COUNT; ++i)
+		{
+			struct perf_event_attr attr = {};
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.disabled = leader_ < 0 ? 1 : 0; // The group starts when the leader is enabled
+			attr.exclude_kernel = 1;			  // Allowed at perf_event_paranoid <= 2
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+			if (fd < 0)
+			{
+				if (leader_ < 0 && error_.empty())
+				{
+					error_ = errno == ENOENT || errno == EOPNOTSUPP ? "no hardware counters on this CPU or VM"
+							 : errno == EACCES || errno == EPERM	  ? "not permitted, see /proc/sys/kernel/perf_event_paranoid"
+							 : errno == ENOSYS						  ? "kernel built without perf events"
+																	  : std::strerror(errno);
+				}
+				continue;
+			}
+			if (leader_ < 0)
+			{
+				leader_ = fd;
+			}
+			fds_[i] = fd;
+			members_.push_back(i);
+		}
+		if (leader_ >= 0 && ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0)
+		{
+			error_ = std::strerror(errno);
+			close_all();
+		}
+#else
+		error_ = "perf_event_open is only available on Linux";
+#endif
+	}
+
+	~HardwareCounters()
+	{
+		close_all();
+	}
+
+	bool available() const { return leader_ >= 0; }
+
+	bool has(int counter) const { return fds_[counter] >= 0; }
+
+	const std::string &error() const { return error_; }
+
+	/**
+	 * @brief The counts so far, scaled up if the kernel had to multiplex the counters.
+	 */
+	Reading read() const
+	{
+		Reading reading;
+		std::uint64_t buffer[3 + COUNT];
+		if (leader_ < 0 || ::read(leader_, buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(std::uint64_t)))
+		{
+			return reading;
+		}
+		std::uint64_t enabled = buffer[1];
+		std::uint64_t running = buffer[2];
+		for (size_t i = 0; i < members_.size() && i < buffer[0]; ++i)
+		{
+			std::uint64_t value = buffer[3 + i];
+			if (running != 0 && running < enabled)
+			{
+				value = static_cast<std::uint64_t>(static_cast<double>(value) * enabled / running);
+			}
+			reading.values[members_[i]] = value;
+		}
+		return reading;
+	}
+
+private:
+	void close_all()
+	{
+		for (int &fd : fds_)
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+				fd = -1;
+			}
+		}
+		leader_ = -1;
+		members_.clear();
+	}
+
+	int fds_[COUNT];
+	int leader_ = -1;
+	std::vector<int> members_; // Counter index of each group member, in group read order
+	std::string error_;
+};
+
+// The counters read around each phase, if --stats=hw was given and they could be opened
+HardwareCounters *active_hw_counters = nullptr;
+
+/**
+ * @brief Counters for --stats. They are always updated (one relaxed atomic add each) and only
+ * reported when asked for. Syscall counts cover the calls catlr makes itself, not those hidden
+ * inside iostreams or spawned tools.
+ */
+struct RunStats
+{
+	std::atomic<std::uint64_t> dirs_listed{0};		// Directory listings read from disk
+	std::atomic<std::uint64_t> dirs_replayed{0};	// ... or replayed from a --cache snapshot
+	std::atomic<std::uint64_t> entries_visited{0};	// Directory entries looked at by a tree or walk
+	std::atomic<std::uint64_t> entries_pruned{0};	// ... and rejected by the filters
+	std::atomic<std::uint64_t> pattern_evals{0};	// pattern_matches() calls
+	std::atomic<std::uint64_t> relative_calls{0};	// fs::relative() calls made for matching
+	std::atomic<std::uint64_t> files_opened{0};		// Files opened to sniff, hash or print
+	std::atomic<std::uint64_t> bytes_read{0};		// Bytes read from those files
+	std::atomic<std::uint64_t> bytes_written{0};	// Bytes written by catlr itself
+	std::atomic<std::uint64_t> write_calls{0};		// write() calls
+	std::atomic<std::uint64_t> stat_calls{0};		// stat()/lstat() calls
+	std::atomic<std::uint64_t> children_spawned{0}; // system()/popen()/fork() children
+	std::atomic<std::uint64_t> dirs_streamed{0};	// Directories over --sort-memory, read in a stream
+	std::atomic<std::uint64_t> runs_spilled{0};		// Sorted runs of their entries written to temp files
+
+	/**
+	 * @brief Wall and CPU time of one phase, summed over targets. Phases are timed on the
+	 * main thread only.
+	 */
+	struct Phase
+	{
+		const char *name;
+		std::uint64_t wall_ns;
+		std::uint64_t cpu_ns;
+		std::uint64_t hw[HardwareCounters::COUNT]; // With --stats=hw
+	};
+	std::vector<Phase> phases;
+};
+
+RunStats run_stats;
+
+inline void tally(std::atomic<std::uint64_t> &counter, std::uint64_t amount = 1)
+{
+	counter.fetch_add(amount, std::memory_order_relaxed);
+}
+
+/**
+ * @brief CPU time of the whole process (all threads), in nanoseconds.
+ */
+std::uint64_t process_cpu_ns()
+{
+	struct timespec now;
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) != 0)
+	{
+		return 0;
+	}
+	return static_cast<std::uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<std::uint64_t>(now.tv_nsec);
+}
+
+/**
+ * @brief Adds the time from construction to stop() (or destruction) to a phase of run_stats.
+ */
+class PhaseTimer
+{
+public:
+	explicit PhaseTimer(const char *name)
+		: name_(name), wall_start_(std::chrono::steady_clock::now()), cpu_start_(process_cpu_ns()),
+		  span_("phase", name)
+	{
+		if (name_ != nullptr && active_hw_counters != nullptr)
+		{
+			hw_start_ = active_hw_counters->read();
+		}
+	}
+
+	~PhaseTimer() { stop(); }
+
+	void stop()
+	{
+		if (name_ == nullptr)
+		{
+			return;
+		}
+		auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wall_start_);
+		std::uint64_t cpu = process_cpu_ns() - cpu_start_;
+		auto phase = std::find_if(run_stats.phases.begin(), run_stats.phases.end(),
+								  [this](const RunStats::Phase &p)
+								  { return std::strcmp(p.name, name_) == 0; });
+		if (phase == run_stats.phases.end())
+		{
+			run_stats.phases.push_back({name_, 0, 0, {}});
+			phase = run_stats.phases.end() - 1;
+		}
+		phase->wall_ns += static_cast<std::uint64_t>(wall.count());
+		phase->cpu_ns += cpu;
+		if (active_hw_counters != nullptr)
+		{
+			HardwareCounters::Reading hw_end = active_hw_counters->read();
+			for (int i = 0; i < HardwareCounters::COUNT; ++i)
+			{
+				phase->hw[i] += hw_end.values[i] - hw_start_.values[i];
+			}
+		}
+		name_ = nullptr;
+		span_.end();
+	}
+
+private:
+	const char *name_;
+	std::chrono::steady_clock::time_point wall_start_;
+	std::uint64_t cpu_start_;
+	HardwareCounters::Reading hw_start_;
+	TraceSpan span_;
+};
+
+// --- Cross-Platform & Utility Functions ---
+
+/**
+ * @brief Trims whitespace from the beginning and end of a string.
+ */
+std::string trim(const std::string &s)
+{
+	auto start = s.begin();
+	while (start != s.end() && std::isspace(*start))
+	{
+		start++;
+	}
+	auto end = s.end();
+	do
+	{
+		end--;
+	} while (std::distance(start, end) > 0 && std::isspace(*end));
+	return std::string(start, end + 1);
+}
+
+/**
+ * @brief Gets the path to the user's home directory (cross-platform).
+ */
+fs::path get_home_path()
+{
+#ifdef _WIN32
+	const char *home_env = getenv("USERPROFILE");
+#else
+	const char *home_env = getenv("HOME");
+#endif
+	if (home_env == nullptr)
+	{
+		return fs::path(); // Return empty path
+	}
+	return fs::path(home_env);
+}
+
+/**
+ * @brief Checks if a command-line tool is available in the system's PATH.
+ */
+bool command_exists(const std::string &command)
+{
+	if (command.empty())
+	{
+		return false;
+	}
+	// Split command from args (e.g., "lsd --tree" -> check "lsd")
+	std::string main_command = command.substr(0, command.find(' '));
+#ifdef _WIN32
+	std::string check_cmd = "where " + main_command + " > NUL 2>&1";
+#else
+	std::string check_cmd = "command -v " + main_command + " > /dev/null 2>&1";
+#endif
+	tally(run_stats.children_spawned);
+	TraceSpan span("process", "child");
+	span.arg("command", check_cmd);
+	return system(check_cmd.c_str()) == 0;
+}
+
+/**
+ * @brief Parses the config file from ~/.config/catlr/catlr.conf.
+ */
+Config parse_config()
+{
+	Config config; // Start with defaults
+	fs::path home = get_home_path();
+	if (home.empty())
+	{
+		return config; // No home dir, return defaults
+	}
+	fs::path config_path = home / ".config" / "catlr" / "catlr.conf";
+	std::ifstream config_file(config_path);
+	if (!config_file.is_open())
+	{
+		return config; // No config file, return defaults
+	}
+	std::string line;
+	while (std::getline(config_file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+		auto equals_pos = line.find('=');
+		if (equals_pos == std::string::npos)
+			continue;
+		std::string key = trim(line.substr(0, equals_pos));
+		std::string value = trim(line.substr(equals_pos + 1));
+		if (key == "treePrintCommand")
+			config.tree_command = value;
+		else if (key == "filePrintCommand")
+			config.file_command = value;
+		else if (key == "outputCacheSize")
+			config.output_cache_size = value;
+	}
+	return config;
+}
+
+/**
+ * @brief (NEW) Parses a .gitignore file and returns a vector of exclusion patterns.
+ * This is a simplified parser: it ignores comments, empty lines, and negations (!).
+ */
+std::vector<std::string> parse_gitignore(const fs::path &gitignore_path)
+{
+	std::vector<std::string> patterns;
+	std::ifstream gitignore_file(gitignore_path);
+
+	if (!gitignore_file.is_open())
+	{
+		return patterns; // No file, no patterns
+	}
+
+	std::string line;
+	while (std::getline(gitignore_file, line))
+	{
+		line = trim(line);
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		if (line[0] == '!')
+		{
+			// Negation is not supported in this simple parser
+			continue;
+		}
+		// Strip leading / for root-level patterns, as our matching is always relative
+		if (line[0] == '/')
+		{
+			line = line.substr(1);
+		}
+
+		// Add the pattern to be processed
+		patterns.push_back(line);
+	}
+	return patterns;
+}
+
+/**
+ * @brief Implements the new pattern matching logic from README/TODO.
+ * @param rel_path_str The path relative to the root, using '/' separators.
+ * @param filename_str The final component (filename) of the path.
+ * @param pattern The user-provided filter pattern.
+ * @return true if the path matches the pattern.
+ */
+bool pattern_matches(const std::string &rel_path_str, const std::string &filename_str, std::string pattern)
+{
+	tally(run_stats.pattern_evals);
+	// Normalize pattern to use forward slashes, just like rel_path_str
+	std::replace(pattern.begin(), pattern.end(), '\\', '/');
+
+	// 1. Wildcard matching
+	if (pattern.find('*') != std::string::npos)
+	{
+		if (pattern.front() == '*' && pattern.back() == '*')
+		{ // *modules*
+			return rel_path_str.find(pattern.substr(1, pattern.length() - 2)) != std::string::npos;
+		}
+		if (pattern.front() == '*')
+		{ // *.cpp
+			std::string suffix = pattern.substr(1);
+			if (rel_path_str.length() < suffix.length())
+				return false;
+			return rel_path_str.compare(rel_path_str.length() - suffix.length(), suffix.length(), suffix) == 0;
+		}
+		if (pattern.back() == '*')
+		{ // build*
+			return rel_path_str.rfind(pattern.substr(0, pattern.length() - 1), 0) == 0;
+		}
+		// Fallback for other wildcards (e.g. *build.log*) -> treat as contains
+		std::string processed_pattern;
+		for (char c : pattern)
+			if (c != '*')
+				processed_pattern += c;
+		if (processed_pattern.empty())
+			return true; // Match "*"
+		return rel_path_str.find(processed_pattern) != std::string::npos;
+	}
+
+	// 2. Direct Matching
+	if (pattern.back() == '/')
+	{
+		// FIX: Handle directory matches correctly
+		// Pattern is "build/"
+		std::string dir_pattern = pattern;								// "build/"
+		std::string dir_name = pattern.substr(0, pattern.length() - 1); // "build"
+
+		// Match if rel_path is the directory itself ("build")
+		// OR if rel_path starts with the directory pattern ("build/main.cpp")
+		return rel_path_str == dir_name || rel_path_str.rfind(dir_pattern, 0) == 0;
+	}
+
+	if (pattern.find('/') == std::string::npos)
+	{ // modules (no slash)
+		return filename_str == pattern;
+	}
+
+	// Full path match: src/models/user.js
+	return rel_path_str == pattern;
+}
+
+/**
+ * @brief Applies include/exclude filters to an already computed relative path.
+ * @param rel_path_str The path relative to the scan root, using '/' separators.
+ * @param filename_str The final component (filename) of the path.
+ * @return true if the path should be shown, false if hidden.
+ */
+bool matches_filters_rel(const std::string &rel_path_str, const std::string &filename_str, const std::vector<std::string> &includes, const std::vector<std::string> &excludes)
+{
+	// 1. Check Includes (Priority 1)
+	for (const auto &pattern : includes)
+	{
+		if (pattern_matches(rel_path_str, filename_str, pattern))
+		{
+			return true;
+		}
+	}
+
+	// 2. Check Excludes (Priority 2)
+	for (const auto &pattern : excludes)
+	{
+		if (pattern_matches(rel_path_str, filename_str, pattern))
+		{
+			return false;
+		}
+	}
+
+	// 3. If 'includes' was not empty, we are in "include-only" mode.
+	if (!includes.empty())
+	{
+		return false;
+	}
+
+	// 4. If 'includes' was empty, we are in "show-all-except-excludes" mode.
+	return true;
+}
+
+/**
+ * @brief Checks if a path matches include/exclude filters.
+ * @param path The file or directory path to check.
+ * @param base_path The root directory the scan started from (for relative paths).
+ * @param includes Vector of include patterns.
+ * @param excludes Vector of exclude patterns.
+ * @return true if the path should be shown, false if hidden.
+ */
+bool matches_filters(const fs::path &path, const fs::path &base_path, const std::vector<std::string> &includes, const std::vector<std::string> &excludes)
+{
+	std::string rel_path_str;
+	std::string filename_str;
+	try
+	{
+		// Use relative path for matching, as specified in README examples
+		tally(run_stats.relative_calls);
+		rel_path_str = fs::relative(path, base_path).string();
+		filename_str = path.filename().string();
+		// Normalize path separators for consistent matching
+		std::replace(rel_path_str.begin(), rel_path_str.end(), '\\', '/');
+	}
+	catch (const std::exception &e)
+	{
+		return false; // Handle invalid path encoding or comparison
+	}
+	return matches_filters_rel(rel_path_str, filename_str, includes, excludes);
+}
+
+// --- Output Layer ---
+
+// Set once the reader of our output has gone away (SIGPIPE/EPIPE). Everything that walks,
+// reads or spawns checks it, so `catlr big-repo | head` stops as soon as `head` exits.
+volatile std::sig_atomic_t output_closed_flag = 0;
+
+extern "C" void handle_sigpipe(int)
+{
+	output_closed_flag = 1;
+}
+
+/**
+ * @brief Replaces the default "terminate on SIGPIPE" with setting output_closed_flag.
+ * A handler (not SIG_IGN) is used so spawned tools still get the default action after exec.
+ */
+void install_sigpipe_handler()
+{
+	struct sigaction action = {};
+	action.sa_handler = handle_sigpipe;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPIPE, &action, nullptr);
+}
+
+/**
+ * @brief True once nothing we print can reach a reader anymore.
+ */
+bool output_closed()
+{
+	return output_closed_flag != 0;
+}
+
+/**
+ * @brief Writes a whole buffer to a file descriptor, retrying on short writes and EINTR and
+ * waiting out a full non-blocking descriptor.
+ * @return false if the descriptor reported an error (EPIPE also marks the output closed).
+ */
+bool write_all(int fd, const char *data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = write(fd, data, length);
+		tally(run_stats.write_calls);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				// A non-blocking stdout (inherited from the shell or a parent): wait until it drains
+				struct pollfd poll_fd = {fd, POLLOUT, 0};
+				if (poll(&poll_fd, 1, -1) >= 0 || errno == EINTR)
+					continue;
+			}
+			if (errno == EPIPE)
+				output_closed_flag = 1;
+			return false;
+		}
+		tally(run_stats.bytes_written, static_cast<std::uint64_t>(written));
+		data += written;
+		length -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+/**
+ * @brief What stdout is, for the terminal refusal and the I/O loop check.
+ */
+struct StdoutIdentity
+{
+	bool terminal = false;
+	ino_t inode = 0; // Set when stdout is a regular file
+	dev_t dev = 0;
+};
+
+// Set in a catlr server's query child, whose stdout is a pipe back to the server: the
+// checks must see the --connect client's stdout instead
+const StdoutIdentity *client_stdout = nullptr;
+
+/**
+ * @brief Describes this process's stdout, or the client's in a server query.
+ */
+StdoutIdentity describe_stdout()
+{
+	if (client_stdout != nullptr)
+	{
+		return *client_stdout;
+	}
+	StdoutIdentity identity;
+#ifndef _WIN32 // isatty/fstat are POSIX
+	identity.terminal = isatty(STDOUT_FILENO);
+	struct stat stdout_stat;
+	if (!identity.terminal && fstat(STDOUT_FILENO, &stdout_stat) == 0 && S_ISREG(stdout_stat.st_mode))
+	{
+		identity.inode = stdout_stat.st_ino;
+		identity.dev = stdout_stat.st_dev;
+	}
+#endif
+	return identity;
+}
+
+/**
+ * @brief Sink that forwards everything downstream and keeps a copy in a file descriptor
+ * (the --cache-output capture). A failing copy never fails the output itself.
+ */
+class TeeSink : public OutputSink
+{
+public:
+	TeeSink(OutputSink &next, int copy_fd) : next_(next), copy_fd_(copy_fd) {}
+
+	bool write(const char *data, size_t length) override
+	{
+		copy_ok_ = copy_ok_ && write_all(copy_fd_, data, length);
+		return next_.write(data, length);
+	}
+
+	bool finish() override { return next_.finish(); }
+
+	bool copy_ok() const { return copy_ok_; }
+
+private:
+	OutputSink &next_;
+	int copy_fd_;
+	bool copy_ok_ = true;
+};
+
+/**
+ * @brief Minimal fixed-size thread pool; submit() returns a future for the task's result.
+ */
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t thread_count)
+	{
+		for (size_t i = 0; i < std::max<size_t>(thread_count, 1); ++i)
+		{
+			workers_.emplace_back([this]
+								  { work(); });
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		ready_.notify_all();
+		for (auto &worker : workers_)
+		{
+			worker.join();
+		}
+	}
+
+	template <typename Task>
+	auto submit(Task task) -> std::future<decltype(task())>
+	{
+		auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+		auto result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			tasks_.push([packaged]
+						{ (*packaged)(); });
+		}
+		ready_.notify_one();
+		return result;
+	}
+
+private:
+	void work()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				ready_.wait(lock, [this]
+							{ return stopping_ || !tasks_.empty(); });
+				if (tasks_.empty())
+				{
+					return; // Stopping and nothing left to do
+				}
+				task = std::move(tasks_.front());
+				tasks_.pop();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> workers_;
+	std::queue<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	bool stopping_ = false;
+};
+
+enum class Compression
+{
+	None,
+	Gzip,
+	Zstd
+};
+
+/**
+ * @brief Compresses one block into a self-contained gzip member or zstd frame.
+ * Concatenated members/frames decode as a single stream with `gzip -d` / `zstd -d`.
+ * @return The compressed bytes, or an empty string on failure.
+ */
+std::string compress_block(Compression method, const std::string &block)
+{
+	TraceSpan span("output", "compress block");
+	span.arg("bytes", static_cast<std::uint64_t>(block.size()));
+	std::string compressed;
+#ifdef CATLR_USE_ZLIB
+	if (method == Compression::Gzip)
+	{
+		z_stream stream{};
+		// windowBits 15 + 16 selects the gzip wrapper
+		if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			return compressed;
+		}
+		compressed.resize(deflateBound(&stream, static_cast<uLong>(block.size())));
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(block.data()));
+		stream.avail_in = static_cast<uInt>(block.size());
+		stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+		stream.avail_out = static_cast<uInt>(compressed.size());
+		int status = deflate(&stream, Z_FINISH);
+		compressed.resize(status == Z_STREAM_END ? stream.total_out : 0);
+		deflateEnd(&stream);
+	}
+#endif
+#ifdef CATLR_USE_ZSTD
+	if (method == Compression::Zstd)
+	{
+		compressed.resize(ZSTD_compressBound(block.size()));
+		size_t size = ZSTD_compress(&compressed[0], compressed.size(), block.data(), block.size(), 3);
+		compressed.resize(ZSTD_isError(size) ? 0 : size);
+	}
+#endif
+	(void)method;
+	(void)block;
+	return compressed;
+}
+
+/**
+ * @brief Returns whether this build can produce the given compression format.
+ */
+bool compression_available(Compression method)
+{
+	switch (method)
+	{
+	case Compression::None:
+		return true;
+	case Compression::Gzip:
+#ifdef CATLR_USE_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	case Compression::Zstd:
+#ifdef CATLR_USE_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+/**
+ * @brief pigz-style sink: cuts the stream into fixed-size blocks, compresses them
+ * independently on a thread pool and writes the results to the next sink in order.
+ */
+class CompressingSink : public OutputSink
+{
+public:
+	static const size_t BLOCK_SIZE = 256 * 1024;
+
+	CompressingSink(OutputSink &next, Compression method, size_t thread_count)
+		: next_(next), method_(method), max_in_flight_(std::max<size_t>(thread_count, 1) * 2), pool_(thread_count)
+	{
+		block_.reserve(BLOCK_SIZE);
+	}
+
+	bool write(const char *data, size_t length) override
+	{
+		while (length > 0)
+		{
+			size_t take = std::min(length, BLOCK_SIZE - block_.size());
+			block_.append(data, take);
+			data += take;
+			length -= take;
+			if (block_.size() == BLOCK_SIZE)
+			{
+				submit_block();
+			}
+		}
+		return ok_;
+	}
+
+	bool finish() override
+	{
+		if (!block_.empty())
+		{
+			submit_block();
+		}
+		drain(0);
+		return ok_;
+	}
+
+private:
+	void submit_block()
+	{
+		Compression method = method_;
+		in_flight_.push_back(pool_.submit([method, block = std::move(block_)]
+										  { return compress_block(method, block); }));
+		block_.clear();
+		block_.reserve(BLOCK_SIZE);
+		// Bound memory: keep at most a couple of blocks per worker queued
+		drain(max_in_flight_);
+	}
+
+	/**
+	 * @brief Writes finished blocks, oldest first, until at most `keep` remain in flight.
+	 */
+	void drain(size_t keep)
+	{
+		while (in_flight_.size() > keep)
+		{
+			std::string compressed = in_flight_.front().get();
+			in_flight_.pop_front();
+			if (compressed.empty() || !next_.write(compressed.data(), compressed.size()))
+			{
+				ok_ = false;
+			}
+		}
+	}
+
+	OutputSink &next_;
+	Compression method_;
+	size_t max_in_flight_;
+	ThreadPool pool_;
+	std::string block_;
+	std::deque<std::future<std::string>> in_flight_;
+	bool ok_ = true;
+};
+
+/**
+ * @brief Stream buffer that counts every byte it emits before handing it to a sink.
+ * Installed behind std::cout so the dump index can record exact content offsets
+ * (offsets are in the uncompressed stream).
+ */
+class OutputBuffer : public std::streambuf
+{
+public:
+	explicit OutputBuffer(OutputSink &sink) : sink_(sink), buffer_(64 * 1024)
+	{
+		setp(buffer_.data(), buffer_.data() + buffer_.size());
+	}
+
+	~OutputBuffer() override
+	{
+		flush_pending();
+	}
+
+	/**
+	 * @brief Number of bytes written so far, including bytes still held in the buffer.
+	 */
+	std::uint64_t position() const
+	{
+		return flushed_ + static_cast<std::uint64_t>(pptr() - pbase());
+	}
+
+protected:
+	int_type overflow(int_type ch) override
+	{
+		if (!flush_pending())
+		{
+			return traits_type::eof();
+		}
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			*pptr() = traits_type::to_char_type(ch);
+			pbump(1);
+		}
+		return traits_type::not_eof(ch);
+	}
+
+	int sync() override
+	{
+		return flush_pending() ? 0 : -1;
+	}
+
+private:
+	bool flush_pending()
+	{
+		size_t length = static_cast<size_t>(pptr() - pbase());
+		if (length == 0)
+		{
+			return true;
+		}
+		TraceSpan span("output", "flush");
+		span.arg("bytes", static_cast<std::uint64_t>(length));
+		bool ok = sink_.write(pbase(), length);
+		flushed_ += length;
+		setp(buffer_.data(), buffer_.data() + buffer_.size());
+		return ok;
+	}
+
+	OutputSink &sink_;
+	std::vector<char> buffer_;
+	std::uint64_t flushed_ = 0;
+};
+
+/**
+ * @brief Runs an external command whose output belongs in the listing.
+ * @param capture If true, the child's stdout is piped back through `out` so the output
+ * layer sees (and counts) it; otherwise the child inherits our stdout.
+ * If the output is closed meanwhile, a captured child is killed; an inherited one dies of
+ * SIGPIPE by itself, which is then noted in output_closed_flag.
+ */
+int run_command(const std::string &cmd, bool capture, std::ostream &out = std::cout)
+{
+	out.flush();
+	if (output_closed())
+	{
+		return -1;
+	}
+	tally(run_stats.children_spawned);
+	TraceSpan span("process", "child");
+	span.arg("command", cmd);
+	if (!capture)
+	{
+		int status = system(cmd.c_str());
+		if (status != -1 && WIFSIGNALED(status) && WTERMSIG(status) == SIGPIPE)
+		{
+			output_closed_flag = 1;
+		}
+		return status;
+	}
+
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		return -1;
+	}
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (pid == 0)
+	{
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl("/bin/sh", "sh", "-c", cmd.c_str(), static_cast<char *>(nullptr));
+		_exit(127);
+	}
+	close(fds[1]);
+
+	char chunk[64 * 1024];
+	while (true)
+	{
+		ssize_t n = read(fds[0], chunk, sizeof(chunk));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		out.write(chunk, n);
+		if (output_closed())
+		{
+			kill(pid, SIGTERM);
+			break;
+		}
+	}
+	close(fds[0]);
+
+	int status = -1;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+	{
+	}
+	return status;
+}
+
+// --- Path Arena ---
+
+/**
+ * @brief Interned storage for the names and directories of one tree. Each distinct name is
+ * stored once, NUL-terminated, in chunks that never move, so views of it stay valid for the
+ * arena's lifetime. Each directory is a node holding its parent's index and its name's id: a
+ * trie in two flat arrays, instead of a full path string per directory.
+ */
+class PathArena
+{
+public:
+	using NodeId = std::uint32_t;
+	static constexpr NodeId ROOT = 0;
+
+	PathArena()
+	{
+		nodes_.push_back({ROOT, name_id("")});
+	}
+
+	/**
+	 * @brief The interned copy of `name`, valid (and NUL-terminated) while the arena lives.
+	 */
+	std::string_view intern(std::string_view name)
+	{
+		return names_[name_id(name)];
+	}
+
+	/**
+	 * @brief The node of `name` under `parent`, added if new.
+	 */
+	NodeId child(NodeId parent, std::string_view name)
+	{
+		std::uint64_t key = (static_cast<std::uint64_t>(parent) << 32) | name_id(name);
+		auto known = children_.find(key);
+		if (known != children_.end())
+		{
+			return known->second;
+		}
+		NodeId node = static_cast<NodeId>(nodes_.size());
+		nodes_.push_back({parent, static_cast<std::uint32_t>(key)});
+		children_.emplace(key, node);
+		return node;
+	}
+
+	/**
+	 * @brief The node of a '/'-separated path below the root (empty components are skipped,
+	 * so "/a/b", "a/b" and "a//b/" are the same node), added if new.
+	 */
+	NodeId node(std::string_view rel_path)
+	{
+		NodeId current = ROOT;
+		while (!rel_path.empty())
+		{
+			size_t slash = rel_path.find('/');
+			std::string_view component = rel_path.substr(0, slash);
+			if (!component.empty())
+			{
+				current = child(current, component);
+			}
+			rel_path = slash == std::string_view::npos ? std::string_view() : rel_path.substr(slash + 1);
+		}
+		return current;
+	}
+
+	/**
+	 * @brief Appends "/a/b" (empty for the root) to `out`.
+	 */
+	void append_path(NodeId node, std::string &out) const
+	{
+		if (node == ROOT)
+		{
+			return;
+		}
+		append_path(nodes_[node].parent, out);
+		out += '/';
+		out += names_[nodes_[node].name];
+	}
+
+private:
+	static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+	struct Node
+	{
+		NodeId parent;
+		std::uint32_t name;
+	};
+
+	std::uint32_t name_id(std::string_view name)
+	{
+		auto known = ids_.find(name);
+		if (known != ids_.end())
+		{
+			return known->second;
+		}
+		if (chunks_.empty() || CHUNK_SIZE - chunk_used_ < name.size() + 1)
+		{
+			chunks_.emplace_back(new char[std::max(CHUNK_SIZE, name.size() + 1)]);
+			chunk_used_ = 0;
+		}
+		char *stored = chunks_.back().get() + chunk_used_;
+		std::memcpy(stored, name.data(), name.size());
+		stored[name.size()] = '\0';
+		chunk_used_ += name.size() + 1;
+
+		std::uint32_t id = static_cast<std::uint32_t>(names_.size());
+		names_.emplace_back(stored, name.size());
+		ids_.emplace(names_.back(), id);
+		return id;
+	}
+
+	std::vector<std::unique_ptr<char[]>> chunks_;
+	size_t chunk_used_ = 0;
+	std::vector<std::string_view> names_;
+	std::unordered_map<std::string_view, std::uint32_t> ids_;
+	std::vector<Node> nodes_;
+	std::unordered_map<std::uint64_t, NodeId> children_; // (parent << 32 | name) -> node
+};
+
+// --- Directory Snapshot Cache ---
+
+/**
+ * @brief Read-only memory mapping of a whole file (pack files, pack indexes, directory snapshots).
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	~MappedFile()
+	{
+		if (data_ != nullptr)
+		{
+			munmap(const_cast<unsigned char *>(data_), size_);
+		}
+	}
+
+	bool open(const fs::path &path)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+		void *mapping = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED)
+		{
+			return false;
+		}
+		data_ = static_cast<const unsigned char *>(mapping);
+		size_ = static_cast<size_t>(file_stat.st_size);
+		return true;
+	}
+
+	const unsigned char *data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	const unsigned char *data_ = nullptr;
+	size_t size_ = 0;
+};
+
+/**
+ * @brief Nanoseconds part of a file's mtime (the field name differs on macOS).
+ */
+std::int64_t stat_mtime_nsec(const struct stat &file_stat)
+{
+#ifdef __APPLE__
+	return file_stat.st_mtimespec.tv_nsec;
+#else
+	return file_stat.st_mtim.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Reads a directory one entry at a time, skipping "." and "..". Where the filesystem
+ * leaves d_type out, the type comes from lstat().
+ */
+class DirectoryStream
+{
+public:
+	explicit DirectoryStream(const fs::path &dir) : dir_(dir), handle_(opendir(dir.c_str())) {}
+
+	~DirectoryStream()
+	{
+		if (handle_ != nullptr)
+		{
+			closedir(handle_);
+		}
+	}
+
+	DirectoryStream(const DirectoryStream &) = delete;
+	DirectoryStream &operator=(const DirectoryStream &) = delete;
+
+	bool is_open() const { return handle_ != nullptr; }
+
+	/**
+	 * @brief The next entry. `name` stays valid until the following call.
+	 */
+	bool next(std::string_view &name, DirEntryType &type)
+	{
+		while (handle_ != nullptr)
+		{
+			struct dirent *item = readdir(handle_);
+			if (item == nullptr)
+			{
+				return false;
+			}
+			name = item->d_name;
+			if (name == "." || name == "..")
+			{
+				continue;
+			}
+			unsigned char d_type = item->d_type;
+			if (d_type == DT_UNKNOWN) // Some filesystems do not fill d_type
+			{
+				struct stat entry_stat;
+				tally(run_stats.stat_calls);
+				if (lstat((dir_ / item->d_name).c_str(), &entry_stat) == 0)
+				{
+					d_type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : S_ISREG(entry_stat.st_mode) ? DT_REG
+																 : S_ISLNK(entry_stat.st_mode)	 ? DT_LNK
+																								 : DT_UNKNOWN;
+				}
+			}
+			type = d_type == DT_DIR ? DirEntryType::Directory : d_type == DT_REG ? DirEntryType::Regular
+															  : d_type == DT_LNK ? DirEntryType::Symlink
+																				 : DirEntryType::Other;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Replaces batch() with up to `count` further entries, for walking a directory too
+	 * large to list whole.
+	 * @return false once the directory is exhausted.
+	 */
+	bool refill(size_t count)
+	{
+		batch_.clear();
+		if (batch_names_.size() < count)
+		{
+			batch_names_.resize(count); // Never resized while batch_ views them
+		}
+		std::string_view name;
+		DirEntryType type;
+		while (batch_.size() < count && next(name, type))
+		{
+			std::string &stored = batch_names_[batch_.size()];
+			stored.assign(name);
+			batch_.push_back({stored, type});
+		}
+		return !batch_.empty();
+	}
+
+	const std::vector<CachedDirEntry> &batch() const { return batch_; }
+
+private:
+	fs::path dir_;
+	DIR *handle_;
+	std::vector<std::string> batch_names_;
+	std::vector<CachedDirEntry> batch_;
+};
+
+/**
+ * @brief Directory listings for one target, read once per run and optionally persisted.
+ * With --cache, listings are stored in a snapshot under ~/.cache/catlr, keyed by the canonical
+ * target path, and a directory whose mtime is unchanged is replayed from the mapped snapshot
+ * after a single stat() instead of being read again. Listings are unfiltered, so one snapshot
+ * serves every combination of filters.
+ *
+ * Snapshot layout (host byte order; the version field guards format changes):
+ *   "CATLRDC\0" u32 version, u32 directory count, i64 written-at seconds, u32 root length, root
+ *   per directory: u32 path length, path (relative to the root), i64 mtime sec, i64 mtime nsec,
+ *                  u32 entry count, then per entry: u8 type, u16 name length, name
+ */
+class DirectoryCache
+{
+public:
+	/**
+	 * @param cache_dir Where snapshots live; empty keeps listings in memory for this run only.
+	 */
+	DirectoryCache(const fs::path &root, const fs::path &cache_dir)
+		: root_(root.string()), started_at_(static_cast<std::int64_t>(std::time(nullptr)))
+	{
+		if (cache_dir.empty())
+		{
+			return;
+		}
+		// FNV-1a of the canonical root names the snapshot; the root stored inside confirms it
+		std::uint64_t key = 0xcbf29ce484222325ULL;
+		for (unsigned char c : root_)
+		{
+			key = (key ^ c) * 0x100000001b3ULL;
+		}
+		std::ostringstream name;
+		name << std::hex << std::setw(16) << std::setfill('0') << key << ".snap";
+		snapshot_path_ = cache_dir / name.str();
+		if (snapshot_.open(snapshot_path_) && !load_snapshot())
+		{
+			snapshot_records_.clear(); // Corrupt or from another version: start over
+		}
+	}
+
+	/**
+	 * @brief Caps the memory of one listing (names plus entries) for callers of list() that
+	 * can stream instead (--sort-memory). 0, the default, is no cap.
+	 */
+	void set_listing_limit(std::uint64_t max_bytes)
+	{
+		listing_limit_ = max_bytes;
+	}
+
+	std::uint64_t listing_limit() const { return listing_limit_; }
+
+	/**
+	 * @brief The entries of `dir` (a path under the root) in directory order.
+	 * @param too_large If given, a directory over the listing limit is not loaded: nullptr is
+	 * returned and this is set, and the caller reads it with a DirectoryStream.
+	 * @return nullptr if the directory cannot be read.
+	 */
+	const std::vector<CachedDirEntry> *list(const fs::path &dir, bool *too_large = nullptr)
+	{
+		const std::string &dir_str = dir.native();
+		PathArena::NodeId node = arena_.node(std::string_view(dir_str).substr(std::min(root_.length(), dir_str.length())));
+		auto known = listings_.find(node);
+		if (known != listings_.end())
+		{
+			return &known->second.entries;
+		}
+		std::uint64_t max_bytes = too_large != nullptr ? listing_limit_ : 0;
+		if (max_bytes != 0 && oversized_.count(node))
+		{
+			*too_large = true;
+			return nullptr;
+		}
+
+		TraceSpan span("fs", "read directory");
+		span.arg("path", dir);
+		struct stat dir_stat;
+		tally(run_stats.stat_calls);
+		if (stat(dir.c_str(), &dir_stat) != 0)
+		{
+			return nullptr;
+		}
+		Listing listing;
+		listing.mtime_sec = dir_stat.st_mtime;
+		listing.mtime_nsec = stat_mtime_nsec(dir_stat);
+		auto cached = snapshot_records_.find(node);
+		bool replayed = cached != snapshot_records_.end() && cached->second.mtime_sec == listing.mtime_sec &&
+						cached->second.mtime_nsec == listing.mtime_nsec && listing.mtime_sec < snapshot_written_at_ &&
+						(max_bytes == 0 || cached->second.listing_bytes <= max_bytes) &&
+						decode_entries(cached->second.entries_offset, listing.entries);
+		if (!replayed)
+		{
+			listing.entries.clear();
+			tally(run_stats.dirs_listed);
+			bool over_limit = false;
+			if (!read_directory(dir, max_bytes, listing.entries, over_limit))
+			{
+				if (over_limit)
+				{
+					span.arg("source", std::string("too large"));
+					tally(run_stats.dirs_streamed);
+					oversized_.insert(node);
+					*too_large = true;
+				}
+				return nullptr;
+			}
+			dirty_ = !snapshot_path_.empty();
+		}
+		else
+		{
+			tally(run_stats.dirs_replayed);
+		}
+		span.arg("entries", static_cast<std::uint64_t>(listing.entries.size()));
+		span.arg("source", std::string(replayed ? "snapshot" : "disk"));
+		return &listings_.emplace(node, std::move(listing)).first->second.entries;
+	}
+
+	/**
+	 * @brief The type of an entry with symlinks followed, as fs::directory_entry::is_directory
+	 * and is_regular_file see it.
+	 */
+	static DirEntryType resolve(const fs::path &path, const CachedDirEntry &entry)
+	{
+		if (entry.type != DirEntryType::Symlink)
+		{
+			return entry.type;
+		}
+		struct stat target_stat;
+		tally(run_stats.stat_calls);
+		if (stat(path.c_str(), &target_stat) != 0)
+		{
+			return DirEntryType::Other; // Dangling
+		}
+		return S_ISDIR(target_stat.st_mode) ? DirEntryType::Directory
+											: (S_ISREG(target_stat.st_mode) ? DirEntryType::Regular : DirEntryType::Other);
+	}
+
+	/**
+	 * @brief Writes the snapshot if anything was read from disk this run. Directories not visited
+	 * this run (e.g. pruned by today's filters) are carried over from the old snapshot.
+	 */
+	bool save()
+	{
+		if (!dirty_)
+		{
+			return true;
+		}
+		std::string out("CATLRDC\0", 8);
+		append_raw(out, SNAPSHOT_VERSION);
+		size_t count_offset = out.size();
+		append_raw(out, std::uint32_t(0));
+		append_raw(out, started_at_);
+		append_string<std::uint32_t>(out, root_);
+
+		std::uint32_t count = 0;
+		std::string rel;
+		for (const auto &item : listings_)
+		{
+			rel.clear();
+			arena_.append_path(item.first, rel);
+			append_record(out, rel, item.second.mtime_sec, item.second.mtime_nsec, item.second.entries);
+			++count;
+		}
+		for (const auto &item : snapshot_records_)
+		{
+			std::vector<CachedDirEntry> entries;
+			// Records that were racy under the old timestamp must not become trusted under the new one
+			if (listings_.count(item.first) || item.second.mtime_sec >= snapshot_written_at_ ||
+				!decode_entries(item.second.entries_offset, entries))
+			{
+				continue;
+			}
+			rel.clear();
+			arena_.append_path(item.first, rel);
+			append_record(out, rel, item.second.mtime_sec, item.second.mtime_nsec, entries);
+			++count;
+		}
+		std::memcpy(&out[count_offset], &count, sizeof(count));
+
+		std::error_code ec;
+		fs::create_directories(snapshot_path_.parent_path(), ec);
+		fs::path temp_path = snapshot_path_.string() + ".tmp." + std::to_string(getpid());
+		{
+			std::ofstream file(temp_path, std::ios::binary);
+			if (!file.write(out.data(), static_cast<std::streamsize>(out.size())))
+			{
+				fs::remove(temp_path, ec);
+				return false;
+			}
+		}
+		fs::rename(temp_path, snapshot_path_, ec); // Atomic: concurrent runs see old or new
+		return !ec;
+	}
+
+private:
+	static constexpr std::uint32_t SNAPSHOT_VERSION = 1;
+
+	struct Listing
+	{
+		std::int64_t mtime_sec;
+		std::int64_t mtime_nsec;
+		std::vector<CachedDirEntry> entries;
+	};
+
+	struct SnapshotRecord
+	{
+		std::int64_t mtime_sec;
+		std::int64_t mtime_nsec;
+		size_t entries_offset; // Entry count, then the entries
+		std::uint64_t listing_bytes;
+	};
+
+	/**
+	 * @brief What one entry of a listing costs in memory, for the listing limit.
+	 */
+	static std::uint64_t entry_bytes(std::string_view name)
+	{
+		return sizeof(CachedDirEntry) + name.size() + 1;
+	}
+
+	/**
+	 * @brief Reads a whole listing, or stops with `over_limit` once it needs more than
+	 * `max_bytes` (0: no limit). Names are gathered first and interned only if all of them fit,
+	 * so an oversized directory leaves nothing behind in the arena.
+	 */
+	bool read_directory(const fs::path &dir, std::uint64_t max_bytes, std::vector<CachedDirEntry> &entries, bool &over_limit)
+	{
+		DirectoryStream stream(dir);
+		if (!stream.is_open())
+		{
+			return false;
+		}
+		std::string names; // NUL-separated
+		std::vector<DirEntryType> types;
+		std::uint64_t bytes = 0;
+		std::string_view name;
+		DirEntryType type;
+		while (stream.next(name, type))
+		{
+			bytes += entry_bytes(name);
+			if (max_bytes != 0 && bytes > max_bytes)
+			{
+				over_limit = true;
+				return false;
+			}
+			names.append(name.data(), name.size()).push_back('\0');
+			types.push_back(type);
+		}
+		entries.reserve(types.size());
+		const char *next_name = names.data();
+		for (DirEntryType entry_type : types)
+		{
+			std::string_view stored = arena_.intern(next_name);
+			entries.push_back({stored, entry_type});
+			next_name += stored.size() + 1;
+		}
+		return true;
+	}
+
+	template <typename T>
+	static void append_raw(std::string &out, T value)
+	{
+		out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+
+	template <typename Length>
+	static void append_string(std::string &out, std::string_view value)
+	{
+		append_raw(out, static_cast<Length>(value.length()));
+		out += value;
+	}
+
+	static void append_record(std::string &out, const std::string &rel, std::int64_t mtime_sec, std::int64_t mtime_nsec,
+							  const std::vector<CachedDirEntry> &entries)
+	{
+		append_string<std::uint32_t>(out, rel);
+		append_raw(out, mtime_sec);
+		append_raw(out, mtime_nsec);
+		append_raw(out, static_cast<std::uint32_t>(entries.size()));
+		for (const auto &entry : entries)
+		{
+			append_raw(out, static_cast<unsigned char>(entry.type));
+			append_string<std::uint16_t>(out, entry.name);
+		}
+	}
+
+	/**
+	 * @brief Bounds-checked reads from the mapped snapshot.
+	 */
+	template <typename T>
+	bool read_raw(size_t &offset, T &value) const
+	{
+		if (offset > snapshot_.size() || snapshot_.size() - offset < sizeof(T))
+		{
+			return false;
+		}
+		std::memcpy(&value, snapshot_.data() + offset, sizeof(T));
+		offset += sizeof(T);
+		return true;
+	}
+
+	template <typename Length>
+	bool read_string(size_t &offset, std::string_view &value) const
+	{
+		Length length;
+		if (!read_raw(offset, length) || snapshot_.size() - offset < length)
+		{
+			return false;
+		}
+		value = std::string_view(reinterpret_cast<const char *>(snapshot_.data() + offset), length);
+		offset += length;
+		return true;
+	}
+
+	bool decode_entries(size_t offset, std::vector<CachedDirEntry> &entries)
+	{
+		std::uint32_t count;
+		if (!read_raw(offset, count))
+		{
+			return false;
+		}
+		entries.resize(count);
+		for (auto &entry : entries)
+		{
+			unsigned char type;
+			std::string_view name;
+			if (!read_raw(offset, type) || type > static_cast<unsigned char>(DirEntryType::Other) ||
+				!read_string<std::uint16_t>(offset, name))
+			{
+				return false;
+			}
+			entry.name = arena_.intern(name);
+			entry.type = static_cast<DirEntryType>(type);
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Indexes the snapshot's records; entry lists are decoded only when replayed.
+	 */
+	bool load_snapshot()
+	{
+		size_t offset = 8;
+		std::uint32_t version, count;
+		std::string_view root;
+		if (snapshot_.size() < 8 || std::memcmp(snapshot_.data(), "CATLRDC\0", 8) != 0 ||
+			!read_raw(offset, version) || version != SNAPSHOT_VERSION || !read_raw(offset, count) ||
+			!read_raw(offset, snapshot_written_at_) || !read_string<std::uint32_t>(offset, root) || root != root_)
+		{
+			return false;
+		}
+		for (std::uint32_t i = 0; i < count; ++i)
+		{
+			std::string_view rel;
+			SnapshotRecord record;
+			std::uint32_t entry_count;
+			if (!read_string<std::uint32_t>(offset, rel) || !read_raw(offset, record.mtime_sec) ||
+				!read_raw(offset, record.mtime_nsec))
+			{
+				return false;
+			}
+			record.entries_offset = offset;
+			record.listing_bytes = 0;
+			if (!read_raw(offset, entry_count))
+			{
+				return false;
+			}
+			for (std::uint32_t j = 0; j < entry_count; ++j) // Skip to the next record
+			{
+				unsigned char type;
+				std::string_view name;
+				if (!read_raw(offset, type) || !read_string<std::uint16_t>(offset, name))
+				{
+					return false;
+				}
+				record.listing_bytes += entry_bytes(name);
+			}
+			snapshot_records_[arena_.node(rel)] = record;
+		}
+		return true;
+	}
+
+	std::string root_;
+	std::int64_t started_at_;
+	fs::path snapshot_path_;
+	MappedFile snapshot_;
+	std::int64_t snapshot_written_at_ = 0;
+	PathArena arena_; // Names and directories of everything listed or in the snapshot
+	std::unordered_map<PathArena::NodeId, SnapshotRecord> snapshot_records_;
+	std::unordered_map<PathArena::NodeId, Listing> listings_;
+	std::uint64_t listing_limit_ = 0;
+	std::unordered_set<PathArena::NodeId> oversized_; // Over the limit: streamed, never listed
+	bool dirty_ = false;
+};
+
+/**
+ * @brief Where --cache keeps directory snapshots: $XDG_CACHE_HOME/catlr or ~/.cache/catlr.
+ */
+fs::path default_cache_dir()
+{
+	const char *xdg_cache = getenv("XDG_CACHE_HOME");
+	if (xdg_cache != nullptr && xdg_cache[0] != '\0')
+	{
+		return fs::path(xdg_cache) / "catlr";
+	}
+	fs::path home = get_home_path();
+	return home.empty() ? fs::path() : home / ".cache" / "catlr";
+}
+
+// --- Walking ---
+
+// Entries read at a time from a directory too large to list
+const size_t STREAM_BATCH = 4096;
+
+Walker::Walker(const fs::path &root, const Filters &filters, DirectoryCache *cache, const fs::path &start)
+	: root_(root), filters_(filters), cache_(cache)
+{
+	if (cache_ == nullptr)
+	{
+		owned_cache_.reset(new DirectoryCache(root, fs::path()));
+		cache_ = owned_cache_.get();
+	}
+	fs::path start_dir = start.empty() ? root : start;
+	fs::path relative = start_dir.lexically_relative(root);
+	enter(start_dir, relative == "." ? fs::path() : relative);
+}
+
+Walker::Walker(Walker &&other) noexcept = default;
+
+Walker::~Walker() = default;
+
+void Walker::enter(const fs::path &dir, const fs::path &relative)
+{
+	double trace_start_us = active_trace != nullptr ? active_trace->now_us() : 0;
+	bool too_large = false;
+	const std::vector<CachedDirEntry> *entries = cache_->list(dir, &too_large);
+	std::unique_ptr<DirectoryStream> stream;
+	if (too_large)
+	{
+		// Over --sort-memory: walked in batches, in the same directory order
+		stream.reset(new DirectoryStream(dir));
+		stream->refill(STREAM_BATCH);
+		entries = &stream->batch(); // Empty if unreadable
+	}
+	stack_.push_back({dir, relative, entries, 0, trace_start_us, 0, 0, std::move(stream)});
+}
+
+bool Walker::next()
+{
+	if (descend_)
+	{
+		descend_ = false;
+		enter(entry_.path, entry_.relative);
+	}
+	while (!stack_.empty() && !output_closed())
+	{
+		Frame &frame = stack_.back();
+		if (frame.stream != nullptr && frame.next == frame.entries->size())
+		{
+			frame.stream->refill(STREAM_BATCH); // Empty once the directory is exhausted
+			frame.next = 0;
+		}
+		if (frame.entries == nullptr || frame.next == frame.entries->size())
+		{
+			if (active_trace != nullptr)
+			{
+				std::ostringstream args;
+				args << "\"path\":\"" << json_escape(frame.dir.string()) << "\",\"filter_us\":" << frame.filter_us
+					 << ",\"pruned\":" << frame.pruned;
+				active_trace->add("walk", "walk directory", frame.trace_start_us, active_trace->now_us(), args.str());
+			}
+			stack_.pop_back(); // Done, or unreadable (skipped, as skip_permission_denied did)
+			continue;
+		}
+		const CachedDirEntry &item = (*frame.entries)[frame.next++];
+		fs::path current_path = frame.dir / item.name;
+		DirEntryType type = DirectoryCache::resolve(current_path, item);
+		tally(run_stats.entries_visited);
+
+		// Directories pass the LIST filters (symlinked ones are listed but not entered);
+		// files pass the PRINT filters
+		if (type == DirEntryType::Directory ? item.type != DirEntryType::Directory : type != DirEntryType::Regular)
+		{
+			continue;
+		}
+		double filter_start_us = active_trace != nullptr ? active_trace->now_us() : 0;
+		const std::vector<std::string> &includes = type == DirEntryType::Directory ? filters_.list_includes : filters_.print_includes;
+		const std::vector<std::string> &excludes = type == DirEntryType::Directory ? filters_.list_excludes : filters_.print_excludes;
+		bool kept;
+		if (item.type == DirEntryType::Symlink)
+		{
+			kept = matches_filters(current_path, root_, includes, excludes);
+		}
+		else
+		{
+			// Frames are real directories, so the walked names are what fs::relative would give
+			std::string name(item.name);
+			std::string rel_path = (frame.relative / name).string();
+			std::replace(rel_path.begin(), rel_path.end(), '\\', '/');
+			kept = matches_filters_rel(rel_path, name, includes, excludes);
+		}
+		if (active_trace != nullptr)
+		{
+			frame.filter_us += active_trace->now_us() - filter_start_us;
+		}
+		if (!kept)
+		{
+			tally(run_stats.entries_pruned);
+			++frame.pruned;
+			continue;
+		}
+
+		fs::path relative = frame.relative / item.name;
+		if (item.type == DirEntryType::Symlink)
+		{
+			// A symlinked file is named by where it points, as fs::relative sees it
+			std::error_code ec;
+			relative = fs::relative(current_path, root_, ec);
+			if (ec)
+			{
+				continue;
+			}
+		}
+		entry_.path = std::move(current_path);
+		entry_.relative = std::move(relative);
+		entry_.type = type;
+		entry_.depth = stack_.size() - 1;
+		descend_ = type == DirEntryType::Directory;
+		return true;
+	}
+	stack_.clear();
+	return false;
+}
+
+Walker walk(const fs::path &root, const Filters &filters)
+{
+	return Walker(root, filters);
+}
+
+// --- Native (Built-in) Implementations ---
+
+/**
+ * @brief Streaming XXH64: a fast non-cryptographic 64-bit hash, used to spot identical files.
+ * Reads input words in host byte order (the reference algorithm assumes little-endian).
+ */
+class Xxh64
+{
+public:
+	explicit Xxh64(std::uint64_t seed = 0) : seed_(seed)
+	{
+		lanes_[0] = seed + PRIME1 + PRIME2;
+		lanes_[1] = seed + PRIME2;
+		lanes_[2] = seed;
+		lanes_[3] = seed - PRIME1;
+	}
+
+	void update(const char *data, size_t length)
+	{
+		total_length_ += length;
+		if (buffered_ + length < sizeof(buffer_))
+		{
+			std::memcpy(buffer_ + buffered_, data, length);
+			buffered_ += length;
+			return;
+		}
+		if (buffered_ > 0)
+		{
+			size_t fill = sizeof(buffer_) - buffered_;
+			std::memcpy(buffer_ + buffered_, data, fill);
+			consume_stripe(buffer_);
+			data += fill;
+			length -= fill;
+			buffered_ = 0;
+		}
+		while (length >= sizeof(buffer_))
+		{
+			consume_stripe(data);
+			data += sizeof(buffer_);
+			length -= sizeof(buffer_);
+		}
+		std::memcpy(buffer_, data, length);
+		buffered_ = length;
+	}
+
+	std::uint64_t digest() const
+	{
+		std::uint64_t hash;
+		if (total_length_ >= sizeof(buffer_))
+		{
+			hash = rotl(lanes_[0], 1) + rotl(lanes_[1], 7) + rotl(lanes_[2], 12) + rotl(lanes_[3], 18);
+			for (std::uint64_t lane : lanes_)
+			{
+				hash = (hash ^ round(0, lane)) * PRIME1 + PRIME4;
+			}
+		}
+		else
+		{
+			hash = seed_ + PRIME5;
+		}
+		hash += total_length_;
+
+		const char *p = buffer_;
+		size_t remaining = buffered_;
+		for (; remaining >= 8; p += 8, remaining -= 8)
+		{
+			hash ^= round(0, read64(p));
+			hash = rotl(hash, 27) * PRIME1 + PRIME4;
+		}
+		if (remaining >= 4)
+		{
+			std::uint32_t word;
+			std::memcpy(&word, p, sizeof(word));
+			hash ^= static_cast<std::uint64_t>(word) * PRIME1;
+			hash = rotl(hash, 23) * PRIME2 + PRIME3;
+			p += 4;
+			remaining -= 4;
+		}
+		for (; remaining > 0; ++p, --remaining)
+		{
+			hash ^= static_cast<std::uint64_t>(static_cast<unsigned char>(*p)) * PRIME5;
+			hash = rotl(hash, 11) * PRIME1;
+		}
+
+		hash ^= hash >> 33;
+		hash *= PRIME2;
+		hash ^= hash >> 29;
+		hash *= PRIME3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+private:
+	static constexpr std::uint64_t PRIME1 = 11400714785074694791ULL;
+	static constexpr std::uint64_t PRIME2 = 14029467366897019727ULL;
+	static constexpr std::uint64_t PRIME3 = 1609587929392839161ULL;
+	static constexpr std::uint64_t PRIME4 = 9650029242287828579ULL;
+	static constexpr std::uint64_t PRIME5 = 2870177450012600261ULL;
+
+	static std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+	static std::uint64_t read64(const char *p)
+	{
+		std::uint64_t word;
+		std::memcpy(&word, p, sizeof(word));
+		return word;
+	}
+
+	static std::uint64_t round(std::uint64_t acc, std::uint64_t input)
+	{
+		acc += input * PRIME2;
+		return rotl(acc, 31) * PRIME1;
+	}
+
+	void consume_stripe(const char *p)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			lanes_[i] = round(lanes_[i], read64(p + 8 * i));
+		}
+	}
+
+	std::uint64_t seed_;
+	std::uint64_t lanes_[4];
+	char buffer_[32];
+	size_t buffered_ = 0;
+	std::uint64_t total_length_ = 0;
+};
+
+/**
+ * @brief Hashes a file's content with XXH64.
+ * @return false if the file could not be read.
+ */
+bool hash_file(const fs::path &path, std::uint64_t &hash)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	tally(run_stats.files_opened);
+	Xxh64 hasher;
+	char chunk[64 * 1024];
+	while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0)
+	{
+		hasher.update(chunk, static_cast<size_t>(file.gcount()));
+		tally(run_stats.bytes_read, static_cast<std::uint64_t>(file.gcount()));
+	}
+	hash = hasher.digest();
+	return true;
+}
+
+/**
+ * @brief NATIVE FALLBACK: Prints file contents using C++ streams.
+ * @param content_hash If non-null, receives the XXH64 of the bytes printed (hashed while reading).
+ * @return false if the file could not be opened.
+ */
+bool print_file_native(const fs::path &path, std::ostream &out, std::uint64_t *content_hash = nullptr)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "[Could not open file: " << path.string() << "]" << std::endl;
+		return false;
+	}
+	tally(run_stats.files_opened);
+	if (content_hash == nullptr)
+	{
+		if (file.rdbuf()->sgetc() != std::char_traits<char>::eof()) // Inserting nothing would set failbit on `out`
+		{
+			out << file.rdbuf();
+		}
+		std::streamoff read_end = file.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in);
+		tally(run_stats.bytes_read, read_end > 0 ? static_cast<std::uint64_t>(read_end) : 0);
+		return true;
+	}
+	Xxh64 hasher;
+	char chunk[64 * 1024];
+	while ((file.read(chunk, sizeof(chunk)) || file.gcount() > 0) && !output_closed())
+	{
+		hasher.update(chunk, static_cast<size_t>(file.gcount()));
+		tally(run_stats.bytes_read, static_cast<std::uint64_t>(file.gcount()));
+		out.write(chunk, file.gcount());
+	}
+	*content_hash = hasher.digest();
+	return true;
+}
+
+/**
+ * @brief Reads up to `length` bytes at `offset` with pread(), without moving any file position.
+ */
+std::string pread_range(int fd, std::uint64_t offset, std::uint64_t length)
+{
+	std::string bytes(length, '\0');
+	size_t filled = 0;
+	while (filled < bytes.size())
+	{
+		ssize_t n = pread(fd, &bytes[filled], bytes.size() - filled, static_cast<off_t>(offset + filled));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		filled += static_cast<size_t>(n);
+	}
+	bytes.resize(filled);
+	tally(run_stats.bytes_read, filled);
+	return bytes;
+}
+
+/**
+ * @brief Prints the head and tail excerpts of a `size`-byte content around the truncation note.
+ */
+void print_excerpt(std::string head, std::string tail, std::uint64_t size, std::ostream &out)
+{
+	size_t head_end = head.rfind('\n');
+	if (head_end != std::string::npos)
+	{
+		head.resize(head_end + 1);
+	}
+	size_t tail_start = tail.find('\n');
+	if (tail_start != std::string::npos && tail_start + 1 < tail.size())
+	{
+		tail.erase(0, tail_start + 1);
+	}
+
+	std::uint64_t omitted = size - head.size() - tail.size();
+	out << head;
+	if (!head.empty() && head.back() != '\n')
+	{
+		out << '\n';
+	}
+	out << "[truncated: " << omitted << " of " << size << " bytes omitted]" << '\n';
+	out << tail;
+}
+
+/**
+ * @brief Prints about `limit` bytes of a file that is larger than that: a head and a tail
+ * excerpt, cut at line boundaries when possible, around an exact "[truncated: ...]" note.
+ * Both excerpts are read with pread(), so the middle of the file is never touched.
+ */
+bool print_file_excerpt(const fs::path &path, std::uint64_t size, std::uint64_t limit, std::ostream &out)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cerr << "[Could not open file: " << path.string() << "]" << std::endl;
+		return false;
+	}
+	tally(run_stats.files_opened);
+	std::uint64_t tail_length = limit / 2;
+	std::uint64_t head_length = limit - tail_length;
+	std::string head = pread_range(fd, 0, head_length);
+	std::string tail = pread_range(fd, size - tail_length, tail_length);
+	close(fd);
+	print_excerpt(head, tail, size, out);
+	return true;
+}
+
+/**
+ * @brief Opens a scratch file in $TMPDIR (or /tmp) for reading and writing. It is unlinked at
+ * once, so it is gone when closed, even if catlr is killed.
+ * @param name_template A file name ending in "XXXXXX", for mkstemp.
+ */
+FILE *open_temp_file(const char *name_template)
+{
+	const char *tmp_dir = getenv("TMPDIR");
+	std::string path = std::string(tmp_dir != nullptr && tmp_dir[0] != '\0' ? tmp_dir : "/tmp") + "/" + name_template;
+	int fd = mkstemp(&path[0]);
+	if (fd < 0)
+	{
+		return nullptr;
+	}
+	unlink(path.c_str());
+	FILE *file = fdopen(fd, "w+b");
+	if (file == nullptr)
+	{
+		close(fd);
+	}
+	return file;
+}
+
+/**
+ * @brief Orders for the entries of each directory in the built-in tree.
+ */
+enum class SortOrder
+{
+	Bytes,	 // Byte order of the names, as `tree` with LC_ALL=C (the default)
+	Natural, // Digit runs compare by value: file2 before file10
+	Icase	 // ASCII letters folded: README next to readme.txt
+};
+
+/**
+ * @brief Appends the key `name` sorts by under `order`, so that comparing keys bytewise gives
+ * the order. Natural keys replace each digit run with '0', its length without leading zeros,
+ * then those digits: shorter numbers come first, and digits still sort where '0'-'9' would.
+ */
+void append_sort_key(SortOrder order, std::string_view name, std::string &key)
+{
+	for (size_t i = 0; i < name.size();)
+	{
+		char c = name[i];
+		if (order == SortOrder::Icase || !std::isdigit(static_cast<unsigned char>(c)))
+		{
+			key += order == SortOrder::Icase && c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+			++i;
+			continue;
+		}
+		while (i < name.size() && name[i] == '0')
+		{
+			++i;
+		}
+		size_t digits = i;
+		while (i < name.size() && std::isdigit(static_cast<unsigned char>(name[i])))
+		{
+			++i;
+		}
+		key += '0';
+		key += static_cast<char>(std::min<size_t>(i - digits, 255));
+		key.append(name.substr(digits, i - digits));
+	}
+}
+
+/**
+ * @brief The first 8 bytes of a key as a big-endian integer (zero-padded), so that most
+ * comparisons are one integer compare.
+ */
+std::uint64_t sort_key_prefix(std::string_view key)
+{
+	std::uint64_t prefix = 0;
+	for (size_t i = 0; i < 8; ++i)
+	{
+		prefix = (prefix << 8) | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
+	}
+	return prefix;
+}
+
+/**
+ * @brief Key order, with the names breaking ties ("File" and "file" under icase, "a1" and
+ * "a01" under natural) so that the order is total and the same on every run.
+ */
+bool sort_key_less(std::string_view key_a, std::string_view name_a, std::string_view key_b, std::string_view name_b)
+{
+	int order = key_a.compare(key_b);
+	return order != 0 ? order < 0 : name_a < name_b;
+}
+
+/**
+ * @brief Sorts the entries of a directory too large to hold, within a memory budget.
+ * Entries gather in memory until they reach the budget; each full run is sorted and spilled
+ * to an unlinked temp file, and reading back merges the runs k ways. Memory stays at one run
+ * plus one buffered entry per spilled run, however large the directory.
+ */
+class ExternalSorter
+{
+public:
+	struct Item
+	{
+		std::string name;
+		DirEntryType type;
+		std::string key; // Sort key unless the order is Bytes, which sorts by the name itself
+
+		void set_key(SortOrder order)
+		{
+			key.clear();
+			if (order != SortOrder::Bytes)
+			{
+				append_sort_key(order, name, key);
+			}
+		}
+	};
+
+	/**
+	 * @brief Orders items on their keys (see sort_key_less).
+	 */
+	struct ItemOrder
+	{
+		SortOrder order;
+		bool operator()(const Item &a, const Item &b) const
+		{
+			if (order == SortOrder::Bytes)
+			{
+				return a.name < b.name;
+			}
+			return sort_key_less(a.key, a.name, b.key, b.name);
+		}
+	};
+
+	ExternalSorter(std::uint64_t budget, SortOrder order) : budget_(budget), order_(order) {}
+
+	~ExternalSorter()
+	{
+		for (auto &run : runs_)
+		{
+			std::fclose(run.file);
+		}
+	}
+
+	ExternalSorter(const ExternalSorter &) = delete;
+	ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+	/**
+	 * @return false if a run could not be spilled (errno tells why).
+	 */
+	bool add(std::string_view name, DirEntryType type)
+	{
+		memory_.push_back({std::string(name), type, std::string()});
+		memory_.back().set_key(order_);
+		memory_bytes_ += sizeof(Item) + name.size() + memory_.back().key.size();
+		return memory_bytes_ < budget_ || spill();
+	}
+
+	/**
+	 * @brief Ends adding; next() then returns the entries in order.
+	 */
+	bool finish()
+	{
+		if (runs_.empty())
+		{
+			std::sort(memory_.begin(), memory_.end(), ItemOrder{order_});
+			return true;
+		}
+		if (!memory_.empty() && !spill())
+		{
+			return false;
+		}
+		while (runs_.size() > MAX_FAN_IN) // Bounds the open files and the merge heap
+		{
+			if (!merge_runs(MAX_FAN_IN))
+			{
+				return false;
+			}
+		}
+		for (size_t i = 0; i < runs_.size(); ++i)
+		{
+			if (read_item(runs_[i].file, runs_[i].current))
+			{
+				heap_.push_back(i);
+			}
+		}
+		std::make_heap(heap_.begin(), heap_.end(), HeapOrder{runs_, {order_}});
+		return true;
+	}
+
+	bool next(Item &item)
+	{
+		if (runs_.empty())
+		{
+			if (memory_next_ == memory_.size())
+			{
+				return false;
+			}
+			item = std::move(memory_[memory_next_++]);
+			return true;
+		}
+		if (heap_.empty())
+		{
+			return false;
+		}
+		std::pop_heap(heap_.begin(), heap_.end(), HeapOrder{runs_, {order_}});
+		Run &run = runs_[heap_.back()];
+		item = std::move(run.current);
+		if (read_item(run.file, run.current))
+		{
+			std::push_heap(heap_.begin(), heap_.end(), HeapOrder{runs_, {order_}});
+		}
+		else
+		{
+			heap_.pop_back();
+		}
+		return true;
+	}
+
+private:
+	static constexpr size_t MAX_FAN_IN = 64;
+
+	struct Run
+	{
+		FILE *file;
+		Item current;
+	};
+
+	/**
+	 * @brief Orders run indices for a min-heap on their current items.
+	 */
+	struct HeapOrder
+	{
+		const std::vector<Run> &runs;
+		ItemOrder order;
+		bool operator()(size_t a, size_t b) const { return order(runs[b].current, runs[a].current); }
+	};
+
+	// Run records: u8 type, u16 name length, name, u16 key length, key
+	static bool write_string(FILE *file, const std::string &text)
+	{
+		std::uint16_t length = static_cast<std::uint16_t>(text.size());
+		return std::fwrite(&length, sizeof(length), 1, file) == 1 && std::fwrite(text.data(), 1, length, file) == length;
+	}
+
+	static bool read_string(FILE *file, std::string &text)
+	{
+		std::uint16_t length;
+		if (std::fread(&length, sizeof(length), 1, file) != 1)
+		{
+			return false;
+		}
+		text.resize(length);
+		return std::fread(&text[0], 1, length, file) == length;
+	}
+
+	static bool write_item(FILE *file, const Item &item)
+	{
+		unsigned char type = static_cast<unsigned char>(item.type);
+		return std::fwrite(&type, 1, 1, file) == 1 && write_string(file, item.name) && write_string(file, item.key);
+	}
+
+	static bool read_item(FILE *file, Item &item)
+	{
+		unsigned char type;
+		if (std::fread(&type, 1, 1, file) != 1)
+		{
+			return false;
+		}
+		item.type = static_cast<DirEntryType>(type);
+		return read_string(file, item.name) && read_string(file, item.key);
+	}
+
+	/**
+	 * @brief Sorts the entries in memory and writes them out as a new run.
+	 */
+	bool spill()
+	{
+		TraceSpan span("sort", "spill run");
+		span.arg("entries", static_cast<std::uint64_t>(memory_.size()));
+		std::sort(memory_.begin(), memory_.end(), ItemOrder{order_});
+		FILE *file = open_temp_file("catlr-sort-XXXXXX");
+		if (file == nullptr)
+		{
+			return false;
+		}
+		runs_.push_back({file, Item()});
+		for (const auto &item : memory_)
+		{
+			if (!write_item(file, item))
+			{
+				return false;
+			}
+		}
+		memory_.clear();
+		memory_bytes_ = 0;
+		tally(run_stats.runs_spilled);
+		return std::fflush(file) == 0 && std::fseek(file, 0, SEEK_SET) == 0;
+	}
+
+	/**
+	 * @brief Replaces the first `count` runs with one run holding their merged entries.
+	 */
+	bool merge_runs(size_t count)
+	{
+		std::vector<Run> inputs(std::make_move_iterator(runs_.begin()), std::make_move_iterator(runs_.begin() + static_cast<std::ptrdiff_t>(count)));
+		runs_.erase(runs_.begin(), runs_.begin() + static_cast<std::ptrdiff_t>(count));
+		FILE *output = open_temp_file("catlr-sort-XXXXXX");
+		bool ok = output != nullptr;
+		std::vector<size_t> heap;
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			if (read_item(inputs[i].file, inputs[i].current))
+			{
+				heap.push_back(i);
+			}
+		}
+		std::make_heap(heap.begin(), heap.end(), HeapOrder{inputs, {order_}});
+		while (ok && !heap.empty())
+		{
+			std::pop_heap(heap.begin(), heap.end(), HeapOrder{inputs, {order_}});
+			Run &run = inputs[heap.back()];
+			ok = write_item(output, run.current);
+			if (read_item(run.file, run.current))
+			{
+				std::push_heap(heap.begin(), heap.end(), HeapOrder{inputs, {order_}});
+			}
+			else
+			{
+				heap.pop_back();
+			}
+		}
+		for (auto &run : inputs)
+		{
+			std::fclose(run.file);
+		}
+		if (output != nullptr)
+		{
+			runs_.push_back({output, Item()});
+		}
+		return ok && std::fflush(output) == 0 && std::fseek(output, 0, SEEK_SET) == 0;
+	}
+
+	std::uint64_t budget_;
+	SortOrder order_;
+	std::vector<Item> memory_;
+	std::uint64_t memory_bytes_ = 0;
+	size_t memory_next_ = 0;
+	std::vector<Run> runs_;
+	std::vector<size_t> heap_;
+};
+
+/**
+ * @brief How the built-in tree orders and caps each directory.
+ */
+struct TreeOptions
+{
+	bool unsorted = false;			   // --unsorted: directory order instead of by name
+	std::uint64_t max_entries = 0;	   // --max-entries-per-dir: 0 = all
+	SortOrder order = SortOrder::Bytes; // --sort
+};
+
+/**
+ * @brief State of one built-in tree drawing. The prefix and the relative path are grown and
+ * restored in place at each level instead of copied.
+ */
+struct TreeDrawing
+{
+	const fs::path &base_path;
+	const Filters &filters;
+	DirectoryCache &cache;
+	std::ostream &out;
+	const TreeOptions &options;
+	std::string prefix;
+	std::string rel_path;
+	std::string name; // Scratch copy of the entry name being matched
+};
+
+/**
+ * @brief Sets tree.rel_path to the parent's relative path (its first `rel_length` bytes) plus
+ * `name`, '/'-separated as matches_filters normalizes it.
+ */
+void set_tree_rel_path(TreeDrawing &tree, size_t rel_length, std::string_view name)
+{
+	tree.rel_path.resize(rel_length);
+	tree.rel_path += rel_length == 0 ? "" : "/";
+	tree.rel_path += name;
+	std::replace(tree.rel_path.begin() + static_cast<std::ptrdiff_t>(rel_length), tree.rel_path.end(), '\\', '/');
+}
+
+/**
+ * @brief Applies the list filters to one entry of `dir`.
+ * @param via_symlink Set below a symlinked directory, where relative paths name the link's
+ * target (as fs::relative resolves them) rather than the names walked.
+ */
+bool tree_entry_kept(TreeDrawing &tree, const fs::path &dir, size_t rel_length, const CachedDirEntry &entry, bool via_symlink)
+{
+	if (via_symlink || entry.type == DirEntryType::Symlink)
+	{
+		return matches_filters(dir / entry.name, tree.base_path, tree.filters.list_includes, tree.filters.list_excludes);
+	}
+	tree.name.assign(entry.name);
+	set_tree_rel_path(tree, rel_length, tree.name);
+	return matches_filters_rel(tree.rel_path, tree.name, tree.filters.list_includes, tree.filters.list_excludes);
+}
+
+void print_tree_recursive(TreeDrawing &tree, const fs::path &path, bool via_symlink);
+
+/**
+ * @brief Draws one kept entry of `dir`, and below it the subtree of a directory.
+ */
+void draw_tree_entry(TreeDrawing &tree, const fs::path &dir, size_t rel_length, const CachedDirEntry &entry, bool is_last,
+					 bool via_symlink)
+{
+	fs::path entry_path = dir / entry.name;
+	tree.out << tree.prefix << (is_last ? "└── " : "├── ") << entry.name;
+	if (DirectoryCache::resolve(entry_path, entry) == DirEntryType::Directory)
+	{
+		tree.out << "/\n";
+		size_t prefix_length = tree.prefix.length();
+		tree.prefix += is_last ? "    " : "│   ";
+		set_tree_rel_path(tree, rel_length, entry.name);
+		print_tree_recursive(tree, entry_path, via_symlink || entry.type == DirEntryType::Symlink);
+		tree.prefix.resize(prefix_length);
+	}
+	else
+	{
+		tree.out << '\n';
+	}
+}
+
+/**
+ * @brief Ends a directory capped by --max-entries-per-dir.
+ */
+void draw_tree_more(TreeDrawing &tree, std::uint64_t hidden)
+{
+	tree.out << tree.prefix << "└── … and " << hidden << " more\n";
+}
+
+/**
+ * @brief Draws a directory over the --sort-memory limit without holding its listing: entries
+ * are read as a stream and filtered, then drawn as they come (--unsorted), through a heap of
+ * the first --max-entries-per-dir entries in order, or sorted by an ExternalSorter.
+ */
+void print_tree_streamed(TreeDrawing &tree, const fs::path &path, bool via_symlink)
+{
+	DirectoryStream stream(path);
+	if (!stream.is_open())
+	{
+		return;
+	}
+	TraceSpan filter_span("filter", "filter directory");
+	filter_span.arg("path", path);
+	size_t rel_length = tree.rel_path.length();
+	std::uint64_t max_entries = tree.options.max_entries;
+	bool capped = max_entries != 0 && !tree.options.unsorted;
+	ExternalSorter::ItemOrder in_order{tree.options.order};
+	std::vector<ExternalSorter::Item> first; // --max-entries-per-dir: a max-heap of the first entries in order
+	ExternalSorter::Item candidate;
+	ExternalSorter sorter(tree.cache.listing_limit(), tree.options.order);
+	ExternalSorter::Item pending; // --unsorted: drawn once the next kept entry shows it is not the last
+	bool has_pending = false;
+	std::uint64_t seen = 0, kept = 0, shown = 0;
+	std::string_view name;
+	DirEntryType type;
+	bool sorted = true;
+	while (sorted && stream.next(name, type))
+	{
+		if (output_closed())
+		{
+			return;
+		}
+		tally(run_stats.entries_visited);
+		++seen;
+		if (!tree_entry_kept(tree, path, rel_length, {name, type}, via_symlink))
+		{
+			tally(run_stats.entries_pruned);
+			continue;
+		}
+		++kept;
+		if (tree.options.unsorted)
+		{
+			if (max_entries == 0 || kept <= max_entries)
+			{
+				if (has_pending)
+				{
+					draw_tree_entry(tree, path, rel_length, {pending.name, pending.type}, false, via_symlink);
+					++shown;
+				}
+				pending.name.assign(name);
+				pending.type = type;
+				has_pending = true;
+			}
+		}
+		else if (capped)
+		{
+			candidate.name.assign(name);
+			candidate.type = type;
+			candidate.set_key(tree.options.order);
+			if (first.size() < max_entries || in_order(candidate, first.front()))
+			{
+				if (first.size() == max_entries)
+				{
+					std::pop_heap(first.begin(), first.end(), in_order);
+					first.pop_back();
+				}
+				first.push_back(std::move(candidate));
+				std::push_heap(first.begin(), first.end(), in_order);
+			}
+		}
+		else
+		{
+			sorted = sorter.add(name, type);
+		}
+	}
+	filter_span.arg("entries", seen);
+	filter_span.arg("kept", kept);
+	filter_span.end();
+
+	if (tree.options.unsorted)
+	{
+		if (has_pending && !output_closed())
+		{
+			draw_tree_entry(tree, path, rel_length, {pending.name, pending.type}, kept == shown + 1, via_symlink);
+			++shown;
+		}
+	}
+	else if (capped)
+	{
+		std::sort_heap(first.begin(), first.end(), in_order);
+		for (size_t i = 0; i < first.size() && !output_closed(); ++i)
+		{
+			draw_tree_entry(tree, path, rel_length, {first[i].name, first[i].type}, i + 1 == kept, via_symlink);
+			++shown;
+		}
+	}
+	else if (!sorted || !sorter.finish())
+	{
+		std::cerr << "Warning: --sort-memory: could not write a temp file to sort '" << path.string() << "' ("
+				  << std::strerror(errno) << "). Its entries are not listed." << std::endl;
+		tree.rel_path.resize(rel_length);
+		return;
+	}
+	else
+	{
+		// One entry of lookahead tells which entry is the last
+		ExternalSorter::Item current, upcoming;
+		bool has_current = sorter.next(current);
+		while (has_current && !output_closed())
+		{
+			bool has_next = sorter.next(upcoming);
+			draw_tree_entry(tree, path, rel_length, {current.name, current.type}, !has_next, via_symlink);
+			std::swap(current, upcoming);
+			has_current = has_next;
+		}
+		shown = kept;
+	}
+	if (shown < kept && !output_closed())
+	{
+		draw_tree_more(tree, kept - shown);
+	}
+	tree.rel_path.resize(rel_length);
+}
+
+/**
+ * @brief One kept entry of a directory being sorted, with its key computed once up front.
+ */
+struct TreeSortEntry
+{
+	std::uint64_t prefix; // sort_key_prefix of the key
+	std::string_view key; // Without the bytes every key in the directory shares
+	const CachedDirEntry *entry;
+};
+
+/**
+ * @brief Computes the keys of one directory's entries under `order` (into `keys`, except for
+ * Bytes, whose keys are the names). The bytes all keys share are dropped first, so that the
+ * integer prefixes still tell apart names like "frame000123.png" and "frame000124.png".
+ */
+void set_tree_sort_keys(std::vector<TreeSortEntry> &entries, SortOrder order, std::string &keys)
+{
+	if (entries.empty())
+	{
+		return;
+	}
+	if (order != SortOrder::Bytes)
+	{
+		std::vector<size_t> ends;
+		ends.reserve(entries.size());
+		for (const auto &sort_entry : entries)
+		{
+			append_sort_key(order, sort_entry.entry->name, keys);
+			ends.push_back(keys.size());
+		}
+		size_t start = 0; // Views are taken once `keys` has stopped growing
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			entries[i].key = std::string_view(keys).substr(start, ends[i] - start);
+			start = ends[i];
+		}
+	}
+	std::string_view first = entries[0].key;
+	size_t shared = first.size();
+	for (const auto &sort_entry : entries)
+	{
+		size_t i = 0;
+		while (i < shared && i < sort_entry.key.size() && sort_entry.key[i] == first[i])
+		{
+			++i;
+		}
+		shared = i;
+	}
+	for (auto &sort_entry : entries)
+	{
+		sort_entry.key.remove_prefix(shared);
+		sort_entry.prefix = sort_key_prefix(sort_entry.key);
+	}
+}
+
+/**
+ * @brief Helper for print_tree_native to recursively draw the tree.
+ */
+void print_tree_recursive(TreeDrawing &tree, const fs::path &path, bool via_symlink)
+{
+	bool too_large = false;
+	const std::vector<CachedDirEntry> *listing = tree.cache.list(path, &too_large);
+	if (too_large)
+	{
+		print_tree_streamed(tree, path, via_symlink);
+		return;
+	}
+	if (listing == nullptr)
+	{
+		return; // Silently ignore directories we can't read
+	}
+	TraceSpan filter_span("filter", "filter directory");
+	filter_span.arg("path", path);
+	size_t rel_length = tree.rel_path.length();
+	std::vector<TreeSortEntry> entries;
+	for (const auto &entry : *listing)
+	{
+		if (output_closed())
+		{
+			return;
+		}
+		// Apply list filters *before* adding to the vector
+		tally(run_stats.entries_visited);
+		if (tree_entry_kept(tree, path, rel_length, entry, via_symlink))
+		{
+			entries.push_back({0, entry.name, &entry});
+		}
+		else
+		{
+			tally(run_stats.entries_pruned);
+		}
+	}
+	filter_span.arg("entries", static_cast<std::uint64_t>(listing->size()));
+	filter_span.arg("kept", static_cast<std::uint64_t>(entries.size()));
+	filter_span.end();
+
+	// With a cap, only the names shown are put in order: partial selection, then a short sort
+	size_t shown = entries.size();
+	if (tree.options.max_entries != 0 && tree.options.max_entries < entries.size())
+	{
+		shown = static_cast<size_t>(tree.options.max_entries);
+	}
+	if (!tree.options.unsorted)
+	{
+		std::string keys;
+		set_tree_sort_keys(entries, tree.options.order, keys);
+		auto in_order = [](const TreeSortEntry &a, const TreeSortEntry &b)
+		{
+			if (a.prefix != b.prefix)
+			{
+				return a.prefix < b.prefix;
+			}
+			return sort_key_less(a.key, a.entry->name, b.key, b.entry->name);
+		};
+		auto shown_end = entries.begin() + static_cast<std::ptrdiff_t>(shown);
+		if (shown < entries.size())
+		{
+			std::nth_element(entries.begin(), shown_end, entries.end(), in_order);
+		}
+		std::sort(entries.begin(), shown_end, in_order);
+	}
+
+	for (size_t i = 0; i < shown && !output_closed(); ++i)
+	{
+		draw_tree_entry(tree, path, rel_length, *entries[i].entry, i + 1 == entries.size(), via_symlink);
+	}
+	if (shown < entries.size() && !output_closed())
+	{
+		draw_tree_more(tree, entries.size() - shown);
+	}
+	tree.rel_path.resize(rel_length);
+}
+
+void print_tree_native(const fs::path &path, const Filters &filters, DirectoryCache &cache, const TreeOptions &options,
+					   std::ostream &out = std::cout)
+{
+	out << path.filename().string() << "/\n";
+	// The base_path for filtering is the path itself
+	TreeDrawing tree{path, filters, cache, out, options, std::string(), std::string(), std::string()};
+	print_tree_recursive(tree, path, false);
+	out.flush(); // One write for the whole tree, ahead of any child sharing stdout
+}
+
+bool print_tree(const fs::path &root, const Filters &filters, OutputSink &sink)
+{
+	OutputBuffer buffer(sink);
+	std::ostream out(&buffer);
+	DirectoryCache cache(root, fs::path());
+	print_tree_native(root, filters, cache, TreeOptions(), out);
+	return static_cast<bool>(out.flush());
+}
+
+bool print_file(const fs::path &path, OutputSink &sink)
+{
+	OutputBuffer buffer(sink);
+	std::ostream out(&buffer);
+	return print_file_native(path, out) && out.flush();
+}
+
+// --- Binary Detection ---
+
+/**
+ * @brief What to do with files classified as binary.
+ */
+enum class BinaryMode
+{
+	Summary, // Print "[binary, <size>]" in place of the content (default)
+	Skip,	 // Leave the file out of the content listing entirely
+	Print	 // Print it like any other file
+};
+
+// Only the first block is inspected, so classification costs one page-sized read.
+const size_t BINARY_SNIFF_BYTES = 4096;
+
+/**
+ * @brief Known binary signatures, checked against the start of the file.
+ */
+const std::vector<std::string> BINARY_MAGIC = {
+	std::string("\x89PNG\r\n\x1a\n", 8),	 // PNG
+	std::string("\x7f" "ELF", 4),			 // ELF executables and shared objects
+	std::string("SQLite format 3\0", 16),	 // SQLite databases
+	std::string("\xff\xd8\xff", 3),		 // JPEG
+	std::string("GIF8", 4),					 // GIF
+	std::string("PK\x03\x04", 4),			 // ZIP, JAR, docx, ...
+	std::string("\x1f\x8b", 2),				 // gzip
+	std::string("\x28\xb5\x2f\xfd", 4),		 // zstd
+	std::string("\xfd" "7zXZ", 5),			 // xz
+	std::string("%PDF-", 5),				 // PDF
+	std::string("\0asm", 4),				 // WebAssembly
+	std::string("\xca\xfe\xba\xbe", 4),		 // Java class / Mach-O fat binary
+	std::string("\xcf\xfa\xed\xfe", 4),		 // Mach-O 64-bit
+	std::string("!<arch>\n", 8),			 // ar archives (.a)
+};
+
+/**
+ * @brief Classifies a block of bytes (the start of a file) as binary or text.
+ * Binary if it starts with a known magic number, contains a NUL byte, or if more than
+ * ~30% of it is invalid UTF-8. A multi-byte sequence cut off by the block end is not counted.
+ */
+bool looks_binary(const char *data, size_t length)
+{
+	for (const auto &magic : BINARY_MAGIC)
+	{
+		if (length >= magic.length() && std::memcmp(data, magic.data(), magic.length()) == 0)
+		{
+			return true;
+		}
+	}
+	if (std::memchr(data, '\0', length) != nullptr)
+	{
+		return true;
+	}
+
+	const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+	size_t invalid = 0;
+	size_t i = 0;
+	while (i < length)
+	{
+		unsigned char lead = bytes[i];
+		size_t sequence_length = (lead < 0x80) ? 1 : ((lead & 0xE0) == 0xC0) ? 2
+												 : ((lead & 0xF0) == 0xE0)	 ? 3
+												 : ((lead & 0xF8) == 0xF0)	 ? 4
+																			 : 0;
+		if (sequence_length == 0)
+		{
+			invalid++;
+			i++;
+			continue;
+		}
+		if (i + sequence_length > length)
+		{
+			break; // Truncated by the block boundary
+		}
+		size_t continuation = 1;
+		while (continuation < sequence_length && (bytes[i + continuation] & 0xC0) == 0x80)
+		{
+			continuation++;
+		}
+		if (continuation < sequence_length)
+		{
+			invalid++;
+			i++;
+			continue;
+		}
+		i += sequence_length;
+	}
+	return invalid * 10 > length * 3;
+}
+
+/**
+ * @brief Reads only the first block of a file and classifies it with looks_binary().
+ * Shared by every printer backend; unreadable files are treated as text so the printer
+ * reports the error as before.
+ */
+bool is_binary_file(const fs::path &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	tally(run_stats.files_opened);
+	char block[BINARY_SNIFF_BYTES];
+	ssize_t length;
+	do
+	{
+		length = read(fd, block, sizeof(block));
+	} while (length < 0 && errno == EINTR);
+	close(fd);
+	tally(run_stats.bytes_read, length > 0 ? static_cast<std::uint64_t>(length) : 0);
+	return length > 0 && looks_binary(block, static_cast<size_t>(length));
+}
+
+/**
+ * @brief Formats a byte count for humans, e.g. 3355443 -> "3.2 MB".
+ */
+std::string format_size(std::uint64_t bytes)
+{
+	const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+	double value = static_cast<double>(bytes);
+	size_t unit = 0;
+	while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0]))
+	{
+		value /= 1024.0;
+		unit++;
+	}
+	std::stringstream formatted;
+	if (unit == 0)
+		formatted << bytes << " " << units[unit];
+	else
+		formatted << std::fixed << std::setprecision(1) << value << " " << units[unit];
+	return formatted.str();
+}
+
+/**
+ * @brief Parses a byte count with an optional K/M/G suffix (powers of 1024), e.g. "64K".
+ * @return false if the text is not a valid count.
+ */
+bool parse_byte_count(const std::string &text, std::uint64_t &bytes)
+{
+	// Digits only: no sign or whitespace, which std::stoull would accept
+	std::uint64_t count = 0;
+	auto parsed = std::from_chars(text.data(), text.data() + text.size(), count);
+	if (parsed.ec != std::errc() || parsed.ptr == text.data())
+	{
+		return false;
+	}
+	std::string suffix(parsed.ptr, text.data() + text.size());
+	int shift = 0;
+	if (suffix == "K" || suffix == "k")
+		shift = 10;
+	else if (suffix == "M" || suffix == "m")
+		shift = 20;
+	else if (suffix == "G" || suffix == "g")
+		shift = 30;
+	else if (!suffix.empty())
+		return false;
+	if (count > (std::numeric_limits<std::uint64_t>::max() >> shift))
+	{
+		return false; // Would overflow
+	}
+	bytes = count << shift;
+	return true;
+}
+
+// --- In-Memory Path Tree ---
+
+/**
+ * @brief A directory tree built from a list of relative paths instead of a directory walk.
+ * Children are kept in a std::map, so they come out sorted by name like the native tree.
+ */
+struct PathTreeNode
+{
+	std::map<std::string, PathTreeNode> children;
+	bool is_directory = false;
+};
+
+/**
+ * @brief Adds a '/'-separated relative path (and its parent directories) to the tree.
+ * @param is_directory Whether the last component itself is a directory (e.g. a submodule).
+ */
+void path_tree_insert(PathTreeNode &root, const std::string &rel_path, bool is_directory = false)
+{
+	PathTreeNode *node = &root;
+	size_t start = 0;
+	while (start < rel_path.length())
+	{
+		size_t end = rel_path.find('/', start);
+		bool last = (end == std::string::npos);
+		if (last)
+			end = rel_path.length();
+		if (end > start)
+		{
+			node->is_directory = true;
+			node = &node->children[rel_path.substr(start, end - start)];
+		}
+		start = end + 1;
+	}
+	if (is_directory)
+	{
+		node->is_directory = true;
+	}
+}
+
+/**
+ * @brief Draws a PathTreeNode like print_tree_recursive, respecting the list filters and --sort.
+ * @param rel_prefix Relative path of `node` ("" for the root, otherwise ending in '/').
+ */
+void print_path_tree(const PathTreeNode &node, const std::string &rel_prefix, const std::string &prefix, const Filters &filters,
+					 SortOrder order, std::ostream &out = std::cout)
+{
+	std::vector<std::pair<const std::string *, const PathTreeNode *>> visible;
+	for (const auto &child : node.children)
+	{
+		tally(run_stats.entries_visited);
+		if (matches_filters_rel(rel_prefix + child.first, child.first, filters.list_includes, filters.list_excludes))
+		{
+			visible.push_back({&child.first, &child.second});
+		}
+		else
+		{
+			tally(run_stats.entries_pruned);
+		}
+	}
+	if (order != SortOrder::Bytes) // The map already holds the children in byte order
+	{
+		std::vector<std::pair<std::string, size_t>> keys(visible.size());
+		for (size_t i = 0; i < visible.size(); ++i)
+		{
+			append_sort_key(order, *visible[i].first, keys[i].first);
+			keys[i].second = i;
+		}
+		std::sort(keys.begin(), keys.end(), [&visible](const auto &a, const auto &b)
+				  { return sort_key_less(a.first, *visible[a.second].first, b.first, *visible[b.second].first); });
+		auto by_name = visible;
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			visible[i] = by_name[keys[i].second];
+		}
+	}
+
+	for (size_t i = 0; i < visible.size() && !output_closed(); ++i)
+	{
+		const std::string &name = *visible[i].first;
+		const PathTreeNode &child = *visible[i].second;
+		bool is_last = (i == visible.size() - 1);
+
+		out << prefix;
+		out << (is_last ? "└── " : "├── ");
+		out << name;
+
+		if (child.is_directory)
+		{
+			out << "/\n";
+			std::string new_prefix = prefix + (is_last ? "    " : "│   ");
+			print_path_tree(child, rel_prefix + name + "/", new_prefix, filters, order, out);
+		}
+		else
+		{
+			out << '\n';
+		}
+	}
+}
+
+/**
+ * @brief Collects the files of a PathTreeNode that the content phase should print, in tree
+ * order: directories failing the list filters are pruned, files must pass the print filters
+ * (the same rules as the recursive walk in step 6b).
+ */
+void collect_printable_paths(const PathTreeNode &node, const std::string &rel_prefix, const Filters &filters, std::vector<std::string> &paths)
+{
+	for (const auto &child : node.children)
+	{
+		std::string rel_path = rel_prefix + child.first;
+		tally(run_stats.entries_visited);
+		if (child.second.is_directory)
+		{
+			if (matches_filters_rel(rel_path, child.first, filters.list_includes, filters.list_excludes))
+			{
+				collect_printable_paths(child.second, rel_path + "/", filters, paths);
+			}
+			else
+			{
+				tally(run_stats.entries_pruned);
+			}
+		}
+		else if (matches_filters_rel(rel_path, child.first, filters.print_includes, filters.print_excludes))
+		{
+			paths.push_back(rel_path);
+		}
+		else
+		{
+			tally(run_stats.entries_pruned);
+		}
+	}
+}
+
+/**
+ * @brief Builds a PathTreeNode from a --files-from list. Entries are separated by NUL bytes if
+ * the list holds any (`git ls-files -z`, `fd -0`), otherwise by newlines. Relative entries
+ * are relative to `target_path`; an entry ending in '/' is a directory.
+ * @return The number of entries skipped because they lie outside `target_path`.
+ */
+size_t build_listed_tree(const std::string &list, const fs::path &target_path, PathTreeNode &root)
+{
+	char separator = list.find('\0') != std::string::npos ? '\0' : '\n';
+	size_t skipped = 0;
+	size_t start = 0;
+	while (start < list.length())
+	{
+		size_t end = list.find(separator, start);
+		if (end == std::string::npos)
+			end = list.length();
+		std::string entry = list.substr(start, end - start);
+		start = end + 1;
+		if (separator == '\n' && !entry.empty() && entry.back() == '\r')
+			entry.pop_back();
+		if (entry.empty())
+			continue;
+
+		fs::path path = fs::path(entry).lexically_normal();
+		if (path.is_absolute())
+			path = path.lexically_relative(target_path);
+		std::string rel_path = path.generic_string();
+		bool is_directory = !rel_path.empty() && rel_path.back() == '/';
+		if (is_directory)
+			rel_path.pop_back();
+		if (rel_path == ".")
+			continue; // The target itself
+		if (rel_path.empty() || rel_path == ".." || rel_path.compare(0, 3, "../") == 0)
+		{
+			++skipped;
+			continue;
+		}
+		path_tree_insert(root, rel_path, is_directory);
+	}
+	return skipped;
+}
+
+// --- Content Deduplication ---
+
+/**
+ * @brief A file whose content has already been emitted, kept as a dedup candidate.
+ */
+struct EmittedFile
+{
+	fs::path path;
+	std::string display_path; // How the file was announced ("rel/path" or "target/rel/path")
+	std::uint64_t size;
+	bool hashed;
+	std::uint64_t hash;
+	std::uint64_t content_offset; // Where its content sits in the output, for the dump index
+	std::uint64_t content_length;
+};
+
+/**
+ * @brief Remembers emitted files so later identical ones can be replaced by a reference.
+ *
+ * Hardlinks are caught by (st_dev, st_ino) without reading anything. Otherwise only files
+ * whose size matches an earlier one are hashed, and earlier files are hashed lazily, so
+ * trees without duplicates pay (almost) nothing.
+ */
+class DedupIndex
+{
+public:
+	/**
+	 * @brief Looks for an already emitted file with the same content.
+	 * @param hash Receives this file's hash if one had to be computed.
+	 * @return The matching emitted file, or nullptr if the content is new.
+	 */
+	const EmittedFile *find_identical(const fs::path &path, const struct stat &file_stat, bool &hashed, std::uint64_t &hash)
+	{
+		hashed = false;
+		auto inode = by_inode_.find({file_stat.st_dev, file_stat.st_ino});
+		if (inode != by_inode_.end())
+		{
+			return &files_[inode->second];
+		}
+
+		auto bucket = by_size_.find(static_cast<std::uint64_t>(file_stat.st_size));
+		if (bucket == by_size_.end())
+		{
+			return nullptr;
+		}
+		for (size_t candidate_index : bucket->second)
+		{
+			EmittedFile &candidate = files_[candidate_index];
+			if (!candidate.hashed)
+			{
+				candidate.hashed = hash_file(candidate.path, candidate.hash);
+				if (!candidate.hashed)
+					continue;
+			}
+			if (!hashed)
+			{
+				hashed = hash_file(path, hash);
+				if (!hashed)
+					return nullptr;
+			}
+			if (candidate.hash == hash)
+			{
+				return &candidate;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * @brief Records a file whose content was just emitted.
+	 */
+	void record(const struct stat &file_stat, EmittedFile file)
+	{
+		size_t file_index = files_.size();
+		by_inode_[{file_stat.st_dev, file_stat.st_ino}] = file_index;
+		by_size_[file.size].push_back(file_index);
+		files_.push_back(std::move(file));
+	}
+
+	/**
+	 * @brief Looks up an emitted git blob. Equal blob oids mean equal content, so no hashing.
+	 */
+	const EmittedFile *find_blob(const std::string &oid) const
+	{
+		auto found = by_oid_.find(oid);
+		return found == by_oid_.end() ? nullptr : &files_[found->second];
+	}
+
+	void record_blob(const std::string &oid, EmittedFile file)
+	{
+		by_oid_[oid] = files_.size();
+		files_.push_back(std::move(file));
+	}
+
+private:
+	std::vector<EmittedFile> files_;
+	std::map<std::pair<dev_t, ino_t>, size_t> by_inode_;
+	std::map<std::uint64_t, std::vector<size_t>> by_size_;
+	std::map<std::string, size_t> by_oid_;
+};
+
+// --- Git Index ---
+
+/**
+ * @brief One entry of .git/index: a tracked path and the stat data git cached for it.
+ */
+struct GitIndexEntry
+{
+	std::string path; // Relative to the work tree, '/'-separated
+	std::uint32_t ctime_sec, ctime_nsec;
+	std::uint32_t mtime_sec, mtime_nsec;
+	std::uint32_t dev, ino, mode, uid, gid, size; // Truncated to 32 bits, as git stores them
+	std::string oid;							  // Raw 20-byte SHA-1 of the staged blob
+	int stage;									  // 0 normally, 1-3 during a merge conflict
+	bool skip_worktree;							  // Sparse checkout: not present on disk
+};
+
+std::uint32_t read_be32(const unsigned char *p)
+{
+	return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]);
+}
+
+std::uint16_t read_be16(const unsigned char *p)
+{
+	return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief Finds the git directory for `start` by walking up its parents.
+ * Handles `.git` files ("gitdir: ...") used by worktrees and submodules.
+ * @param work_tree Receives the directory that contains `.git`.
+ * @return The git directory, or an empty path if `start` is not inside a repository.
+ */
+fs::path find_git_dir(const fs::path &start, fs::path &work_tree)
+{
+	std::error_code ec;
+	for (fs::path dir = start; !dir.empty(); dir = dir.parent_path())
+	{
+		fs::path dot_git = dir / ".git";
+		if (fs::is_directory(dot_git, ec))
+		{
+			work_tree = dir;
+			return dot_git;
+		}
+		if (fs::is_regular_file(dot_git, ec))
+		{
+			std::ifstream link(dot_git);
+			std::string line;
+			if (std::getline(link, line) && line.rfind("gitdir:", 0) == 0)
+			{
+				fs::path git_dir = trim(line.substr(7));
+				work_tree = dir;
+				return git_dir.is_absolute() ? git_dir : dir / git_dir;
+			}
+		}
+		if (dir == dir.root_path())
+		{
+			break;
+		}
+	}
+	return fs::path();
+}
+
+/**
+ * @brief Parses a .git/index file (versions 2, 3 and 4).
+ * Version 4 prefix-compresses each path against the previous entry: a varint says how many
+ * bytes to drop from the end of the previous path, then a NUL-terminated suffix follows.
+ * @return false (with `error` set) if the file is missing or malformed.
+ */
+bool read_git_index(const fs::path &index_path, std::vector<GitIndexEntry> &entries, std::string &error)
+{
+	std::ifstream file(index_path, std::ios::binary);
+	if (!file.is_open())
+	{
+		error = "could not open " + index_path.string();
+		return false;
+	}
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data());
+	size_t size = data.size();
+
+	if (size < 12 || data.compare(0, 4, "DIRC") != 0)
+	{
+		error = "not a git index";
+		return false;
+	}
+	std::uint32_t version = read_be32(bytes + 4);
+	std::uint32_t count = read_be32(bytes + 8);
+	if (version < 2 || version > 4)
+	{
+		error = "unsupported index version " + std::to_string(version);
+		return false;
+	}
+
+	const size_t fixed_size = 62; // 10 stat words, 20-byte SHA-1, 16-bit flags
+	size_t pos = 12;
+	std::string previous_path;
+	entries.reserve(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		size_t entry_start = pos;
+		if (pos + fixed_size > size)
+		{
+			error = "truncated index entry";
+			return false;
+		}
+		const unsigned char *p = bytes + pos;
+		GitIndexEntry entry;
+		entry.ctime_sec = read_be32(p);
+		entry.ctime_nsec = read_be32(p + 4);
+		entry.mtime_sec = read_be32(p + 8);
+		entry.mtime_nsec = read_be32(p + 12);
+		entry.dev = read_be32(p + 16);
+		entry.ino = read_be32(p + 20);
+		entry.mode = read_be32(p + 24);
+		entry.uid = read_be32(p + 28);
+		entry.gid = read_be32(p + 32);
+		entry.size = read_be32(p + 36);
+		entry.oid.assign(reinterpret_cast<const char *>(p + 40), 20);
+		std::uint16_t flags = read_be16(p + 60);
+		entry.stage = (flags >> 12) & 0x3;
+		entry.skip_worktree = false;
+		pos += fixed_size;
+
+		if (version >= 3 && (flags & 0x4000)) // CE_EXTENDED
+		{
+			if (pos + 2 > size)
+			{
+				error = "truncated index entry";
+				return false;
+			}
+			entry.skip_worktree = (read_be16(bytes + pos) & 0x4000) != 0;
+			pos += 2;
+		}
+
+		if (version == 4)
+		{
+			// Offset-encoded varint, as in git's varint.c
+			if (pos >= size)
+			{
+				error = "truncated index entry";
+				return false;
+			}
+			std::uint64_t strip = bytes[pos] & 0x7f;
+			while (bytes[pos++] & 0x80)
+			{
+				if (pos >= size)
+				{
+					error = "truncated index entry";
+					return false;
+				}
+				strip = ((strip + 1) << 7) | (bytes[pos] & 0x7f);
+			}
+			if (strip > previous_path.length())
+			{
+				error = "corrupt path prefix in index";
+				return false;
+			}
+			const void *nul = std::memchr(bytes + pos, '\0', size - pos);
+			if (nul == nullptr)
+			{
+				error = "truncated index path";
+				return false;
+			}
+			size_t suffix_length = static_cast<const unsigned char *>(nul) - (bytes + pos);
+			entry.path = previous_path.substr(0, previous_path.length() - strip);
+			entry.path.append(reinterpret_cast<const char *>(bytes + pos), suffix_length);
+			pos += suffix_length + 1;
+		}
+		else
+		{
+			const void *nul = std::memchr(bytes + pos, '\0', size - pos);
+			if (nul == nullptr)
+			{
+				error = "truncated index path";
+				return false;
+			}
+			size_t path_length = static_cast<const unsigned char *>(nul) - (bytes + pos);
+			entry.path.assign(reinterpret_cast<const char *>(bytes + pos), path_length);
+			// Entries are NUL-padded (1 to 8 bytes) to a multiple of 8 from their start
+			pos = entry_start + ((pos - entry_start + path_length + 8) & ~size_t(7));
+		}
+
+		previous_path = entry.path;
+		entries.push_back(std::move(entry));
+	}
+	return true;
+}
+
+/**
+ * @brief Builds a PathTreeNode of the files tracked under `target_path`, from the git index.
+ * @return false (with `error` set) if no usable index was found.
+ */
+bool build_git_tracked_tree(const fs::path &target_path, PathTreeNode &root, std::string &error)
+{
+	fs::path work_tree;
+	fs::path git_dir = find_git_dir(target_path, work_tree);
+	if (git_dir.empty())
+	{
+		error = "not inside a git repository";
+		return false;
+	}
+	std::vector<GitIndexEntry> entries;
+	if (!read_git_index(git_dir / "index", entries, error))
+	{
+		return false;
+	}
+
+	// Only entries below the target, relative to it
+	std::string prefix = fs::relative(target_path, work_tree).generic_string();
+	if (prefix == ".")
+		prefix.clear();
+	else
+		prefix += "/";
+
+	for (const auto &entry : entries)
+	{
+		if (entry.skip_worktree || entry.path.compare(0, prefix.length(), prefix) != 0)
+		{
+			continue;
+		}
+		bool is_gitlink = (entry.mode & 0170000) == 0160000; // Submodule: shown as a directory
+		path_tree_insert(root, entry.path.substr(prefix.length()), is_gitlink);
+	}
+	return true;
+}
+
+// --- Git Object Database ---
+#ifdef CATLR_USE_ZLIB
+
+enum class GitObjectType
+{
+	None = 0,
+	Commit = 1,
+	Tree = 2,
+	Blob = 3,
+	Tag = 4,
+	OfsDelta = 6,
+	RefDelta = 7
+};
+
+/**
+ * @brief A fully resolved (non-delta) object. The data is shared so cached bases are not copied.
+ */
+struct GitObject
+{
+	GitObjectType type = GitObjectType::None;
+	std::shared_ptr<const std::string> data;
+};
+
+std::string to_hex(const std::string &raw)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	for (unsigned char c : raw)
+	{
+		hex += digits[c >> 4];
+		hex += digits[c & 15];
+	}
+	return hex;
+}
+
+/**
+ * @brief Converts an even-length hex string to raw bytes.
+ * @return false if `hex` contains a non-hex character or has an odd length.
+ */
+bool from_hex(const std::string &hex, std::string &raw)
+{
+	if (hex.length() % 2 != 0)
+	{
+		return false;
+	}
+	raw.clear();
+	for (size_t i = 0; i < hex.length(); i += 2)
+	{
+		int value = 0;
+		for (size_t j = i; j < i + 2; ++j)
+		{
+			char c = static_cast<char>(std::tolower(static_cast<unsigned char>(hex[j])));
+			if (c >= '0' && c <= '9')
+				value = value * 16 + (c - '0');
+			else if (c >= 'a' && c <= 'f')
+				value = value * 16 + (c - 'a' + 10);
+			else
+				return false;
+		}
+		raw += static_cast<char>(value);
+	}
+	return true;
+}
+
+/**
+ * @brief Inflates a complete zlib stream.
+ * @param size_hint Expected output size (exact for packed objects), used to size the buffer.
+ */
+bool inflate_zlib(const unsigned char *input, size_t input_length, std::string &output, size_t size_hint)
+{
+	z_stream stream{};
+	if (inflateInit(&stream) != Z_OK)
+	{
+		return false;
+	}
+	output.resize(std::max<size_t>(size_hint, 64));
+	stream.next_in = const_cast<Bytef *>(input);
+	stream.avail_in = static_cast<uInt>(std::min<size_t>(input_length, std::numeric_limits<uInt>::max()));
+	size_t produced = 0;
+	int status;
+	do
+	{
+		if (produced == output.size())
+		{
+			output.resize(output.size() * 2);
+		}
+		stream.next_out = reinterpret_cast<Bytef *>(&output[produced]);
+		stream.avail_out = static_cast<uInt>(std::min<size_t>(output.size() - produced, std::numeric_limits<uInt>::max()));
+		status = inflate(&stream, Z_NO_FLUSH);
+		produced = static_cast<size_t>(reinterpret_cast<char *>(stream.next_out) - &output[0]);
+	} while (status == Z_OK || (status == Z_BUF_ERROR && stream.avail_out == 0));
+	inflateEnd(&stream);
+	output.resize(produced);
+	return status == Z_STREAM_END;
+}
+
+/**
+ * @brief Applies a git delta (copy/insert instructions) to its base object.
+ */
+bool apply_delta(const std::string &base, const std::string &delta, std::string &result)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(delta.data());
+	const unsigned char *end = p + delta.size();
+	auto read_size = [&](std::uint64_t &value)
+	{
+		value = 0;
+		int shift = 0;
+		unsigned char c;
+		do
+		{
+			if (p >= end)
+				return false;
+			c = *p++;
+			value |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+			shift += 7;
+		} while (c & 0x80);
+		return true;
+	};
+
+	std::uint64_t base_size, result_size;
+	if (!read_size(base_size) || !read_size(result_size) || base_size != base.size())
+	{
+		return false;
+	}
+	result.clear();
+	result.reserve(result_size);
+	while (p < end)
+	{
+		unsigned char cmd = *p++;
+		if (cmd & 0x80)
+		{
+			// Copy from base: bits 0-3 select offset bytes, bits 4-6 select size bytes
+			std::uint64_t copy_offset = 0, copy_size = 0;
+			for (int i = 0; i < 4; ++i)
+			{
+				if (cmd & (1 << i))
+				{
+					if (p >= end)
+						return false;
+					copy_offset |= static_cast<std::uint64_t>(*p++) << (8 * i);
+				}
+			}
+			for (int i = 0; i < 3; ++i)
+			{
+				if (cmd & (0x10 << i))
+				{
+					if (p >= end)
+						return false;
+					copy_size |= static_cast<std::uint64_t>(*p++) << (8 * i);
+				}
+			}
+			if (copy_size == 0)
+				copy_size = 0x10000;
+			if (copy_offset + copy_size > base.size())
+				return false;
+			result.append(base, copy_offset, copy_size);
+		}
+		else if (cmd != 0)
+		{
+			// Insert the next `cmd` literal bytes
+			if (static_cast<size_t>(end - p) < cmd)
+				return false;
+			result.append(reinterpret_cast<const char *>(p), cmd);
+			p += cmd;
+		}
+		else
+		{
+			return false; // Reserved instruction
+		}
+	}
+	return result.size() == result_size;
+}
+
+/**
+ * @brief A packfile and its version 2 index (.idx), both memory-mapped.
+ */
+struct GitPack
+{
+	MappedFile index;
+	MappedFile pack;
+	std::uint32_t count = 0;
+	const unsigned char *fanout = nullptr;	 // 256 cumulative counts by first oid byte
+	const unsigned char *oids = nullptr;	 // `count` sorted 20-byte oids
+	const unsigned char *offsets = nullptr;	 // `count` 32-bit offsets (MSB set: index into large_offsets)
+	const unsigned char *large_offsets = nullptr;
+
+	bool load(const fs::path &idx_path)
+	{
+		fs::path pack_path = idx_path;
+		pack_path.replace_extension(".pack");
+		if (!index.open(idx_path) || !pack.open(pack_path))
+		{
+			return false;
+		}
+		const unsigned char *p = index.data();
+		if (index.size() < 8 + 256 * 4 || std::memcmp(p, "\377tOc", 4) != 0 || read_be32(p + 4) != 2)
+		{
+			return false; // Only version 2 indexes (git's default since 1.5.2)
+		}
+		fanout = p + 8;
+		count = read_be32(fanout + 255 * 4);
+		for (int bucket = 1; bucket < 256; ++bucket)
+		{
+			if (read_be32(fanout + (bucket - 1) * 4) > read_be32(fanout + bucket * 4))
+			{
+				return false; // Corrupt fanout: lookups could run past the oid table
+			}
+		}
+		oids = fanout + 256 * 4;
+		offsets = oids + size_t(count) * 20 + size_t(count) * 4; // Skip the CRC32 table
+		large_offsets = offsets + size_t(count) * 4;
+		return static_cast<size_t>(large_offsets - p) <= index.size();
+	}
+
+	std::string oid_at(std::uint32_t position) const
+	{
+		return std::string(reinterpret_cast<const char *>(oids + size_t(position) * 20), 20);
+	}
+
+	/**
+	 * @brief Binary-searches the index for an oid (or the first oid with a given prefix).
+	 * @return The position of the first entry >= `oid` within its fanout bucket.
+	 */
+	std::uint32_t lower_bound(const std::string &oid) const
+	{
+		unsigned char first = static_cast<unsigned char>(oid[0]);
+		std::uint32_t low = first == 0 ? 0 : read_be32(fanout + (first - 1) * 4);
+		std::uint32_t high = read_be32(fanout + first * 4);
+		while (low < high)
+		{
+			std::uint32_t middle = low + (high - low) / 2;
+			if (std::memcmp(oids + size_t(middle) * 20, oid.data(), oid.length()) < 0)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		return low;
+	}
+
+	bool find(const std::string &oid, std::uint64_t &offset) const
+	{
+		std::uint32_t position = lower_bound(oid);
+		if (position >= count || std::memcmp(oids + size_t(position) * 20, oid.data(), 20) != 0)
+		{
+			return false;
+		}
+		std::uint32_t small = read_be32(offsets + size_t(position) * 4);
+		if (small & 0x80000000u)
+		{
+			size_t large_at = static_cast<size_t>(large_offsets - index.data()) + size_t(small & 0x7fffffffu) * 8;
+			if (large_at + 8 > index.size())
+			{
+				return false; // Corrupt index
+			}
+			offset = (std::uint64_t(read_be32(index.data() + large_at)) << 32) | read_be32(index.data() + large_at + 4);
+		}
+		else
+		{
+			offset = small;
+		}
+		return true;
+	}
+};
+
+/**
+ * @brief Byte-capped LRU cache of resolved delta bases, keyed by (pack, offset).
+ * Long delta chains share bases, so without it each blob would re-inflate its whole chain.
+ */
+class DeltaBaseCache
+{
+public:
+	explicit DeltaBaseCache(size_t byte_limit) : byte_limit_(byte_limit) {}
+
+	bool get(size_t pack, std::uint64_t offset, GitObject &object)
+	{
+		auto found = entries_.find({pack, offset});
+		if (found == entries_.end())
+		{
+			return false;
+		}
+		lru_.splice(lru_.begin(), lru_, found->second);
+		object = found->second->second;
+		return true;
+	}
+
+	void put(size_t pack, std::uint64_t offset, const GitObject &object)
+	{
+		Key key{pack, offset};
+		if (entries_.count(key) != 0 || object.data->size() > byte_limit_)
+		{
+			return;
+		}
+		lru_.push_front({key, object});
+		entries_[key] = lru_.begin();
+		bytes_ += object.data->size();
+		while (bytes_ > byte_limit_)
+		{
+			bytes_ -= lru_.back().second.data->size();
+			entries_.erase(lru_.back().first);
+			lru_.pop_back();
+		}
+	}
+
+private:
+	using Key = std::pair<size_t, std::uint64_t>;
+	std::list<std::pair<Key, GitObject>> lru_;
+	std::map<Key, std::list<std::pair<Key, GitObject>>::iterator> entries_;
+	size_t bytes_ = 0;
+	size_t byte_limit_;
+};
+
+/**
+ * @brief Reads objects from a repository's loose objects and packfiles.
+ */
+class GitObjectStore
+{
+public:
+	explicit GitObjectStore(const fs::path &objects_dir) : objects_dir_(objects_dir), cache_(96 * 1024 * 1024)
+	{
+		std::error_code ec;
+		for (const auto &entry : fs::directory_iterator(objects_dir / "pack", ec))
+		{
+			if (entry.path().extension() == ".idx")
+			{
+				auto pack = std::make_unique<GitPack>();
+				if (pack->load(entry.path()))
+				{
+					packs_.push_back(std::move(pack));
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Reads and fully resolves an object by its raw 20-byte oid.
+	 */
+	bool read(const std::string &oid, GitObject &object)
+	{
+		for (size_t i = 0; i < packs_.size(); ++i)
+		{
+			std::uint64_t offset;
+			if (packs_[i]->find(oid, offset))
+			{
+				return read_packed(i, offset, object);
+			}
+		}
+		return read_loose(oid, object);
+	}
+
+	/**
+	 * @brief Expands an abbreviated hex oid (at least 4 digits) if it is unambiguous.
+	 */
+	bool resolve_prefix(const std::string &hex, std::string &oid)
+	{
+		std::string even_hex = hex.substr(0, hex.length() & ~size_t(1));
+		std::string raw_prefix;
+		if (hex.length() < 4 || !from_hex(even_hex, raw_prefix))
+		{
+			return false;
+		}
+		std::vector<std::string> matches;
+		auto consider = [&](const std::string &candidate)
+		{
+			if (to_hex(candidate).compare(0, hex.length(), hex) == 0 &&
+				std::find(matches.begin(), matches.end(), candidate) == matches.end())
+			{
+				matches.push_back(candidate);
+			}
+		};
+		for (const auto &pack : packs_)
+		{
+			for (std::uint32_t i = pack->lower_bound(raw_prefix); i < pack->count; ++i)
+			{
+				std::string candidate = pack->oid_at(i);
+				if (candidate.compare(0, raw_prefix.length(), raw_prefix) != 0)
+					break;
+				consider(candidate);
+			}
+		}
+		std::error_code ec;
+		for (const auto &entry : fs::directory_iterator(objects_dir_ / hex.substr(0, 2), ec))
+		{
+			std::string raw;
+			if (from_hex(hex.substr(0, 2) + entry.path().filename().string(), raw) && raw.length() == 20)
+			{
+				consider(raw);
+			}
+		}
+		if (matches.size() != 1)
+		{
+			return false;
+		}
+		oid = matches[0];
+		return true;
+	}
+
+private:
+	bool read_loose(const std::string &oid, GitObject &object)
+	{
+		std::string hex = to_hex(oid);
+		std::ifstream file(objects_dir_ / hex.substr(0, 2) / hex.substr(2), std::ios::binary);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		std::string compressed((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		std::string raw;
+		if (!inflate_zlib(reinterpret_cast<const unsigned char *>(compressed.data()), compressed.size(), raw, 0))
+		{
+			return false;
+		}
+		// "<type> <size>\0<data>"
+		size_t space = raw.find(' ');
+		size_t nul = raw.find('\0');
+		if (space == std::string::npos || nul == std::string::npos || space > nul)
+		{
+			return false;
+		}
+		std::string type = raw.substr(0, space);
+		object.type = type == "commit" ? GitObjectType::Commit : type == "tree" ? GitObjectType::Tree
+															 : type == "blob"	? GitObjectType::Blob
+															 : type == "tag"	? GitObjectType::Tag
+																				: GitObjectType::None;
+		object.data = std::make_shared<const std::string>(raw.substr(nul + 1));
+		return object.type != GitObjectType::None;
+	}
+
+	/**
+	 * @brief Reads one raw pack entry: its type and inflated payload (which may be a delta).
+	 */
+	bool read_pack_entry(const GitPack &pack, std::uint64_t offset, GitObjectType &type, std::string &data,
+						 std::uint64_t &base_offset, std::string &base_oid)
+	{
+		const unsigned char *p = pack.pack.data() + offset;
+		const unsigned char *end = pack.pack.data() + pack.pack.size();
+		if (offset >= pack.pack.size())
+		{
+			return false;
+		}
+		unsigned char c = *p++;
+		type = static_cast<GitObjectType>((c >> 4) & 7);
+		std::uint64_t size = c & 15;
+		int shift = 4;
+		while (c & 0x80)
+		{
+			if (p >= end)
+				return false;
+			c = *p++;
+			size |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+			shift += 7;
+		}
+
+		if (type == GitObjectType::OfsDelta)
+		{
+			// Negative offset to the base, in git's offset varint encoding
+			if (p >= end)
+				return false;
+			c = *p++;
+			std::uint64_t distance = c & 0x7f;
+			while (c & 0x80)
+			{
+				if (p >= end)
+					return false;
+				c = *p++;
+				distance = ((distance + 1) << 7) | (c & 0x7f);
+			}
+			if (distance > offset)
+				return false;
+			base_offset = offset - distance;
+		}
+		else if (type == GitObjectType::RefDelta)
+		{
+			if (end - p < 20)
+				return false;
+			base_oid.assign(reinterpret_cast<const char *>(p), 20);
+			p += 20;
+		}
+		return inflate_zlib(p, static_cast<size_t>(end - p), data, static_cast<size_t>(size)) && data.size() == size;
+	}
+
+	/**
+	 * @brief Resolves a packed object, walking its delta chain iteratively down to a cached
+	 * or non-delta base, then applying the deltas back up (caching intermediate bases).
+	 */
+	bool read_packed(size_t pack_index, std::uint64_t offset, GitObject &object)
+	{
+		std::vector<std::string> deltas;
+		std::vector<std::pair<size_t, std::uint64_t>> chain; // Object each delta produces
+		GitObject base;
+		while (true)
+		{
+			if (cache_.get(pack_index, offset, base))
+			{
+				break;
+			}
+			GitObjectType type;
+			std::string data, base_oid;
+			std::uint64_t base_offset = 0;
+			if (!read_pack_entry(*packs_[pack_index], offset, type, data, base_offset, base_oid))
+			{
+				return false;
+			}
+			if (type == GitObjectType::OfsDelta || type == GitObjectType::RefDelta)
+			{
+				deltas.push_back(std::move(data));
+				chain.push_back({pack_index, offset});
+				if (type == GitObjectType::OfsDelta)
+				{
+					offset = base_offset;
+					continue;
+				}
+				bool in_pack = false;
+				for (size_t i = 0; i < packs_.size() && !in_pack; ++i)
+				{
+					if (packs_[i]->find(base_oid, offset))
+					{
+						pack_index = i;
+						in_pack = true;
+					}
+				}
+				if (in_pack)
+				{
+					continue;
+				}
+				if (!read_loose(base_oid, base))
+				{
+					return false;
+				}
+				break;
+			}
+			base.type = type;
+			base.data = std::make_shared<const std::string>(std::move(data));
+			if (!deltas.empty())
+			{
+				cache_.put(pack_index, offset, base);
+			}
+			break;
+		}
+
+		for (size_t i = deltas.size(); i-- > 0;)
+		{
+			std::string result;
+			if (!apply_delta(*base.data, deltas[i], result))
+			{
+				return false;
+			}
+			base.data = std::make_shared<const std::string>(std::move(result));
+			if (i > 0)
+			{
+				cache_.put(chain[i].first, chain[i].second, base);
+			}
+		}
+		object = base;
+		return true;
+	}
+
+	fs::path objects_dir_;
+	std::vector<std::unique_ptr<GitPack>> packs_;
+	DeltaBaseCache cache_;
+};
+
+/**
+ * @brief The directory holding objects, refs and packed-refs. Linked worktrees keep only
+ * HEAD in their own git dir and point at the main one through a `commondir` file.
+ */
+fs::path git_common_dir(const fs::path &git_dir)
+{
+	std::ifstream commondir(git_dir / "commondir");
+	std::string line;
+	if (std::getline(commondir, line))
+	{
+		fs::path common = trim(line);
+		return common.is_absolute() ? common : git_dir / common;
+	}
+	return git_dir;
+}
+
+/**
+ * @brief Resolves a ref name (HEAD, branch, tag, remote, packed or loose, symbolic or not).
+ * Tries the names git's rev-parse tries, in the same order.
+ */
+bool resolve_git_ref_name(const fs::path &git_dir, const fs::path &common_dir, const std::string &name, std::string &oid, int depth = 0)
+{
+	if (depth > 5)
+	{
+		return false; // Symbolic ref loop
+	}
+	const std::vector<std::string> candidates = {name, "refs/" + name, "refs/tags/" + name, "refs/heads/" + name,
+												 "refs/remotes/" + name, "refs/remotes/" + name + "/HEAD"};
+	for (const auto &candidate : candidates)
+	{
+		for (const fs::path &dir : {git_dir, common_dir})
+		{
+			std::error_code ec;
+			fs::path ref_path = dir / candidate;
+			if (!fs::is_regular_file(ref_path, ec))
+			{
+				continue;
+			}
+			std::ifstream ref_file(ref_path);
+			std::string line;
+			std::getline(ref_file, line);
+			line = trim(line);
+			if (line.rfind("ref:", 0) == 0)
+			{
+				return resolve_git_ref_name(git_dir, common_dir, trim(line.substr(4)), oid, depth + 1);
+			}
+			if (line.length() == 40 && from_hex(line, oid))
+			{
+				return true;
+			}
+		}
+
+		std::ifstream packed_refs(common_dir / "packed-refs");
+		std::string line;
+		while (std::getline(packed_refs, line))
+		{
+			if (line.length() > 41 && line[40] == ' ' && line.substr(41) == candidate)
+			{
+				return from_hex(line.substr(0, 40), oid);
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Reads a named header line ("tree <hex>", "parent <hex>", "object <hex>") of a
+ * commit or tag object.
+ */
+bool read_object_header(const std::string &data, const std::string &key, std::string &oid)
+{
+	std::stringstream lines(data);
+	std::string line;
+	while (std::getline(lines, line) && !line.empty())
+	{
+		if (line.rfind(key + " ", 0) == 0)
+		{
+			return from_hex(line.substr(key.length() + 1, 40), oid);
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Resolves a revision to a commit oid. Supports ref names, full or abbreviated hex
+ * oids, and trailing first-parent steps (`main~3`, `HEAD^^`). Annotated tags are peeled.
+ */
+bool resolve_revision(const fs::path &git_dir, GitObjectStore &store, const std::string &revision, std::string &commit_oid, std::string &error)
+{
+	size_t suffix_start = revision.find_first_of("~^");
+	std::string name = revision.substr(0, suffix_start);
+	fs::path common_dir = git_common_dir(git_dir);
+
+	std::string oid;
+	if (!resolve_git_ref_name(git_dir, common_dir, name, oid) &&
+		!(name.length() == 40 && from_hex(name, oid)) &&
+		!store.resolve_prefix(name, oid))
+	{
+		error = "unknown or ambiguous revision '" + name + "'";
+		return false;
+	}
+
+	// Count first-parent steps: "~N" means N, "~" and "^" mean 1, "^0" means none. Anything
+	// else ("^{tree}", ":path", a stray letter) is not supported.
+	int steps = 0;
+	for (size_t i = (suffix_start == std::string::npos ? revision.length() : suffix_start); i < revision.length();)
+	{
+		char op = revision[i++];
+		if (op != '~' && op != '^')
+		{
+			error = "unknown or ambiguous revision '" + revision + "'";
+			return false;
+		}
+		size_t digits_end = i;
+		while (digits_end < revision.length() && std::isdigit(static_cast<unsigned char>(revision[digits_end])))
+			digits_end++;
+		int count = 1;
+		if (digits_end > i &&
+			(std::from_chars(revision.data() + i, revision.data() + digits_end, count).ec != std::errc() ||
+			 count > std::numeric_limits<int>::max() - steps))
+		{
+			error = "step count out of range in '" + revision + "'";
+			return false;
+		}
+		if (op == '^' && count > 1)
+		{
+			error = "only first-parent steps (~N, ^) are supported in '" + revision + "'";
+			return false;
+		}
+		steps += count;
+		i = digits_end;
+	}
+
+	for (int step = 0;; ++step)
+	{
+		GitObject object;
+		// Peel annotated tags down to the commit
+		while (true)
+		{
+			if (!store.read(oid, object))
+			{
+				error = "missing object " + to_hex(oid);
+				return false;
+			}
+			if (object.type != GitObjectType::Tag)
+				break;
+			if (!read_object_header(*object.data, "object", oid))
+			{
+				error = "malformed tag " + to_hex(oid);
+				return false;
+			}
+		}
+		if (object.type != GitObjectType::Commit)
+		{
+			error = "'" + revision + "' does not name a commit";
+			return false;
+		}
+		if (step == steps)
+			break;
+		if (!read_object_header(*object.data, "parent", oid))
+		{
+			error = "'" + revision + "' goes past the root commit";
+			return false;
+		}
+	}
+	commit_oid = oid;
+	return true;
+}
+
+/**
+ * @brief One entry of a tree object.
+ */
+struct GitTreeEntry
+{
+	std::string mode; // Octal, e.g. "100644", "40000" (tree), "120000" (symlink), "160000" (submodule)
+	std::string name;
+	std::string oid;
+};
+
+/**
+ * @brief Parses a tree object: repeated "<mode> <name>\0<20-byte oid>".
+ */
+bool parse_git_tree(const std::string &data, std::vector<GitTreeEntry> &entries)
+{
+	size_t pos = 0;
+	while (pos < data.size())
+	{
+		size_t space = data.find(' ', pos);
+		size_t nul = data.find('\0', space == std::string::npos ? pos : space);
+		if (space == std::string::npos || nul == std::string::npos || nul + 21 > data.size())
+		{
+			return false;
+		}
+		entries.push_back({data.substr(pos, space - pos), data.substr(space + 1, nul - space - 1), data.substr(nul + 1, 20)});
+		pos = nul + 21;
+	}
+	return true;
+}
+
+/**
+ * @brief Walks a tree object recursively into a PathTreeNode, recording the blob oid of every
+ * regular file. Subtrees failing the list filters are not read at all.
+ */
+bool collect_revision_tree(GitObjectStore &store, const std::string &tree_oid, const std::string &rel_prefix, const Filters &filters,
+						   PathTreeNode &node, std::map<std::string, std::string> &blob_oids, std::string &error)
+{
+	GitObject tree;
+	std::vector<GitTreeEntry> entries;
+	if (!store.read(tree_oid, tree) || tree.type != GitObjectType::Tree || !parse_git_tree(*tree.data, entries))
+	{
+		error = "could not read tree " + to_hex(tree_oid);
+		return false;
+	}
+	for (const auto &entry : entries)
+	{
+		std::string rel_path = rel_prefix + entry.name;
+		if (entry.mode == "40000")
+		{
+			if (!matches_filters_rel(rel_path, entry.name, filters.list_includes, filters.list_excludes))
+			{
+				continue;
+			}
+			PathTreeNode &child = node.children[entry.name];
+			child.is_directory = true;
+			if (!collect_revision_tree(store, entry.oid, rel_path + "/", filters, child, blob_oids, error))
+			{
+				return false;
+			}
+		}
+		else if (entry.mode == "160000")
+		{
+			node.children[entry.name].is_directory = true; // Submodule: listed, not descended
+		}
+		else
+		{
+			node.children[entry.name];
+			if (entry.mode == "100644" || entry.mode == "100755")
+			{
+				blob_oids[rel_path] = entry.oid;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Builds the tree of `target_path` as it is in `revision`, straight from the object
+ * database (no checkout). Targets below the work tree root start at the matching subtree.
+ * @param resolved Receives the hex oid of the commit `revision` resolved to.
+ */
+bool build_revision_tree(const fs::path &target_path, const std::string &revision, const Filters &filters,
+						 std::unique_ptr<GitObjectStore> &store, PathTreeNode &root, std::map<std::string, std::string> &blob_oids,
+						 std::string &resolved, std::string &error)
+{
+	fs::path work_tree;
+	fs::path git_dir = find_git_dir(target_path, work_tree);
+	if (git_dir.empty())
+	{
+		error = "not inside a git repository";
+		return false;
+	}
+	store = std::make_unique<GitObjectStore>(git_common_dir(git_dir) / "objects");
+
+	std::string commit_oid, tree_oid;
+	GitObject commit;
+	if (!resolve_revision(git_dir, *store, revision, commit_oid, error))
+	{
+		return false;
+	}
+	if (!store->read(commit_oid, commit) || !read_object_header(*commit.data, "tree", tree_oid))
+	{
+		error = "could not read commit " + to_hex(commit_oid);
+		return false;
+	}
+	resolved = to_hex(commit_oid);
+
+	// Descend to the subtree matching the target's position in the work tree
+	std::string prefix = fs::relative(target_path, work_tree).generic_string();
+	if (prefix != ".")
+	{
+		std::stringstream components(prefix);
+		std::string component;
+		while (std::getline(components, component, '/'))
+		{
+			GitObject tree;
+			std::vector<GitTreeEntry> entries;
+			if (!store->read(tree_oid, tree) || !parse_git_tree(*tree.data, entries))
+			{
+				error = "could not read tree " + to_hex(tree_oid);
+				return false;
+			}
+			auto found = std::find_if(entries.begin(), entries.end(), [&](const GitTreeEntry &entry)
+									  { return entry.name == component && entry.mode == "40000"; });
+			if (found == entries.end())
+			{
+				error = "'" + prefix + "' does not exist in " + revision;
+				return false;
+			}
+			tree_oid = found->oid;
+		}
+	}
+	return collect_revision_tree(*store, tree_oid, "", filters, root, blob_oids, error);
+}
+
+#endif // CATLR_USE_ZLIB
+
+// --- Dump Index ---
+
+// The trailer ends with a fixed-width line so a reader can find the index from the end of the dump.
+const std::string INDEX_HEADER = "--- catlr index ---";
+const std::string INDEX_FOOTER_PREFIX = "--- catlr index at ";
+const std::string INDEX_FOOTER_SUFFIX = " ---";
+const size_t INDEX_FOOTER_DIGITS = 20;
+const size_t INDEX_FOOTER_LENGTH = INDEX_FOOTER_PREFIX.length() + INDEX_FOOTER_DIGITS + INDEX_FOOTER_SUFFIX.length() + 1;
+
+/**
+ * @brief Escapes tabs, newlines and backslashes so a path fits on one index line.
+ */
+std::string escape_index_field(const std::string &field)
+{
+	std::string escaped;
+	for (char c : field)
+	{
+		if (c == '\\')
+			escaped += "\\\\";
+		else if (c == '\t')
+			escaped += "\\t";
+		else if (c == '\n')
+			escaped += "\\n";
+		else
+			escaped += c;
+	}
+	return escaped;
+}
+
+/**
+ * @brief Reverses escape_index_field.
+ */
+std::string unescape_index_field(const std::string &field)
+{
+	std::string unescaped;
+	for (size_t i = 0; i < field.length(); ++i)
+	{
+		if (field[i] == '\\' && i + 1 < field.length())
+		{
+			char next = field[++i];
+			unescaped += (next == 't') ? '\t' : (next == 'n') ? '\n' : next;
+		}
+		else
+		{
+			unescaped += field[i];
+		}
+	}
+	return unescaped;
+}
+
+/**
+ * @brief Writes the index records, one "offset<TAB>length<TAB>target<TAB>path" line each.
+ */
+void write_index_entries(std::ostream &out, const std::vector<IndexEntry> &entries)
+{
+	out << INDEX_HEADER << "\n";
+	for (const auto &entry : entries)
+	{
+		out << entry.offset << '\t' << entry.length << '\t'
+			<< escape_index_field(entry.target) << '\t' << escape_index_field(entry.path) << '\n';
+	}
+}
+
+/**
+ * @brief Appends the index trailer to the dump, ending with the fixed-width footer line.
+ */
+void write_index_trailer(OutputBuffer &out_buffer, const std::vector<IndexEntry> &entries)
+{
+	std::uint64_t index_offset = out_buffer.position();
+	write_index_entries(std::cout, entries);
+	std::string digits = std::to_string(index_offset);
+	digits.insert(0, INDEX_FOOTER_DIGITS - digits.length(), '0');
+	std::cout << INDEX_FOOTER_PREFIX << digits << INDEX_FOOTER_SUFFIX << "\n";
+}
+
+/**
+ * @brief Parses index lines from a stream until EOF or the footer line.
+ */
+std::vector<IndexEntry> read_index_entries(std::istream &in)
+{
+	std::vector<IndexEntry> entries;
+	std::string line;
+	if (!std::getline(in, line) || line != INDEX_HEADER)
+	{
+		return entries;
+	}
+	while (std::getline(in, line))
+	{
+		if (line.rfind(INDEX_FOOTER_PREFIX, 0) == 0)
+		{
+			break;
+		}
+		std::stringstream fields(line);
+		std::string offset, length, target, path;
+		if (!std::getline(fields, offset, '\t') || !std::getline(fields, length, '\t') ||
+			!std::getline(fields, target, '\t') || !std::getline(fields, path))
+		{
+			continue; // Malformed line
+		}
+		try
+		{
+			entries.push_back({std::stoull(offset), std::stoull(length),
+							   unescape_index_field(target), unescape_index_field(path)});
+		}
+		catch (const std::exception &e)
+		{
+			continue;
+		}
+	}
+	return entries;
+}
+
+/**
+ * @brief Loads the index of a dump, from its trailer or else from a "<dump>.idx" sidecar.
+ */
+std::vector<IndexEntry> load_dump_index(std::ifstream &dump, const fs::path &dump_path)
+{
+	dump.seekg(0, std::ios::end);
+	std::streamoff size = dump.tellg();
+	if (size >= static_cast<std::streamoff>(INDEX_FOOTER_LENGTH))
+	{
+		std::string footer(INDEX_FOOTER_LENGTH, '\0');
+		dump.seekg(size - static_cast<std::streamoff>(INDEX_FOOTER_LENGTH));
+		dump.read(&footer[0], static_cast<std::streamsize>(footer.size()));
+		if (dump && footer.rfind(INDEX_FOOTER_PREFIX, 0) == 0)
+		{
+			// A damaged footer or trailer falls back to the sidecar
+			const char *digits = footer.data() + INDEX_FOOTER_PREFIX.length();
+			std::uint64_t index_offset = 0;
+			auto parsed = std::from_chars(digits, digits + INDEX_FOOTER_DIGITS, index_offset);
+			if (parsed.ec == std::errc() && parsed.ptr == digits + INDEX_FOOTER_DIGITS)
+			{
+				dump.seekg(static_cast<std::streamoff>(index_offset));
+				std::vector<IndexEntry> entries = read_index_entries(dump);
+				if (!entries.empty())
+				{
+					return entries;
+				}
+			}
+		}
+	}
+	dump.clear();
+
+	std::ifstream sidecar(dump_path.string() + ".idx");
+	if (sidecar.is_open())
+	{
+		return read_index_entries(sidecar);
+	}
+	return {};
+}
+
+/**
+ * @brief Implements `catlr --extract <dump> <path>`: seeks straight to one file's content.
+ * @param file_path Either "path/in/target" or "target/path/in/target".
+ * @return Process exit code.
+ */
+int extract_from_dump(const fs::path &dump_path, const std::string &file_path)
+{
+	std::ifstream dump(dump_path, std::ios::binary);
+	if (!dump.is_open())
+	{
+		std::cerr << "Error: Could not open dump '" << dump_path.string() << "'." << std::endl;
+		return 1;
+	}
+	std::vector<IndexEntry> entries = load_dump_index(dump, dump_path);
+	if (entries.empty())
+	{
+		std::cerr << "Error: '" << dump_path.string() << "' has no index (write it with --index or --index-file)." << std::endl;
+		return 1;
+	}
+
+	std::string wanted = file_path;
+	std::replace(wanted.begin(), wanted.end(), '\\', '/');
+	auto found = std::find_if(entries.begin(), entries.end(),
+							  [&](const IndexEntry &entry)
+							  {
+								  return entry.path == wanted || entry.target + "/" + entry.path == wanted;
+							  });
+	if (found == entries.end())
+	{
+		std::cerr << "Error: '" << file_path << "' is not in the index of '" << dump_path.string() << "'." << std::endl;
+		return 1;
+	}
+
+	dump.clear();
+	dump.seekg(static_cast<std::streamoff>(found->offset));
+	std::uint64_t remaining = found->length;
+	char chunk[64 * 1024];
+	while (remaining > 0 && dump)
+	{
+		std::streamsize want = static_cast<std::streamsize>(std::min<std::uint64_t>(remaining, sizeof(chunk)));
+		dump.read(chunk, want);
+		std::cout.write(chunk, dump.gcount());
+		remaining -= static_cast<std::uint64_t>(dump.gcount());
+	}
+	std::cout.flush();
+	return remaining == 0 ? 0 : 1;
+}
+
+// --- Change Detection ---
+
+/**
+ * @brief SHA-1, used only to compute git blob ids of modified files (`blob <size>\0<data>`).
+ */
+class Sha1
+{
+public:
+	Sha1() : state_{0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u} {}
+
+	void update(const char *data, size_t length)
+	{
+		total_length_ += length;
+		while (length > 0)
+		{
+			size_t take = std::min(length, sizeof(buffer_) - buffered_);
+			std::memcpy(buffer_ + buffered_, data, take);
+			buffered_ += take;
+			data += take;
+			length -= take;
+			if (buffered_ == sizeof(buffer_))
+			{
+				transform(buffer_);
+				buffered_ = 0;
+			}
+		}
+	}
+
+	/**
+	 * @brief Finishes the hash and returns the raw 20-byte digest.
+	 */
+	std::string digest()
+	{
+		std::uint64_t bit_length = total_length_ * 8;
+		char padding[64] = {static_cast<char>(0x80)};
+		update(padding, buffered_ < 56 ? 56 - buffered_ : 120 - buffered_);
+		char length_bytes[8];
+		for (int i = 0; i < 8; ++i)
+		{
+			length_bytes[i] = static_cast<char>(bit_length >> (56 - 8 * i));
+		}
+		update(length_bytes, 8);
+		std::string raw;
+		for (std::uint32_t word : state_)
+		{
+			for (int shift = 24; shift >= 0; shift -= 8)
+			{
+				raw += static_cast<char>(word >> shift);
+			}
+		}
+		return raw;
+	}
+
+private:
+	static std::uint32_t rotl(std::uint32_t x, int r) { return (x << r) | (x >> (32 - r)); }
+
+	void transform(const unsigned char *block)
+	{
+		std::uint32_t w[80];
+		for (int i = 0; i < 16; ++i)
+		{
+			w[i] = read_be32(block + 4 * i);
+		}
+		for (int i = 16; i < 80; ++i)
+		{
+			w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+		std::uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3], e = state_[4];
+		for (int i = 0; i < 80; ++i)
+		{
+			std::uint32_t f, k;
+			if (i < 20)
+				f = (b & c) | (~b & d), k = 0x5A827999u;
+			else if (i < 40)
+				f = b ^ c ^ d, k = 0x6ED9EBA1u;
+			else if (i < 60)
+				f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDCu;
+			else
+				f = b ^ c ^ d, k = 0xCA62C1D6u;
+			std::uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rotl(b, 30);
+			b = a;
+			a = temp;
+		}
+		state_[0] += a;
+		state_[1] += b;
+		state_[2] += c;
+		state_[3] += d;
+		state_[4] += e;
+	}
+
+	std::uint32_t state_[5];
+	unsigned char buffer_[64];
+	size_t buffered_ = 0;
+	std::uint64_t total_length_ = 0;
+};
+
+/**
+ * @brief Computes the git blob id of a file on disk.
+ */
+bool git_blob_oid(const fs::path &path, std::uint64_t size, std::string &oid)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	tally(run_stats.files_opened);
+	Sha1 hasher;
+	std::string header = "blob " + std::to_string(size);
+	hasher.update(header.c_str(), header.length() + 1); // Including the NUL
+	char chunk[64 * 1024];
+	while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0)
+	{
+		hasher.update(chunk, static_cast<size_t>(file.gcount()));
+		tally(run_stats.bytes_read, static_cast<std::uint64_t>(file.gcount()));
+	}
+	oid = hasher.digest();
+	return true;
+}
+
+/**
+ * @brief What catlr remembers about one file in a manifest (--write-manifest).
+ */
+struct ManifestEntry
+{
+	std::uint64_t size;
+	std::int64_t mtime_sec;
+	std::int64_t mtime_nsec;
+	std::uint64_t ino;
+	std::uint64_t hash; // XXH64 of the content
+};
+
+/**
+ * @brief A catlr manifest: stat data and content hash of every printable file of a run,
+ * keyed by (target name, relative path). Stored as text:
+ *   catlr-manifest 1 <run start, unix seconds>
+ *   <target>\t<path>\t<size>\t<mtime sec>\t<mtime nsec>\t<inode>\t<xxh64 hex>
+ */
+class Manifest
+{
+public:
+	std::int64_t started_at = 0; // Files modified at or after this second are "racy"
+
+	bool load(const fs::path &path, std::string &error)
+	{
+		std::ifstream file(path);
+		std::string line;
+		if (!file.is_open() || !std::getline(file, line))
+		{
+			error = "could not read manifest " + path.string();
+			return false;
+		}
+		std::stringstream header(line);
+		std::string magic;
+		int version = 0;
+		header >> magic >> version >> started_at;
+		if (magic != "catlr-manifest" || version != 1)
+		{
+			error = path.string() + " is not a catlr manifest";
+			return false;
+		}
+		while (std::getline(file, line))
+		{
+			std::stringstream fields(line);
+			std::string target, rel_path, hash;
+			ManifestEntry entry;
+			if (!std::getline(fields, target, '\t') || !std::getline(fields, rel_path, '\t') ||
+				!(fields >> entry.size >> entry.mtime_sec >> entry.mtime_nsec >> entry.ino >> hash))
+			{
+				continue; // Malformed line
+			}
+			auto parsed = std::from_chars(hash.data(), hash.data() + hash.size(), entry.hash, 16);
+			if (parsed.ec != std::errc() || parsed.ptr != hash.data() + hash.size())
+			{
+				continue; // Malformed hash
+			}
+			entries_[{unescape_index_field(target), unescape_index_field(rel_path)}] = entry;
+		}
+		return true;
+	}
+
+	bool save(const fs::path &path) const
+	{
+		std::ofstream file(path);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		file << "catlr-manifest 1 " << started_at << "\n";
+		for (const auto &item : entries_)
+		{
+			const ManifestEntry &entry = item.second;
+			file << escape_index_field(item.first.first) << '\t' << escape_index_field(item.first.second) << '\t'
+				 << entry.size << '\t' << entry.mtime_sec << '\t' << entry.mtime_nsec << '\t' << entry.ino << '\t'
+				 << std::hex << entry.hash << std::dec << "\n";
+		}
+		return static_cast<bool>(file);
+	}
+
+	const ManifestEntry *find(const std::string &target, const std::string &rel_path) const
+	{
+		auto found = entries_.find({target, rel_path});
+		return found == entries_.end() ? nullptr : &found->second;
+	}
+
+	void set(const std::string &target, const std::string &rel_path, const ManifestEntry &entry)
+	{
+		entries_[{target, rel_path}] = entry;
+	}
+
+private:
+	std::map<std::pair<std::string, std::string>, ManifestEntry> entries_;
+};
+
+/**
+ * @brief Decides whether a file changed since a baseline: a saved manifest, or a git revision
+ * (with .git/index as the stat cache). As in git's racy-clean logic, content is only hashed
+ * when the cached stat data differs or is too recent to be trusted.
+ */
+class ChangeFilter
+{
+public:
+	bool use_manifest(const fs::path &path, std::string &error)
+	{
+		return manifest_.load(path, error) && (from_manifest_ = true);
+	}
+
+	bool from_manifest() const { return from_manifest_; }
+
+#ifdef CATLR_USE_ZLIB
+	/**
+	 * @brief Prepares the git baseline of the repository containing `target_path`.
+	 */
+	bool use_revision(const fs::path &target_path, const std::string &revision, std::string &error)
+	{
+		fs::path work_tree;
+		fs::path git_dir = find_git_dir(target_path, work_tree);
+		if (git_dir.empty())
+		{
+			error = "not inside a git repository";
+			return false;
+		}
+		if (work_tree == work_tree_)
+		{
+			return true; // Same repository as the previous target
+		}
+		work_tree_.clear();
+		index_.clear();
+		by_path_.clear();
+		revision_blobs_.clear();
+
+		// Stat cache: the index, trusted for entries older than the index file itself
+		struct stat index_stat;
+		if (read_git_index(git_dir / "index", index_, error) && stat((git_dir / "index").c_str(), &index_stat) == 0)
+		{
+			index_mtime_sec_ = index_stat.st_mtime;
+			index_mtime_nsec_ = stat_mtime_nsec(index_stat);
+			for (const auto &entry : index_)
+			{
+				if (entry.stage == 0)
+					by_path_[entry.path] = &entry;
+			}
+		}
+		error.clear();
+
+		GitObjectStore store(git_common_dir(git_dir) / "objects");
+		std::string commit_oid, tree_oid;
+		GitObject commit;
+		if (!resolve_revision(git_dir, store, revision, commit_oid, error))
+		{
+			return false;
+		}
+		if (!store.read(commit_oid, commit) || !read_object_header(*commit.data, "tree", tree_oid))
+		{
+			error = "could not read commit " + to_hex(commit_oid);
+			return false;
+		}
+		PathTreeNode unused;
+		if (!collect_revision_tree(store, tree_oid, "", Filters(), unused, revision_blobs_, error))
+		{
+			return false;
+		}
+		work_tree_ = work_tree;
+		git_dir_prefix_ = fs::relative(git_dir, work_tree).generic_string() + "/";
+		return true;
+	}
+#endif
+
+	/**
+	 * @brief True if the file is new or its content differs from the baseline.
+	 * @param hash Receives the file's XXH64 when it is known without extra work (manifest mode).
+	 */
+	bool changed(const fs::path &path, const struct stat &file_stat, const std::string &target, const std::string &rel_path,
+				 bool &hash_known, std::uint64_t &hash)
+	{
+		hash_known = false;
+		if (from_manifest_)
+		{
+			const ManifestEntry *entry = manifest_.find(target, rel_path);
+			if (entry == nullptr)
+			{
+				return true; // Added
+			}
+			bool stat_clean = entry->size == static_cast<std::uint64_t>(file_stat.st_size) &&
+							  entry->mtime_sec == file_stat.st_mtime && entry->mtime_nsec == stat_mtime_nsec(file_stat) &&
+							  entry->ino == static_cast<std::uint64_t>(file_stat.st_ino) &&
+							  entry->mtime_sec < manifest_.started_at; // Not racy
+			if (stat_clean)
+			{
+				hash_known = true;
+				hash = entry->hash;
+				return false;
+			}
+			hash_known = hash_file(path, hash);
+			return !hash_known || hash != entry->hash;
+		}
+
+		std::string wt_path = fs::relative(path, work_tree_).generic_string();
+		if (wt_path.rfind(git_dir_prefix_, 0) == 0)
+		{
+			return false; // The repository's own metadata
+		}
+		auto in_revision = revision_blobs_.find(wt_path);
+		if (in_revision == revision_blobs_.end())
+		{
+			return true; // Added (untracked, or new since the revision)
+		}
+		std::string current_oid;
+		auto cached = by_path_.find(wt_path);
+		if (cached != by_path_.end() && index_stat_clean(*cached->second, file_stat))
+		{
+			current_oid = cached->second->oid;
+		}
+		else if (!git_blob_oid(path, static_cast<std::uint64_t>(file_stat.st_size), current_oid))
+		{
+			return true;
+		}
+		return current_oid != in_revision->second;
+	}
+
+private:
+	/**
+	 * @brief Whether the index's cached stat data proves the file still has the staged content.
+	 * Entries modified in the same instant as (or after) the index was written are racy.
+	 */
+	bool index_stat_clean(const GitIndexEntry &entry, const struct stat &file_stat) const
+	{
+		if (entry.size != static_cast<std::uint32_t>(file_stat.st_size) ||
+			entry.mtime_sec != static_cast<std::uint32_t>(file_stat.st_mtime) ||
+			entry.mtime_nsec != static_cast<std::uint32_t>(stat_mtime_nsec(file_stat)) ||
+			entry.ino != static_cast<std::uint32_t>(file_stat.st_ino))
+		{
+			return false;
+		}
+		return entry.mtime_sec < index_mtime_sec_ || (entry.mtime_sec == index_mtime_sec_ && entry.mtime_nsec < index_mtime_nsec_);
+	}
+
+	bool from_manifest_ = false;
+	Manifest manifest_;
+	fs::path work_tree_;
+	std::string git_dir_prefix_; // e.g. ".git/"
+	std::vector<GitIndexEntry> index_;
+	std::map<std::string, const GitIndexEntry *> by_path_;
+	std::int64_t index_mtime_sec_ = 0;
+	std::int64_t index_mtime_nsec_ = 0;
+	std::map<std::string, std::string> revision_blobs_; // Work-tree-relative path -> blob oid
+};
+
+// --- Content Printing ---
+
+/**
+ * @brief Settings for the content phase (step 6b), whichever way the files were found.
+ */
+struct ContentOptions
+{
+	ino_t stdout_inode = 0; // Identity of stdout when it is a regular file (I/O loop check)
+	dev_t stdout_dev = 0;
+	bool use_configured_file_cmd = false;
+	bool use_cat = false;
+	std::string file_command;
+	bool capture_children = false;
+	bool indexing = false;
+	bool dedup = false;
+	bool qualify_paths = false; // Prefix dedup references with the target name (several targets)
+	BinaryMode binary_mode = BinaryMode::Summary;
+	std::uint64_t max_file_bytes = 0;  // 0 = unlimited
+	std::uint64_t max_total_bytes = 0; // 0 = unlimited
+	ChangeFilter *changes = nullptr;   // --changed-since: print only changed files
+	Manifest *manifest_out = nullptr;  // --write-manifest: record every printable file
+};
+
+/**
+ * @brief Prints one file at a time with its "--- path ---" header, applying the I/O loop,
+ * binary, dedup and budget checks, and keeps the state those checks share across targets.
+ */
+class ContentPrinter
+{
+public:
+	ContentPrinter(const ContentOptions &options, OutputBuffer &out_buffer)
+		: options_(options), out_buffer_(out_buffer), out_(&out_buffer) {}
+
+	/**
+	 * @brief Prints a regular file found under a target.
+	 * @param relative_path The path shown in the header, relative to the target.
+	 * @return false once traversal should stop (the total budget is spent).
+	 */
+	bool print_file(const fs::path &current_path, const fs::path &relative_path, const std::string &target_name)
+	{
+		TraceSpan span("file", "print file");
+		span.arg("path", relative_path);
+		std::string index_path = relative_path.string();
+		std::replace(index_path.begin(), index_path.end(), '\\', '/');
+
+		// --- TOTAL BUDGET CHECK (stop walking once it is spent) ---
+		if (total_budget_spent())
+		{
+			return false;
+		}
+
+		struct stat file_stat;
+		tally(run_stats.stat_calls);
+		if (stat(current_path.string().c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+		{
+			return true; // Vanished, or not a regular file
+		}
+		std::uint64_t file_size = static_cast<std::uint64_t>(file_stat.st_size);
+		span.arg("size", file_size);
+
+		// --- IO LOOP CHECK ---
+		if (options_.stdout_inode != 0 && file_stat.st_ino == options_.stdout_inode && file_stat.st_dev == options_.stdout_dev)
+		{
+			std::cerr << "--- " << relative_path.string() << " ---" << std::endl;
+			std::cerr << "[Warning: Skipping file to avoid I/O loop (file is program output)]" << std::endl;
+			out_ << std::endl;
+			return true;
+		}
+
+		// --- CHANGE CHECK (--changed-since) and manifest recording (--write-manifest) ---
+		if (options_.changes != nullptr || options_.manifest_out != nullptr)
+		{
+			bool hash_known = false;
+			std::uint64_t hash = 0;
+			bool changed = options_.changes == nullptr ||
+						   options_.changes->changed(current_path, file_stat, target_name, index_path, hash_known, hash);
+			if (options_.manifest_out != nullptr && (hash_known || hash_file(current_path, hash)))
+			{
+				options_.manifest_out->set(target_name, index_path,
+										   {file_size, static_cast<std::int64_t>(file_stat.st_mtime), stat_mtime_nsec(file_stat),
+											static_cast<std::uint64_t>(file_stat.st_ino), hash});
+			}
+			if (!changed)
+			{
+				return true;
+			}
+		}
+
+		// --- BINARY CHECK (before any printer backend touches the file) ---
+		bool is_binary = options_.binary_mode != BinaryMode::Print && is_binary_file(current_path);
+		if (is_binary && options_.binary_mode == BinaryMode::Skip)
+		{
+			return true;
+		}
+
+		out_ << "--- " << relative_path.string() << " ---" << std::endl;
+		if (is_binary)
+		{
+			out_ << "[binary, " << format_size(file_size) << "]" << std::endl;
+			out_ << std::endl;
+			return true;
+		}
+		std::uint64_t content_offset = out_buffer_.position();
+
+		// --- DEDUP CHECK ---
+		bool content_hashed = false;
+		std::uint64_t content_hash = 0;
+		if (options_.dedup && file_size > 0)
+		{
+			const EmittedFile *original = dedup_index_.find_identical(current_path, file_stat, content_hashed, content_hash);
+			if (original != nullptr)
+			{
+				print_identical(*original, target_name, index_path);
+				return true;
+			}
+		}
+
+		// Per-file and remaining total budget; larger files are excerpted natively
+		std::uint64_t file_limit = content_limit();
+		if (file_size > file_limit)
+		{
+			print_file_excerpt(current_path, file_size, file_limit, out_);
+		}
+		else if (options_.use_configured_file_cmd || options_.use_cat)
+		{
+			std::string cmd;
+			if (options_.use_configured_file_cmd)
+			{
+				cmd = options_.file_command;
+				if (options_.file_command == "bat")
+					cmd += " --paging=never --style=full";
+				cmd += " \"" + current_path.string() + "\"";
+			}
+			else
+			{
+				cmd = "cat \"" + current_path.string() + "\"";
+			}
+			run_command(cmd, options_.capture_children, out_);
+		}
+		else
+		{
+			// Hash while printing, so a later same-size file needs no re-read of this one
+			bool hash_while_printing = options_.dedup && !content_hashed;
+			bool printed = print_file_native(current_path, out_, hash_while_printing ? &content_hash : nullptr);
+			if (hash_while_printing)
+				content_hashed = printed;
+		}
+
+		std::uint64_t content_length = out_buffer_.position() - content_offset;
+		if (options_.indexing)
+		{
+			index_entries_.push_back({content_offset, content_length, target_name, index_path});
+		}
+		if (options_.dedup && file_size > 0)
+		{
+			dedup_index_.record(file_stat, {current_path, display_path(target_name, index_path), file_size,
+											content_hashed, content_hash, content_offset, content_length});
+		}
+
+		out_ << std::endl; // Separator
+		return true;
+	}
+
+	/**
+	 * @brief Prints content that is already in memory, e.g. a git blob read by --rev.
+	 * Goes through the same budget, binary and dedup checks as print_file; the content is
+	 * always written by the built-in printer.
+	 * @param oid Raw blob oid, used for deduplication.
+	 * @return false once traversal should stop (the total budget is spent).
+	 */
+	bool print_blob(const std::string &rel_path, const std::string &target_name, const std::string &oid, const std::string &data)
+	{
+		TraceSpan span("file", "print blob");
+		span.arg("path", rel_path);
+		span.arg("size", static_cast<std::uint64_t>(data.size()));
+		if (total_budget_spent())
+		{
+			return false;
+		}
+		bool is_binary = options_.binary_mode != BinaryMode::Print &&
+						 looks_binary(data.data(), std::min(data.size(), BINARY_SNIFF_BYTES));
+		if (is_binary && options_.binary_mode == BinaryMode::Skip)
+		{
+			return true;
+		}
+
+		out_ << "--- " << rel_path << " ---" << std::endl;
+		if (is_binary)
+		{
+			out_ << "[binary, " << format_size(data.size()) << "]" << std::endl;
+			out_ << std::endl;
+			return true;
+		}
+		std::uint64_t content_offset = out_buffer_.position();
+
+		if (options_.dedup && !data.empty())
+		{
+			const EmittedFile *original = dedup_index_.find_blob(oid);
+			if (original != nullptr)
+			{
+				print_identical(*original, target_name, rel_path);
+				return true;
+			}
+		}
+
+		std::uint64_t file_limit = content_limit();
+		if (data.size() > file_limit)
+		{
+			std::uint64_t tail_length = file_limit / 2;
+			print_excerpt(data.substr(0, file_limit - tail_length), data.substr(data.size() - tail_length), data.size(), out_);
+		}
+		else
+		{
+			out_.write(data.data(), static_cast<std::streamsize>(data.size()));
+		}
+
+		std::uint64_t content_length = out_buffer_.position() - content_offset;
+		if (options_.indexing)
+		{
+			index_entries_.push_back({content_offset, content_length, target_name, rel_path});
+		}
+		if (options_.dedup && !data.empty())
+		{
+			dedup_index_.record_blob(oid, {fs::path(), display_path(target_name, rel_path), data.size(),
+										   false, 0, content_offset, content_length});
+		}
+
+		out_ << std::endl; // Separator
+		return true;
+	}
+
+	/**
+	 * @brief True once --max-total-bytes stopped the content listing.
+	 */
+	bool budget_spent() const
+	{
+		return budget_spent_;
+	}
+
+	const std::vector<IndexEntry> &index_entries() const
+	{
+		return index_entries_;
+	}
+
+private:
+	/**
+	 * @brief Checks --max-total-bytes before the next file; once spent, it stays spent.
+	 */
+	bool total_budget_spent()
+	{
+		if (options_.max_total_bytes != 0 && out_buffer_.position() >= options_.max_total_bytes)
+		{
+			budget_spent_ = true;
+		}
+		return budget_spent_;
+	}
+
+	/**
+	 * @brief How many content bytes the next file may use: the per-file budget, capped by
+	 * what is left of the total budget.
+	 */
+	std::uint64_t content_limit() const
+	{
+		std::uint64_t limit = std::numeric_limits<std::uint64_t>::max();
+		if (options_.max_file_bytes != 0)
+		{
+			limit = options_.max_file_bytes;
+		}
+		if (options_.max_total_bytes != 0)
+		{
+			std::uint64_t position = out_buffer_.position();
+			limit = std::min(limit, options_.max_total_bytes > position ? options_.max_total_bytes - position : 0);
+		}
+		return limit;
+	}
+
+	std::string display_path(const std::string &target_name, const std::string &index_path) const
+	{
+		return options_.qualify_paths ? target_name + "/" + index_path : index_path;
+	}
+
+	/**
+	 * @brief Prints the reference for a duplicate; its index entry points at the original's
+	 * bytes so --extract still works.
+	 */
+	void print_identical(const EmittedFile &original, const std::string &target_name, const std::string &index_path)
+	{
+		out_ << "[identical to " << original.display_path << "]" << std::endl;
+		if (options_.indexing)
+		{
+			index_entries_.push_back({original.content_offset, original.content_length, target_name, index_path});
+		}
+		out_ << std::endl;
+	}
+
+	const ContentOptions &options_;
+	OutputBuffer &out_buffer_;
+	std::ostream out_; // Writes to out_buffer_, which std::cout may not be (see list_target)
+	DedupIndex dedup_index_;
+	std::vector<IndexEntry> index_entries_;
+	bool budget_spent_ = false;
+};
+
+/**
+ * @brief Prints every regular file a Walker from `dir` reaches: directory order, depth-first,
+ * skipping directories the list filters exclude and not following symlinked directories.
+ * @return false once traversal should stop.
+ */
+bool print_directory_files(DirectoryCache &cache, const fs::path &dir, const fs::path &target_path, const Filters &filters,
+						   ContentPrinter &printer)
+{
+	std::string target_name = target_path.filename().string();
+	for (const auto &entry : Walker(target_path, filters, &cache, dir))
+	{
+		if (entry.type == DirEntryType::Regular && !printer.print_file(entry.path, entry.relative, target_name))
+		{
+			return false;
+		}
+	}
+	return !output_closed();
+}
+
+// --- Output Memoization ---
+
+/**
+ * @brief Hashes the parts of a target's tree that the output depends on: the names and types
+ * in every directory the listing can reach, and size, mtime and inode of every regular file.
+ * @param racy Set when an entry was modified too recently (at or after `now`, in whole
+ * seconds) for its mtime to prove it unchanged, in which case the output is not stored.
+ */
+void fingerprint_directory(DirectoryCache &cache, const fs::path &dir, const fs::path &target_path, const Filters &filters,
+						   std::int64_t now, Xxh64 &hasher, bool &racy)
+{
+	const std::vector<CachedDirEntry> *entries = cache.list(dir);
+	if (entries == nullptr)
+	{
+		hasher.update("?", 1); // Unreadable
+		return;
+	}
+	for (const auto &entry : *entries)
+	{
+		fs::path current_path = dir / entry.name;
+		hasher.update(entry.name.data(), entry.name.length() + 1); // Interned names are NUL-terminated
+		hasher.update(reinterpret_cast<const char *>(&entry.type), 1);
+
+		struct stat entry_stat;
+		tally(run_stats.stat_calls);
+		if (stat(current_path.c_str(), &entry_stat) != 0)
+		{
+			continue; // Dangling symlink
+		}
+		if (S_ISDIR(entry_stat.st_mode))
+		{
+			// The tree follows symlinked directories; list-excluded ones are never shown or walked
+			if (matches_filters(current_path, target_path, filters.list_includes, filters.list_excludes))
+			{
+				fingerprint_directory(cache, current_path, target_path, filters, now, hasher, racy);
+			}
+			hasher.update("/", 1);
+		}
+		else if (S_ISREG(entry_stat.st_mode))
+		{
+			std::int64_t stamp[4] = {static_cast<std::int64_t>(entry_stat.st_size), static_cast<std::int64_t>(entry_stat.st_mtime),
+									 stat_mtime_nsec(entry_stat), static_cast<std::int64_t>(entry_stat.st_ino)};
+			hasher.update(reinterpret_cast<const char *>(stamp), sizeof(stamp));
+			racy = racy || entry_stat.st_mtime >= now;
+		}
+	}
+}
+
+/**
+ * @brief Whole-run output cache for --cache-output: one file per fingerprint under
+ * ~/.cache/catlr/output, replayed straight to stdout on a hit. Replaying refreshes the file's
+ * mtime, which is what eviction sorts by (least recently used first) to stay under the limit.
+ */
+class OutputMemo
+{
+public:
+	OutputMemo(const fs::path &dir, std::uint64_t key, std::uint64_t size_limit) : dir_(dir), size_limit_(size_limit)
+	{
+		std::ostringstream name;
+		name << std::hex << std::setw(16) << std::setfill('0') << key;
+		path_ = dir_ / (name.str() + ".out");
+	}
+
+	~OutputMemo() { abandon(); }
+
+	enum class Replay
+	{
+		Miss,	  // Nothing stored: produce the output normally
+		Done,	  // The stored output was written (or the reader went away)
+		Failed, // Writing stopped part-way; errno says why
+	};
+
+	/**
+	 * @brief Copies a stored output to `out_fd` without passing it through user space where the
+	 * kernel allows it (sendfile on Linux), falling back to read/write.
+	 */
+	Replay replay(int out_fd)
+	{
+		int fd = ::open(path_.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return Replay::Miss;
+		}
+		futimens(fd, nullptr); // Mark as recently used
+		bool done = false;
+		bool failed = false;
+#ifdef __linux__
+		// Zero-copy; descriptors sendfile refuses (O_APPEND, non-blocking) fall through to
+		// read/write, which continues from where sendfile left the file offset
+		while (!done && !output_closed())
+		{
+			ssize_t copied = sendfile(out_fd, fd, nullptr, 1 << 30);
+			if (copied < 0 && errno == EINTR)
+				continue;
+			if (copied < 0 && (errno == EINVAL || errno == ENOSYS || errno == EAGAIN))
+				break;
+			failed = copied < 0 && errno != EPIPE;
+			done = copied <= 0;
+		}
+#endif
+		char buffer[64 * 1024];
+		while (!done && !output_closed())
+		{
+			ssize_t copied = read(fd, buffer, sizeof(buffer));
+			if (copied < 0 && errno == EINTR)
+				continue;
+			failed = copied < 0 || (copied > 0 && !write_all(out_fd, buffer, static_cast<size_t>(copied)) && !output_closed());
+			done = copied <= 0 || failed;
+		}
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return failed ? Replay::Failed : Replay::Done;
+	}
+
+	/**
+	 * @brief Starts capturing a fresh output into a temporary file.
+	 * @return The descriptor to tee the output into, or -1.
+	 */
+	int begin_capture()
+	{
+		std::error_code ec;
+		fs::create_directories(dir_, ec);
+		temp_path_ = path_.string() + ".tmp." + std::to_string(getpid());
+		capture_fd_ = ::open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		return capture_fd_;
+	}
+
+	/**
+	 * @brief Publishes the captured output under its fingerprint, then evicts old outputs.
+	 */
+	void commit()
+	{
+		if (capture_fd_ < 0)
+		{
+			return;
+		}
+		bool written = close(capture_fd_) == 0;
+		capture_fd_ = -1;
+		std::error_code ec;
+		if (written)
+		{
+			fs::rename(temp_path_, path_, ec);
+		}
+		if (!written || ec)
+		{
+			fs::remove(temp_path_, ec);
+			return;
+		}
+		evict();
+	}
+
+	/**
+	 * @brief Drops a capture that must not be reused (incomplete, or racy input).
+	 */
+	void abandon()
+	{
+		if (capture_fd_ >= 0)
+		{
+			close(capture_fd_);
+			capture_fd_ = -1;
+			std::error_code ec;
+			fs::remove(temp_path_, ec);
+		}
+	}
+
+private:
+	void evict()
+	{
+		struct Stored
+		{
+			fs::path path;
+			std::uint64_t size;
+			std::int64_t mtime_sec;
+			std::int64_t mtime_nsec;
+		};
+		std::vector<Stored> stored;
+		std::uint64_t total = 0;
+		std::error_code ec;
+		for (const auto &entry : fs::directory_iterator(dir_, ec))
+		{
+			struct stat file_stat;
+			if (entry.path().extension() == ".out" && stat(entry.path().c_str(), &file_stat) == 0)
+			{
+				stored.push_back({entry.path(), static_cast<std::uint64_t>(file_stat.st_size), file_stat.st_mtime,
+								  stat_mtime_nsec(file_stat)});
+				total += static_cast<std::uint64_t>(file_stat.st_size);
+			}
+		}
+		std::sort(stored.begin(), stored.end(), [](const Stored &a, const Stored &b)
+				  { return std::tie(a.mtime_sec, a.mtime_nsec) < std::tie(b.mtime_sec, b.mtime_nsec); });
+		for (const auto &item : stored)
+		{
+			if (total <= size_limit_)
+			{
+				break;
+			}
+			if (fs::remove(item.path, ec))
+			{
+				total -= item.size;
+			}
+		}
+	}
+
+	fs::path dir_;
+	fs::path path_;
+	fs::path temp_path_;
+	std::uint64_t size_limit_;
+	int capture_fd_ = -1;
+};
+
+// --- Watch Mode ---
+
+/**
+ * @brief A target as --watch keeps following it after the first pass.
+ */
+struct WatchTarget
+{
+	fs::path path;
+	Filters filters;
+};
+
+/**
+ * @brief Collects `dir` and every real (non-symlinked) subdirectory the list filters allow:
+ * the directories whose changes can alter a target's output.
+ */
+void collect_watch_dirs(const fs::path &dir, const WatchTarget &target, DirectoryCache &cache, std::vector<fs::path> &dirs)
+{
+	const std::vector<CachedDirEntry> *entries = cache.list(dir);
+	if (entries == nullptr)
+	{
+		return;
+	}
+	dirs.push_back(dir);
+	for (const auto &entry : *entries)
+	{
+		fs::path child = dir / entry.name;
+		if (entry.type == DirEntryType::Directory &&
+			matches_filters(child, target.path, target.filters.list_includes, target.filters.list_excludes))
+		{
+			collect_watch_dirs(child, target, cache, dirs);
+		}
+	}
+}
+
+#ifdef __linux__
+
+/**
+ * @brief What one debounced batch of inotify events amounts to.
+ */
+struct WatchBatch
+{
+	std::set<size_t> restructured;			// Targets whose set of entries changed
+	std::set<std::pair<size_t, fs::path>> written; // Files created or written
+	std::set<std::pair<size_t, fs::path>> removed; // Files deleted or moved away
+	std::set<std::pair<size_t, fs::path>> created; // Files that appeared during the batch
+	std::vector<std::pair<size_t, fs::path>> new_dirs;
+	bool overflow = false; // The kernel dropped events: everything must be re-read
+};
+
+/**
+ * @brief The inotify events that can change a listing: entries added, removed or written.
+ */
+const std::uint32_t INOTIFY_WATCH_EVENTS = IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+										   IN_DELETE_SELF | IN_ONLYDIR;
+
+/**
+ * @brief inotify watches on the directories of each target that survive the list filters,
+ * the same set the file walk descends into, so pruned trees (node_modules, build output)
+ * never count against fs.inotify.max_user_watches.
+ */
+class TreeWatcher
+{
+public:
+	static constexpr int DEBOUNCE_MS = 200;	 // Quiet time that ends a batch
+	static constexpr int MAX_BATCH_MS = 2000; // Upper bound on latency under a constant stream
+
+	TreeWatcher() : fd_(inotify_init1(IN_CLOEXEC)) {}
+	~TreeWatcher()
+	{
+		if (fd_ >= 0)
+			close(fd_);
+	}
+
+	bool ok() const { return fd_ >= 0; }
+
+	/**
+	 * @brief Watches `dir` and the subdirectories collect_watch_dirs selects under it.
+	 */
+	void watch_tree(size_t target, const fs::path &dir, const WatchTarget &watch_target, DirectoryCache &cache)
+	{
+		std::vector<fs::path> dirs;
+		collect_watch_dirs(dir, watch_target, cache, dirs);
+		for (const auto &watch_dir : dirs)
+		{
+			int wd = inotify_add_watch(fd_, watch_dir.c_str(), INOTIFY_WATCH_EVENTS);
+			if (wd < 0)
+			{
+				if (errno == ENOSPC && !limit_warned_)
+				{
+					std::cerr << "Warning: inotify watch limit reached (fs.inotify.max_user_watches); some directories are not watched." << std::endl;
+					limit_warned_ = true;
+				}
+				continue;
+			}
+			WatchedDir &watched = dirs_[wd];
+			watched.target = target;
+			watched.path = watch_dir;
+			watched.names.clear();
+			for (const auto &entry : *cache.list(watch_dir))
+			{
+				watched.names.emplace_back(entry.name);
+			}
+			std::sort(watched.names.begin(), watched.names.end());
+		}
+	}
+
+	/**
+	 * @brief Blocks until something changes, then collects events until DEBOUNCE_MS pass
+	 * without one, so an editor's save or a `git checkout` arrives as one batch.
+	 * @return false if the inotify descriptor failed.
+	 */
+	bool next_batch(WatchBatch &batch)
+	{
+		std::set<int> touched_dirs;
+		int timeout = -1;
+		auto first_event = std::chrono::steady_clock::now();
+		for (;;)
+		{
+			struct pollfd poll_fd = {fd_, POLLIN, 0};
+			int ready = poll(&poll_fd, 1, timeout);
+			if (ready < 0 && errno == EINTR)
+				continue;
+			if (ready < 0)
+				return false;
+			if (ready == 0)
+				break; // Quiet long enough
+			if (!read_events(batch, touched_dirs))
+				return false;
+			if (timeout < 0)
+				first_event = std::chrono::steady_clock::now();
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - first_event).count();
+			if (elapsed >= MAX_BATCH_MS)
+				break;
+			timeout = DEBOUNCE_MS;
+		}
+
+		// A directory is restructured only if its names differ now; an editor's write-to-temp
+		// and rename-over leaves them as they were.
+		for (int wd : touched_dirs)
+		{
+			auto watched = dirs_.find(wd);
+			if (watched == dirs_.end())
+			{
+				continue;
+			}
+			std::vector<std::string> names;
+			DIR *handle = opendir(watched->second.path.c_str());
+			while (handle != nullptr)
+			{
+				struct dirent *item = readdir(handle);
+				if (item == nullptr)
+					break;
+				std::string name = item->d_name;
+				if (name != "." && name != "..")
+					names.push_back(name);
+			}
+			if (handle != nullptr)
+				closedir(handle);
+			std::sort(names.begin(), names.end());
+			if (names != watched->second.names)
+			{
+				batch.restructured.insert(watched->second.target);
+				watched->second.names = std::move(names);
+			}
+		}
+		return true;
+	}
+
+private:
+	struct WatchedDir
+	{
+		size_t target;
+		fs::path path;
+		std::vector<std::string> names; // Sorted, to detect structural changes
+	};
+
+	bool read_events(WatchBatch &batch, std::set<int> &touched_dirs)
+	{
+		alignas(struct inotify_event) char buffer[64 * 1024];
+		ssize_t length = read(fd_, buffer, sizeof(buffer));
+		if (length < 0)
+		{
+			return errno == EINTR || errno == EAGAIN;
+		}
+		for (ssize_t offset = 0; offset < length;)
+		{
+			const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+			offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				batch.overflow = true;
+				continue;
+			}
+			auto watched = dirs_.find(event->wd);
+			if (watched == dirs_.end())
+			{
+				continue;
+			}
+			if (event->mask & IN_IGNORED)
+			{
+				dirs_.erase(watched); // Directory gone; the kernel dropped the watch
+				continue;
+			}
+			if (event->len == 0)
+			{
+				continue; // Event on the directory itself
+			}
+			fs::path path = watched->second.path / event->name;
+			std::pair<size_t, fs::path> item(watched->second.target, path);
+			bool is_dir = event->mask & IN_ISDIR;
+			if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+			{
+				touched_dirs.insert(event->wd);
+			}
+			if (is_dir)
+			{
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					batch.new_dirs.push_back(item);
+			}
+			else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+			{
+				batch.written.erase(item);
+				if (batch.created.erase(item) == 0) // Files that came and went (editor temp files) are not news
+					batch.removed.insert(item);
+			}
+			else
+			{
+				if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && batch.removed.erase(item) == 0)
+					batch.created.insert(item);
+				batch.written.insert(item);
+			}
+		}
+		return true;
+	}
+
+	int fd_;
+	std::unordered_map<int, WatchedDir> dirs_;
+	bool limit_warned_ = false;
+};
+
+/**
+ * @brief --watch: after the first pass, re-emits what changed. Each batch prints the tree of
+ * restructured targets, the new contents of written files and a "[deleted]" note for removed
+ * ones, then ends with "--- End of Update ---" and a flush, so consumers can frame updates.
+ * Runs until interrupted or the reader goes away.
+ * @param print_tree Draws a target's tree the way the first pass did.
+ */
+void run_watch(const std::vector<WatchTarget> &targets, ContentPrinter &printer,
+			   const std::function<void(const WatchTarget &, DirectoryCache &)> &print_tree)
+{
+	TreeWatcher watcher;
+	if (!watcher.ok())
+	{
+		std::cerr << "Error: --watch: could not initialise inotify: " << std::strerror(errno) << std::endl;
+		return;
+	}
+	for (size_t i = 0; i < targets.size(); ++i)
+	{
+		DirectoryCache cache(targets[i].path, fs::path());
+		watcher.watch_tree(i, targets[i].path, targets[i], cache);
+	}
+	std::cerr << "Info: Watching for changes (Ctrl-C to stop)." << std::endl;
+
+	// Writing to a stdout file inside a target must not count as a change, or every update
+	// would trigger the next one.
+	struct stat stdout_stat;
+	bool stdout_is_file = fstat(STDOUT_FILENO, &stdout_stat) == 0 && S_ISREG(stdout_stat.st_mode);
+	auto is_stdout = [&](const fs::path &path)
+	{
+		struct stat file_stat;
+		return stdout_is_file && stat(path.c_str(), &file_stat) == 0 && file_stat.st_ino == stdout_stat.st_ino &&
+			   file_stat.st_dev == stdout_stat.st_dev;
+	};
+
+	WatchBatch batch;
+	while (!output_closed() && watcher.next_batch(batch))
+	{
+		std::map<size_t, std::unique_ptr<DirectoryCache>> caches; // Fresh listings for this batch
+		auto cache_for = [&](size_t target_index) -> DirectoryCache &
+		{
+			auto &cache = caches[target_index];
+			if (!cache)
+				cache = std::make_unique<DirectoryCache>(targets[target_index].path, fs::path());
+			return *cache;
+		};
+		if (batch.overflow)
+		{
+			for (size_t i = 0; i < targets.size(); ++i)
+			{
+				batch.restructured.insert(i);
+				batch.new_dirs.push_back({i, targets[i].path}); // Re-watch and re-print everything
+			}
+			batch.written.clear();
+		}
+		for (const auto &new_dir : batch.new_dirs)
+		{
+			const WatchTarget &target = targets[new_dir.first];
+			std::error_code ec;
+			if (fs::is_directory(fs::symlink_status(new_dir.second, ec)) &&
+				(new_dir.second == target.path || matches_filters(new_dir.second, target.path, target.filters.list_includes, target.filters.list_excludes)))
+			{
+				watcher.watch_tree(new_dir.first, new_dir.second, target, cache_for(new_dir.first));
+			}
+		}
+
+		for (size_t target_index : batch.restructured)
+		{
+			const WatchTarget &target = targets[target_index];
+			std::cout << "--- Directory Tree for: " << target.path.filename().string() << " ---" << std::endl;
+			print_tree(target, cache_for(target_index));
+			std::cout << std::endl;
+		}
+
+		bool emitted = !batch.restructured.empty();
+		std::string current_target;
+		auto begin_target = [&](size_t target_index)
+		{
+			emitted = true;
+			const std::string &name = targets[target_index].path.filename().string();
+			if (name != current_target)
+			{
+				std::cout << "--- File Contents (Changed) for: " << name << " ---" << std::endl;
+				current_target = name;
+			}
+		};
+		bool keep_printing = true;
+		for (const auto &written : batch.written)
+		{
+			const WatchTarget &target = targets[written.first];
+			std::error_code ec;
+			if (keep_printing && !output_closed() && fs::is_regular_file(written.second, ec) && !is_stdout(written.second) &&
+				matches_filters(written.second, target.path, target.filters.print_includes, target.filters.print_excludes))
+			{
+				begin_target(written.first);
+				keep_printing = printer.print_file(written.second, written.second.lexically_relative(target.path),
+												   target.path.filename().string());
+			}
+		}
+		for (const auto &new_dir : batch.new_dirs) // Directories moved in arrive with their files
+		{
+			const WatchTarget &target = targets[new_dir.first];
+			std::error_code ec;
+			if (keep_printing && !output_closed() && fs::is_directory(fs::symlink_status(new_dir.second, ec)) &&
+				(new_dir.second == target.path || matches_filters(new_dir.second, target.path, target.filters.list_includes, target.filters.list_excludes)))
+			{
+				begin_target(new_dir.first);
+				keep_printing = print_directory_files(cache_for(new_dir.first), new_dir.second, target.path, target.filters, printer);
+			}
+		}
+		for (const auto &removed : batch.removed)
+		{
+			const WatchTarget &target = targets[removed.first];
+			if (matches_filters(removed.second, target.path, target.filters.print_includes, target.filters.print_excludes))
+			{
+				begin_target(removed.first);
+				std::cout << "--- " << removed.second.lexically_relative(target.path).string() << " ---" << std::endl;
+				std::cout << "[deleted]" << std::endl
+						  << std::endl;
+			}
+		}
+		if (emitted) // e.g. not for an editor's temp file that came and went
+		{
+			std::cout << "--- End of Update ---" << std::endl;
+			std::cout.flush();
+		}
+		batch = WatchBatch();
+	}
+}
+
+#endif // __linux__
+
+// --- Main Program Logic ---
+
+/**
+ * @brief Displays the new usage information.
+ */
+void show_usage(const char *prog_name)
+{
+	std::cerr << "Usage: " << prog_name << " [directory_path...] [filter_rules...]" << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "Arguments:" << std::endl;
+	std::cerr << "  directory_path...: One or more target directories (defaults to current)." << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "Filtering Options (patterns can use wildcards like '*.cpp' or '*build*'):" << std::endl;
+	std::cerr << "  Note: Automatically respects .gitignore files in target directories." << std::endl;
+	std::cerr << "  Note: File extensions (e.g., .o, .cpp) are automatically treated as (*.o, *.cpp)." << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "  -e,  --exclude <p...>: Exclude from BOTH list and print (e.g., -e build/ .o .a)." << std::endl;
+	std::cerr << "  -i,  --include <p...>: Include in BOTH list and print. Overrides excludes." << std::endl;
+	std::cerr << "  -li, -il, --list-include <p...>: Only LIST paths matching pattern." << std::endl;
+	std::cerr << "  -le, -el, --list-exclude <p...>: Exclude from LIST (tree view) only (e.g., -le .git/)." << std::endl;
+	std::cerr << "  -pi, -ip, --print-include <p...>: Only PRINT files matching pattern (e.g., -pi .cpp .h)." << std::endl;
+	std::cerr << "  -pe, -ep, --print-exclude <p...>: Exclude from PRINT only (e.g., -pe .min.js)." << std::endl;
+	std::cerr << "  --no-gitignore       : Disable automatic .gitignore parsing." << std::endl;
+	std::cerr << "  --git-tracked        : Take the file set from the git index instead of walking directories." << std::endl;
+	std::cerr << "  --files-from <file|->: Take the file set from a NUL- or newline-separated list ('-' reads stdin)." << std::endl;
+	std::cerr << "  --rev <revision>     : Dump a git revision straight from the object database (needs zlib)." << std::endl;
+	std::cerr << "  --changed-since <rev|manifest>: Print only files added or modified since a revision or manifest." << std::endl;
+	std::cerr << "  --write-manifest <file>: Record stat data and hashes of printed files for a later --changed-since." << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "Dump Index Options:" << std::endl;
+	std::cerr << "  --index              : Append an index trailer (path -> byte offset/length) to the output." << std::endl;
+	std::cerr << "  --index-file <file>  : Write the index to a sidecar file instead (name it '<dump>.idx')." << std::endl;
+	std::cerr << "  --extract <dump> <path>: Print one file's content from an indexed dump without scanning it." << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "Output Options:" << std::endl;
+	std::cerr << "  --compress[=gzip|zstd]: Compress the output in parallel blocks (needs a build with zlib/zstd)." << std::endl;
+	std::cerr << "  --dedup              : Print '[identical to <path>]' instead of repeating identical files." << std::endl;
+	std::cerr << "  --cache              : Reuse directory listings from ~/.cache/catlr for unchanged directories." << std::endl;
+	std::cerr << "  --cache-output       : Replay the stored output of an identical earlier run on an unchanged tree." << std::endl;
+	std::cerr << "  --watch              : After the listing, keep printing changed files (and trees) as they change." << std::endl;
+	std::cerr << "  --binary=<mode>      : Binary files: 'summary' (default, '[binary, 3.2 MB]'), 'skip' or 'print'." << std::endl;
+	std::cerr << "  --max-file-bytes <n> : Print at most ~n bytes per file (head and tail excerpts). Accepts K/M/G." << std::endl;
+	std::cerr << "  --max-total-bytes <n>: Stop reading files once the output reaches n bytes. Accepts K/M/G." << std::endl;
+	std::cerr << "  --sort-memory <n>    : Stream directories whose listing needs more than n bytes, sorting them in temp files. Accepts K/M/G." << std::endl;
+	std::cerr << "  --sort=<order>       : Tree order: 'bytes' (default), 'natural' (file2 before file10) or 'icase'." << std::endl;
+	std::cerr << "  --unsorted           : List tree entries in directory order instead of by name." << std::endl;
+	std::cerr << "  --max-entries-per-dir <n>: Show the first n entries of each directory in the tree, then '… and N more'." << std::endl;
+	std::cerr << "  --stats[=hw]         : When done, print per-phase timings and counters (=hw: CPU counters) to stderr." << std::endl;
+	std::cerr << "  --trace=<file>       : Record directory reads, filtering, file prints, children and flushes as a Chrome trace." << std::endl;
+	std::cerr << "  -h,  --help            : Show this help message." << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "Server Options:" << std::endl;
+	std::cerr << "  --serve[=socket]     : Run a resident server that answers --connect queries from memory." << std::endl;
+	std::cerr << "  --connect[=socket]   : Send this query to a running server (runs it locally if none answers)." << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "Examples:" << std::endl;
+	std::cerr << "  " << prog_name << "                        # List/print all (respecting .gitignore)" << std::endl;
+	std::cerr << "  " << prog_name << " --no-gitignore          # List/print all (ignoring .gitignore)" << std::endl;
+	std::cerr << "  " << prog_name << " /src/backend -ip .java  # Scan /src/backend, print only .java files" << std::endl;
+	std::cerr << "  " << prog_name << " -e build/ -i build/main.js # Exclude 'build' dir, but still show 'build/main.js'" << std::endl;
+	std::cerr << "  " << prog_name << " -e .o .a '*.neblib'       # Exclude all .o/.a files and *.neblib" << std::endl;
+	std::cerr << "  " << prog_name << " --index > dump.txt && " << prog_name << " --extract dump.txt src/main.cpp" << std::endl;
+}
+
+/**
+ * @brief NEW: Applies syntactic sugar to pattern arguments.
+ * Converts ".cpp" to "*.cpp"
+ * Leaves "build/", "*.cpp", "TODO.md" as-is.
+ */
+std::string process_pattern_arg(std::string pattern_arg)
+{
+	if (pattern_arg.length() > 1 && pattern_arg[0] == '.' &&
+		pattern_arg.find('*') == std::string::npos &&
+		pattern_arg.find('/') == std::string::npos)
+	{
+		return "*" + pattern_arg;
+	}
+	return pattern_arg;
+}
+
+/**
+ * @brief The filters for one target: the command-line filters plus, unless disabled, the
+ * patterns of the target's .gitignore (added to both list and print excludes).
+ */
+Filters target_filters(const Filters &filters, const fs::path &target_path, bool respect_gitignore)
+{
+	Filters path_filters = filters;
+	if (respect_gitignore)
+	{
+		fs::path gitignore_path = target_path / ".gitignore";
+		if (fs::exists(gitignore_path))
+		{
+			std::vector<std::string> gitignore_patterns = parse_gitignore(gitignore_path);
+			for (const auto &pattern : gitignore_patterns)
+			{
+				std::string processed = process_pattern_arg(pattern);
+				path_filters.list_excludes.push_back(processed);
+				path_filters.print_excludes.push_back(processed);
+			}
+		}
+	}
+	return path_filters;
+}
+
+/**
+ * @brief Draws the tree of a target read from disk: with the configured tree command, or with
+ * the built-in tree when that is missing, list filters are active or a built-in tree option
+ * (--sort-memory, --sort, --unsorted, --max-entries-per-dir) is set.
+ */
+void print_walked_tree(const fs::path &target_path, const Filters &path_filters, const std::string &tree_command,
+					   bool use_external_tree, bool capture_children, DirectoryCache &dir_cache, const TreeOptions &tree_options,
+					   std::ostream &out = std::cout)
+{
+	if (use_external_tree)
+	{
+		if (!path_filters.list_includes.empty() || !path_filters.list_excludes.empty())
+		{
+			out << "Info: External 'tree' command does not support filters. Using built-in tree." << std::endl;
+			print_tree_native(target_path, path_filters, dir_cache, tree_options, out);
+		}
+		else if (dir_cache.listing_limit() != 0 || tree_options.order != SortOrder::Bytes || tree_options.unsorted || tree_options.max_entries != 0)
+		{
+			out << "Info: External 'tree' command does not support --sort-memory, --sort, --unsorted or --max-entries-per-dir. Using built-in tree." << std::endl;
+			print_tree_native(target_path, path_filters, dir_cache, tree_options, out);
+		}
+		else
+		{
+			std::string tree_cmd = tree_command + " \"" + target_path.string() + "\"";
+			run_command(tree_cmd, capture_children, out);
+		}
+	}
+	else
+	{
+		out << "Info: '" << tree_command << "' not found. Using built-in tree implementation." << std::endl;
+		print_tree_native(target_path, path_filters, dir_cache, tree_options, out);
+	}
+}
+
+/**
+ * @brief The --cache-output key: everything a run's output depends on (catlr binary, arguments,
+ * config and tools, effective filters and the tree fingerprint of each target). A stdout file
+ * inside a target was just truncated, so it is racy and such runs are never stored.
+ * @param racy Set if some file is too new for its mtime to be trusted.
+ */
+std::uint64_t output_fingerprint(int argc, char *argv[], const std::vector<fs::path> &target_paths, const Filters &filters,
+								 bool respect_gitignore, const std::string &tools, bool use_cache, std::int64_t now, bool &racy)
+{
+	Xxh64 hasher;
+	auto add = [&hasher](const std::string &value)
+	{ hasher.update(value.c_str(), value.length() + 1); };
+	add("catlr-output 1");
+
+	struct stat self_stat;
+	if (stat("/proc/self/exe", &self_stat) == 0 || stat(argv[0], &self_stat) == 0)
+	{
+		add(std::to_string(self_stat.st_size) + ":" + std::to_string(self_stat.st_mtime) + "." +
+			std::to_string(stat_mtime_nsec(self_stat)));
+	}
+	for (int i = 1; i < argc; ++i)
+	{
+		add(argv[i]);
+	}
+	add(tools);
+
+	for (const auto &path_entry : target_paths)
+	{
+		std::error_code ec;
+		fs::path target_path = fs::canonical(path_entry, ec);
+		add(ec ? "?" + path_entry.string() : target_path.string());
+		if (ec)
+		{
+			continue;
+		}
+		Filters path_filters = target_filters(filters, target_path, respect_gitignore);
+		for (const auto *patterns : {&path_filters.list_includes, &path_filters.list_excludes,
+									 &path_filters.print_includes, &path_filters.print_excludes})
+		{
+			for (const auto &pattern : *patterns)
+			{
+				add(pattern);
+			}
+			add("|");
+		}
+		DirectoryCache dir_cache(target_path, use_cache ? default_cache_dir() : fs::path());
+		fingerprint_directory(dir_cache, target_path, target_path, path_filters, now, hasher, racy);
+		dir_cache.save();
+	}
+	return hasher.digest();
+}
+
+/**
+ * @brief Writes the --stats report (phases, then counters) to stderr.
+ * @param hardware The --stats=hw counters, or nullptr without =hw.
+ */
+void print_run_stats(const HardwareCounters *hardware)
+{
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(2);
+	report << "--- Stats ---" << '\n';
+	report << std::left << std::setw(14) << "phase" << std::right << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms" << '\n';
+	for (const auto &phase : run_stats.phases)
+	{
+		report << std::left << std::setw(14) << phase.name << std::right << std::setw(12) << phase.wall_ns / 1e6
+			   << std::setw(12) << phase.cpu_ns / 1e6 << '\n';
+	}
+
+	auto value = [](const std::atomic<std::uint64_t> &counter)
+	{ return counter.load(std::memory_order_relaxed); };
+	report << "directories: " << value(run_stats.dirs_listed) << " read, " << value(run_stats.dirs_replayed) << " from cache" << '\n';
+	report << "entries: " << value(run_stats.entries_visited) << " visited, " << value(run_stats.entries_pruned) << " pruned" << '\n';
+	report << "filters: " << value(run_stats.pattern_evals) << " pattern evaluations, " << value(run_stats.relative_calls)
+		   << " fs::relative calls" << '\n';
+	report << "files: " << value(run_stats.files_opened) << " opened, " << format_size(value(run_stats.bytes_read)) << " read" << '\n';
+	report << "output: " << format_size(value(run_stats.bytes_written)) << " in " << value(run_stats.write_calls) << " writes" << '\n';
+	report << "syscalls: " << value(run_stats.dirs_listed) << " opendir, " << value(run_stats.stat_calls) << " stat, "
+		   << value(run_stats.files_opened) << " open, " << value(run_stats.write_calls) << " write" << '\n';
+
+	struct rusage children;
+	double children_cpu_ms = 0;
+	if (getrusage(RUSAGE_CHILDREN, &children) == 0)
+	{
+		children_cpu_ms = (children.ru_utime.tv_sec + children.ru_stime.tv_sec) * 1e3 +
+						  (children.ru_utime.tv_usec + children.ru_stime.tv_usec) / 1e3;
+	}
+	report << "children: " << value(run_stats.children_spawned) << " spawned, " << children_cpu_ms << " cpu ms" << '\n';
+	if (value(run_stats.dirs_streamed) != 0)
+	{
+		report << "streamed: " << value(run_stats.dirs_streamed) << " directories over --sort-memory, "
+			   << value(run_stats.runs_spilled) << " sorted runs spilled" << '\n';
+	}
+
+	if (hardware != nullptr && !hardware->available())
+	{
+		report << "hardware counters: unavailable (" << hardware->error() << ")" << '\n';
+	}
+	else if (hardware != nullptr)
+	{
+		report << "hardware counters (main thread, user space):" << '\n';
+		report << std::left << std::setw(14) << "phase" << std::right;
+		for (int i = 0; i < HardwareCounters::COUNT; ++i)
+		{
+			report << std::setw(15) << HardwareCounters::name(i);
+		}
+		report << std::setw(8) << "IPC" << '\n';
+		for (const auto &phase : run_stats.phases)
+		{
+			report << std::left << std::setw(14) << phase.name << std::right;
+			for (int i = 0; i < HardwareCounters::COUNT; ++i)
+			{
+				if (hardware->has(i))
+					report << std::setw(15) << phase.hw[i];
+				else
+					report << std::setw(15) << "n/a";
+			}
+			if (hardware->has(0) && hardware->has(1) && phase.hw[0] != 0)
+				report << std::setw(8) << static_cast<double>(phase.hw[1]) / phase.hw[0];
+			report << '\n';
+		}
+	}
+	std::cerr << report.str() << std::flush;
+}
+
+/**
+ * @brief Times a whole run and prints the --stats report when it goes out of scope, so runs
+ * that end early (a replayed --cache-output hit, a closed pipe) still report.
+ */
+class StatsReport
+{
+public:
+	/**
+	 * @param hardware Also read hardware counters around each phase (--stats=hw).
+	 */
+	explicit StatsReport(bool hardware)
+	{
+		if (hardware)
+		{
+			hardware_ = std::make_unique<HardwareCounters>();
+			if (hardware_->available())
+			{
+				active_hw_counters = hardware_.get();
+			}
+		}
+		total_ = std::make_unique<PhaseTimer>("total");
+	}
+
+	~StatsReport()
+	{
+		total_.reset();
+		print_run_stats(hardware_.get());
+		active_hw_counters = nullptr;
+	}
+
+private:
+	std::unique_ptr<HardwareCounters> hardware_;
+	std::unique_ptr<PhaseTimer> total_;
+};
+
+/**
+ * @brief Everything the command line selects, as parsed by parse_cli.
+ */
+struct CliOptions
+{
+	std::vector<fs::path> target_paths;
+	Filters filters;
+	bool respect_gitignore = true; // (NEW) Default to true
+	bool write_index = false;
+	std::string index_file;
+	Compression compression = Compression::None;
+	bool dedup = false;
+	BinaryMode binary_mode = BinaryMode::Summary;
+	std::uint64_t max_file_bytes = 0;  // 0 = unlimited
+	std::uint64_t max_total_bytes = 0; // 0 = unlimited
+	std::uint64_t sort_memory = 0;	   // 0 = unlimited
+	TreeOptions tree;
+	bool git_tracked = false;
+	std::string files_from; // --files-from: a list file, or "-" for stdin
+	std::string revision;
+	std::string changed_since;
+	std::string manifest_file;
+	bool use_cache = false;
+	bool cache_output = false;
+	bool watch = false;
+	bool stats = false;
+	bool stats_hardware = false;
+	std::string trace_file;
+};
+
+const int CLI_CONTINUE = -1;
+
+/**
+ * @brief Parses the command line into `options`. --help and --extract are handled right here.
+ * @return CLI_CONTINUE to go on with the listing, otherwise the exit status.
+ */
+int parse_cli(int argc, char *argv[], CliOptions &options)
+{
+	int first_flag_idx = argc;
+
+	// Find first flag
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "-h" || arg == "--help")
+		{
+			show_usage(argv[0]);
+			return 0;
+		}
+		if (arg == "--extract")
+		{
+			if (i + 2 >= argc)
+			{
+				std::cerr << "Error: --extract requires <dump> and <path> arguments." << std::endl;
+				return 1;
+			}
+			return extract_from_dump(argv[i + 1], argv[i + 2]);
+		}
+		if (arg == "--no-gitignore")
+		{
+			options.respect_gitignore = false;
+			// Don't set first_flag_idx, as this is a flag
+		}
+		if (arg[0] == '-' && arg.length() > 1)
+		{ // Found a flag
+			if (first_flag_idx == argc)
+			{ // Only set on the first flag found
+				first_flag_idx = i;
+			}
+		}
+	}
+
+	// Collect paths (all args before the first flag)
+	for (int i = 1; i < first_flag_idx; ++i)
+	{
+		options.target_paths.push_back(argv[i]);
+	}
+	if (options.target_paths.empty())
+	{
+		options.target_paths.push_back(".");
+	}
+
+	// Parse flags and patterns (from first flag index onwards)
+	for (int i = first_flag_idx; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		// --- Filter Flags (Multi-Pattern) ---
+		if (arg == "-e" || arg == "--exclude")
+		{
+			while (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				i++;
+				std::string pattern = process_pattern_arg(argv[i]);
+				options.filters.list_excludes.push_back(pattern);
+				options.filters.print_excludes.push_back(pattern);
+			}
+		}
+		else if (arg == "-i" || arg == "--include")
+		{
+			while (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				i++;
+				std::string pattern = process_pattern_arg(argv[i]);
+				options.filters.list_includes.push_back(pattern);
+				options.filters.print_includes.push_back(pattern);
+			}
+		}
+		else if (arg == "-li" || arg == "--list-include" || arg == "-il")
+		{
+			while (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				i++;
+				options.filters.list_includes.push_back(process_pattern_arg(argv[i]));
+			}
+		}
+		else if (arg == "-le" || arg == "--list-exclude" || arg == "-el")
+		{
+			while (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				i++;
+				options.filters.list_excludes.push_back(process_pattern_arg(argv[i]));
+			}
+		}
+		else if (arg == "-pi" || arg == "--print-include" || arg == "-ip")
+		{
+			while (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				i++;
+				options.filters.print_includes.push_back(process_pattern_arg(argv[i]));
+			}
+		}
+		else if (arg == "-pe" || arg == "--print-exclude" || arg == "-ep")
+		{
+			while (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				i++;
+				options.filters.print_excludes.push_back(process_pattern_arg(argv[i]));
+			}
+		}
+		else if (arg == "--no-gitignore")
+		{
+			// Already handled, just skip
+			continue;
+		}
+		else if (arg.rfind("--binary=", 0) == 0)
+		{
+			std::string mode = arg.substr(std::string("--binary=").length());
+			if (mode == "summary")
+				options.binary_mode = BinaryMode::Summary;
+			else if (mode == "skip")
+				options.binary_mode = BinaryMode::Skip;
+			else if (mode == "print")
+				options.binary_mode = BinaryMode::Print;
+			else
+				std::cerr << "Warning: Unknown binary mode '" << mode << "' (use summary, skip or print). Ignoring." << std::endl;
+		}
+		else if (arg == "--max-file-bytes" || arg == "--max-total-bytes" || arg == "--sort-memory")
+		{
+			std::uint64_t &budget = (arg == "--max-file-bytes")	   ? options.max_file_bytes
+									: (arg == "--max-total-bytes") ? options.max_total_bytes
+																   : options.sort_memory;
+			if (i + 1 >= argc || !parse_byte_count(argv[i + 1], budget) || budget == 0)
+			{
+				std::cerr << "Error: " << arg << " requires a positive byte count (e.g. 4096, 64K, 10M)." << std::endl;
+				return 1;
+			}
+			i++;
+		}
+		else if (arg.rfind("--sort=", 0) == 0)
+		{
+			std::string order = arg.substr(std::string("--sort=").length());
+			if (order == "bytes")
+				options.tree.order = SortOrder::Bytes;
+			else if (order == "natural")
+				options.tree.order = SortOrder::Natural;
+			else if (order == "icase")
+				options.tree.order = SortOrder::Icase;
+			else
+				std::cerr << "Warning: Unknown sort order '" << order << "' (use bytes, natural or icase). Ignoring." << std::endl;
+		}
+		else if (arg == "--unsorted")
+		{
+			options.tree.unsorted = true;
+		}
+		else if (arg == "--max-entries-per-dir")
+		{
+			char *end = nullptr;
+			options.tree.max_entries = i + 1 < argc ? std::strtoull(argv[i + 1], &end, 10) : 0;
+			if (options.tree.max_entries == 0 || end == nullptr || *end != '\0' || argv[i + 1][0] == '-')
+			{
+				std::cerr << "Error: --max-entries-per-dir requires a positive number of entries (e.g. 50)." << std::endl;
+				return 1;
+			}
+			i++;
+		}
+		else if (arg == "--git-tracked")
+		{
+			options.git_tracked = true;
+		}
+		else if (arg == "--files-from")
+		{
+			if (i + 1 >= argc)
+			{
+				std::cerr << "Error: --files-from requires a list file, or '-' to read the list from stdin." << std::endl;
+				return 1;
+			}
+			options.files_from = argv[++i];
+		}
+		else if (arg == "--rev")
+		{
+			if (i + 1 >= argc)
+			{
+				std::cerr << "Error: --rev requires a revision (e.g. HEAD, main, v1.2, a1b2c3d)." << std::endl;
+				return 1;
+			}
+			options.revision = argv[++i];
+#ifndef CATLR_USE_ZLIB
+			std::cerr << "Error: This catlr was built without zlib support, which --rev needs (see README to enable it)." << std::endl;
+			return 1;
+#endif
+		}
+		else if (arg == "--changed-since" || arg == "--write-manifest")
+		{
+			if (i + 1 >= argc)
+			{
+				std::cerr << "Error: " << arg << (arg == "--changed-since" ? " requires a git revision or a manifest file." : " requires a file name.") << std::endl;
+				return 1;
+			}
+			(arg == "--changed-since" ? options.changed_since : options.manifest_file) = argv[++i];
+		}
+		else if (arg == "--watch")
+		{
+			options.watch = true;
+#ifndef __linux__
+			std::cerr << "Error: --watch needs inotify, which is only available on Linux." << std::endl;
+			return 1;
+#endif
+		}
+		else if (arg == "--cache")
+		{
+			options.use_cache = true;
+		}
+		else if (arg == "--stats" || arg == "--stats=hw")
+		{
+			options.stats = true;
+			options.stats_hardware = arg == "--stats=hw";
+		}
+		else if (arg.rfind("--trace=", 0) == 0)
+		{
+			options.trace_file = arg.substr(std::string("--trace=").length());
+			if (options.trace_file.empty())
+			{
+				std::cerr << "Error: --trace= requires a file name (e.g. --trace=out.json)." << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--cache-output")
+		{
+			options.cache_output = true;
+			options.use_cache = true; // The fingerprint walk replays directory listings too
+		}
+		else if (arg == "--dedup")
+		{
+			options.dedup = true;
+		}
+		else if (arg == "--index")
+		{
+			options.write_index = true;
+		}
+		else if (arg == "--compress" || arg.rfind("--compress=", 0) == 0)
+		{
+			std::string method = (arg == "--compress") ? "gzip" : arg.substr(std::string("--compress=").length());
+			if (method == "gzip")
+				options.compression = Compression::Gzip;
+			else if (method == "zstd")
+				options.compression = Compression::Zstd;
+			else
+			{
+				std::cerr << "Error: Unknown compression method '" << method << "' (use gzip or zstd)." << std::endl;
+				return 1;
+			}
+			if (!compression_available(options.compression))
+			{
+				std::cerr << "Error: This catlr was built without " << method << " support (see README to enable it)." << std::endl;
+				return 1;
+			}
+			if (describe_stdout().terminal)
+			{
+				std::cerr << "Error: Refusing to write compressed data to a terminal." << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--index-file")
+		{
+			if (i + 1 < argc)
+			{
+				options.index_file = argv[++i];
+			}
+			else
+			{
+				std::cerr << "Warning: --index-file requires a file name. Ignoring." << std::endl;
+			}
+		}
+		else if (arg[0] == '.')
+		{
+			// Backwards compatibility for: catlr . .txt .md
+			options.filters.print_includes.push_back(process_pattern_arg(arg));
+		}
+		else if (arg[0] == '-')
+		{
+			std::cerr << "Warning: Unknown flag '" << arg << "'. Ignoring." << std::endl;
+		}
+	}
+
+	if (options.watch && (!options.revision.empty() || options.git_tracked || options.write_index || !options.index_file.empty() || options.compression != Compression::None ||
+				  options.cache_output || !options.manifest_file.empty()))
+	{
+		std::cerr << "Error: --watch cannot be combined with --rev, --git-tracked, --index, --index-file, --compress, --cache-output or --write-manifest." << std::endl;
+		return 1;
+	}
+	if (!options.files_from.empty())
+	{
+		if (options.target_paths.size() > 1)
+		{
+			std::cerr << "Error: --files-from takes a single target directory; the paths in the list are relative to it." << std::endl;
+			return 1;
+		}
+		if (!options.revision.empty() || options.git_tracked || options.watch)
+		{
+			std::cerr << "Error: --files-from cannot be combined with --rev, --git-tracked or --watch." << std::endl;
+			return 1;
+		}
+	}
+	return CLI_CONTINUE;
+}
+
+/**
+ * @brief A target from the command line, resolved with fs::canonical, and its filters.
+ */
+struct ResolvedTarget
+{
+	fs::path path;
+	Filters filters;
+	std::unique_ptr<PathTreeNode> listed_files; // --files-from: the file set, instead of a walk
+};
+
+/**
+ * @brief True if listing `outer` already shows `inner`, a directory below it: the outer target's
+ * list filters, its .gitignore included, admit every directory on the way down.
+ */
+bool target_reaches(const ResolvedTarget &outer, const fs::path &inner)
+{
+	fs::path relative = inner.lexically_relative(outer.path);
+	if (relative.empty() || relative == "." || *relative.begin() == "..")
+	{
+		return false;
+	}
+	fs::path dir = outer.path;
+	for (const auto &part : relative)
+	{
+		dir /= part;
+		if (!matches_filters(dir, outer.path, outer.filters.list_includes, outer.filters.list_excludes))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Resolves the targets and drops the ones another target already lists, so no tree is
+ * listed twice: repeats (the same canonical directory named twice), and directories inside
+ * another target that its filters and .gitignore admit. A directory the outer target leaves
+ * out is kept, with its own .gitignore.
+ */
+std::vector<ResolvedTarget> resolve_targets(const CliOptions &options)
+{
+	std::vector<std::pair<fs::path, fs::path>> resolved; // Argument, canonical path
+	for (const auto &path_entry : options.target_paths)
+	{
+		try
+		{
+			resolved.push_back({path_entry, fs::canonical(path_entry)});
+		}
+		catch (const fs::filesystem_error &e)
+		{
+			std::cerr << "Error: Could not resolve path '" << path_entry.string() << "'. " << e.what() << std::endl;
+		}
+	}
+
+	std::vector<ResolvedTarget> unique;
+	std::vector<fs::path> arguments; // As given, for the warnings
+	for (size_t i = 0; i < resolved.size(); ++i)
+	{
+		const fs::path &path = resolved[i].second;
+		auto repeat = std::find_if(resolved.begin(), resolved.begin() + i, [&](const auto &earlier) { return earlier.second == path; });
+		if (repeat != resolved.begin() + i)
+		{
+			std::cerr << "Warning: Skipping '" << resolved[i].first.string() << "': it is the same directory as '"
+					  << repeat->first.string() << "'." << std::endl;
+			continue;
+		}
+		// Each target gets its own copy of the filters, as .gitignore is per target
+		unique.push_back({path, target_filters(options.filters, path, options.respect_gitignore), nullptr});
+		arguments.push_back(resolved[i].first);
+	}
+
+	std::vector<bool> reached(unique.size(), false);
+	for (size_t i = 0; i < unique.size(); ++i)
+	{
+		size_t outer = 0;
+		while (outer < unique.size() && (outer == i || !target_reaches(unique[outer], unique[i].path)))
+		{
+			++outer;
+		}
+		if (outer < unique.size())
+		{
+			std::cerr << "Warning: Skipping '" << arguments[i].string() << "': it is inside '" << arguments[outer].string()
+					  << "', which lists it already." << std::endl;
+			reached[i] = true;
+		}
+	}
+	std::vector<ResolvedTarget> targets;
+	for (size_t i = 0; i < unique.size(); ++i)
+	{
+		if (!reached[i])
+		{
+			targets.push_back(std::move(unique[i]));
+		}
+	}
+	return targets;
+}
+
+/**
+ * @brief Lists one target to `out`: its tree (step 6a), then its file contents (step 6b).
+ * @param printer Writes to the same buffer as `out`.
+ * @param timed Records the git, tree and contents phases; only the main thread may.
+ * @return false once no further target should be listed (--max-total-bytes is spent).
+ */
+bool list_target(const ResolvedTarget &target, const CliOptions &options, const Config &config, bool use_external_tree,
+				 const ContentOptions &content_options, ContentPrinter &printer, std::ostream &out, bool timed)
+{
+	const fs::path &target_path = target.path;
+	const Filters &path_filters = target.filters;
+	DirectoryCache dir_cache(target_path, options.use_cache ? default_cache_dir() : fs::path());
+	dir_cache.set_listing_limit(options.sort_memory);
+
+	// --- 5b. Git Index / Revision Mode / File List ---
+	// The file set comes from .git/index, from a commit's tree objects or from --files-from,
+	// so neither phase walks the directory.
+	bool use_file_list = target.listed_files != nullptr;
+	bool uses_git = options.git_tracked || !options.revision.empty() || content_options.changes != nullptr;
+	PhaseTimer git_phase(timed && uses_git ? "git" : nullptr);
+	PathTreeNode tracked_tree;
+	bool use_git_index = false;
+	bool use_revision = false;
+	std::string resolved_commit;
+#ifdef CATLR_USE_ZLIB
+	std::unique_ptr<GitObjectStore> object_store;
+	std::map<std::string, std::string> blob_oids;
+	if (!options.revision.empty())
+	{
+		std::string error;
+		use_revision = build_revision_tree(target_path, options.revision, path_filters, object_store, tracked_tree, blob_oids, resolved_commit, error);
+		if (!use_revision)
+		{
+			std::cerr << "Error: --rev: " << error << " for '" << target_path.string() << "'." << std::endl;
+			return true;
+		}
+	}
+#endif
+	if (options.git_tracked && !use_revision)
+	{
+		std::string error;
+		use_git_index = build_git_tracked_tree(target_path, tracked_tree, error);
+		if (!use_git_index)
+		{
+			std::cerr << "Warning: --git-tracked: " << error << " for '" << target_path.string() << "'. Walking the directory instead." << std::endl;
+		}
+	}
+
+#ifdef CATLR_USE_ZLIB
+	if (content_options.changes != nullptr && !content_options.changes->from_manifest())
+	{
+		std::string error;
+		if (!content_options.changes->use_revision(target_path, options.changed_since, error))
+		{
+			std::cerr << "Error: --changed-since: " << error << " for '" << target_path.string() << "'." << std::endl;
+			return true;
+		}
+	}
+#endif
+
+	git_phase.stop();
+
+	// --- 6a. Directory Tree Listing ---
+	PhaseTimer tree_phase(timed ? "tree" : nullptr);
+	out << "--- Directory Tree for: " << target_path.filename().string() << " ---" << std::endl;
+	out << "Located at: " << target_path.string() << std::endl
+		<< std::endl;
+
+	const PathTreeNode &path_tree = use_file_list ? *target.listed_files : tracked_tree;
+	if (use_git_index || use_revision || use_file_list)
+	{
+		if (use_revision)
+			out << "Info: Listing revision " << options.revision << " (" << resolved_commit << ")." << std::endl;
+		else if (use_file_list)
+			out << "Info: Listing the files from " << (options.files_from == "-" ? "stdin" : "'" + options.files_from + "'") << "." << std::endl;
+		else
+			out << "Info: Listing files tracked in the git index." << std::endl;
+		out << target_path.filename().string() << "/" << std::endl;
+		print_path_tree(path_tree, "", "", path_filters, options.tree.order, out);
+	}
+	else
+	{
+		print_walked_tree(target_path, path_filters, config.tree_command, use_external_tree, content_options.capture_children, dir_cache,
+						  options.tree, out);
+	}
+	out << std::endl;
+	tree_phase.stop();
+
+	// --- 6b. Recursive File Content Listing ---
+	PhaseTimer contents_phase(timed ? "contents" : nullptr);
+	out << "--- File Contents (Recursive) for: " << target_path.filename().string() << " ---" << std::endl;
+	if (content_options.changes != nullptr)
+	{
+		out << "Info: Printing only files changed since " << options.changed_since << "." << std::endl;
+	}
+
+	if (use_revision)
+	{
+#ifdef CATLR_USE_ZLIB
+		std::vector<std::string> revision_paths;
+		collect_printable_paths(tracked_tree, "", path_filters, revision_paths);
+		for (const auto &rel_path : revision_paths)
+		{
+			auto blob = blob_oids.find(rel_path);
+			if (blob == blob_oids.end())
+			{
+				continue; // Symlink or submodule: listed, no content
+			}
+			GitObject object;
+			if (!object_store->read(blob->second, object) || object.type != GitObjectType::Blob)
+			{
+				std::cerr << "[Could not read blob " << to_hex(blob->second) << " for " << rel_path << "]" << std::endl;
+				continue;
+			}
+			if (output_closed() || !printer.print_blob(rel_path, target_path.filename().string(), blob->second, *object.data))
+			{
+				break;
+			}
+		}
+#endif
+	}
+	else if (use_git_index || use_file_list)
+	{
+		std::vector<std::string> tracked_paths;
+		collect_printable_paths(path_tree, "", path_filters, tracked_paths);
+		for (const auto &rel_path : tracked_paths)
+		{
+			if (output_closed() || !printer.print_file(target_path / rel_path, fs::path(rel_path), target_path.filename().string()))
+			{
+				break;
+			}
+		}
+	}
+	else
+	{
+		print_directory_files(dir_cache, target_path, target_path, path_filters, printer);
+	}
+
+	if (!dir_cache.save())
+	{
+		std::cerr << "Warning: Could not write the directory cache for '" << target_path.string() << "'." << std::endl;
+	}
+
+	if (printer.budget_spent())
+	{
+		out << "[truncated: --max-total-bytes budget of " << options.max_total_bytes
+			<< " bytes spent; remaining files and targets were not read]" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Lists a target into a new spill file, for list_targets_parallel.
+ * @return The spill file, rewound, or null if it could not be written.
+ */
+FILE *list_target_to_spill(const ResolvedTarget &target, const CliOptions &options, const Config &config, bool use_external_tree,
+						   const ContentOptions &content_options)
+{
+	TraceSpan span("target", "list target");
+	span.arg("path", target.path);
+	FILE *spill = open_temp_file("catlr-target-XXXXXX");
+	if (spill == nullptr)
+	{
+		return nullptr;
+	}
+	bool written;
+	{
+		FdSink sink(fileno(spill));
+		OutputBuffer buffer(sink);
+		std::ostream out(&buffer);
+		ContentPrinter printer(content_options, buffer);
+		list_target(target, options, config, use_external_tree, content_options, printer, out, false);
+		written = static_cast<bool>(out.flush());
+	}
+	if (!written || lseek(fileno(spill), 0, SEEK_SET) != 0)
+	{
+		std::fclose(spill);
+		return nullptr;
+	}
+	return spill;
+}
+
+/**
+ * @brief Lists independent targets concurrently, in argument order. The first target is
+ * listed on this thread straight to std::cout while a pool lists the others into spill
+ * files, each copied out as soon as the targets before it are done. A target whose spill
+ * file could not be written is listed again here.
+ */
+void list_targets_parallel(const std::vector<ResolvedTarget> &targets, const CliOptions &options, const Config &config,
+						   bool use_external_tree, const ContentOptions &content_options, ContentPrinter &printer)
+{
+	// A child inheriting stdout would write ahead of the targets before it
+	ContentOptions spill_options = content_options;
+	spill_options.capture_children = true;
+	std::vector<std::future<FILE *>> spills;
+	{
+		ThreadPool pool(std::min<size_t>(targets.size() - 1, std::max(std::thread::hardware_concurrency(), 1U)));
+		for (size_t i = 1; i < targets.size(); ++i)
+		{
+			spills.push_back(pool.submit([&, i]
+										 { return list_target_to_spill(targets[i], options, config, use_external_tree, spill_options); }));
+		}
+
+		list_target(targets[0], options, config, use_external_tree, content_options, printer, std::cout, false);
+		for (size_t i = 1; i < targets.size(); ++i)
+		{
+			FILE *spill = spills[i - 1].get(); // Waited for even once the output is closed: workers stop early then too
+			if (spill == nullptr && !output_closed())
+			{
+				list_target(targets[i], options, config, use_external_tree, content_options, printer, std::cout, false);
+			}
+			else if (spill != nullptr && !output_closed())
+			{
+				TraceSpan span("output", "copy target");
+				span.arg("path", targets[i].path);
+				char chunk[64 * 1024];
+				ssize_t n;
+				while ((n = read(fileno(spill), chunk, sizeof(chunk))) > 0 || (n < 0 && errno == EINTR))
+				{
+					std::cout.write(chunk, std::max<ssize_t>(n, 0));
+					if (output_closed())
+					{
+						break;
+					}
+				}
+			}
+			if (spill != nullptr)
+			{
+				std::fclose(spill);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Lists and prints the targets as `options` say.
+ * @return The exit status.
+ */
+int run_cli(int argc, char *argv[], CliOptions &options)
+{
+	// Declared first, so it is written last, after every span (including "total") has ended
+	std::unique_ptr<TraceLog> trace_log;
+	if (!options.trace_file.empty())
+	{
+		trace_log = std::make_unique<TraceLog>(options.trace_file);
+		active_trace = trace_log.get();
+	}
+	std::unique_ptr<StatsReport> stats_report;
+	if (options.stats)
+	{
+		stats_report = std::make_unique<StatsReport>(options.stats_hardware);
+	}
+
+	// --- 0. I/O Loop Detection Setup ---
+	StdoutIdentity stdout_identity = describe_stdout();
+
+	std::int64_t run_started_at = static_cast<std::int64_t>(std::time(nullptr));
+
+	// --- 3. Load Config and Validate Tools ---
+	PhaseTimer config_phase("config");
+	Config config = parse_config();
+	bool use_external_tree = command_exists(config.tree_command);
+	bool use_configured_file_cmd = command_exists(config.file_command);
+	bool use_cat = !use_configured_file_cmd && command_exists("cat");
+
+	// --- 3a. Change Detection Baseline ---
+	// A regular file is a manifest written by --write-manifest; anything else is a revision.
+	ChangeFilter change_filter;
+	if (!options.changed_since.empty())
+	{
+		std::error_code ec;
+		if (fs::is_regular_file(options.changed_since, ec))
+		{
+			std::string error;
+			if (!change_filter.use_manifest(options.changed_since, error))
+			{
+				std::cerr << "Error: --changed-since: " << error << "." << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+#ifndef CATLR_USE_ZLIB
+			std::cerr << "Error: '" << options.changed_since << "' is not a manifest, and this catlr was built without zlib support, which comparing against a git revision needs." << std::endl;
+			return 1;
+#endif
+		}
+		if (!options.revision.empty())
+		{
+			std::cerr << "Warning: --changed-since has no effect together with --rev. Ignoring." << std::endl;
+			options.changed_since.clear();
+		}
+	}
+	Manifest manifest;
+	manifest.started_at = run_started_at;
+
+	// --- 3b. File List (--files-from) ---
+	std::string file_list;
+	if (!options.files_from.empty())
+	{
+		std::ifstream list_file;
+		std::istream *list_in = &std::cin;
+		if (options.files_from != "-")
+		{
+			list_file.open(options.files_from, std::ios::binary);
+			list_in = &list_file;
+		}
+		if (list_in == &list_file && !list_file.is_open())
+		{
+			std::cerr << "Error: --files-from: Could not open '" << options.files_from << "'." << std::endl;
+			return 1;
+		}
+		file_list.assign(std::istreambuf_iterator<char>(*list_in), std::istreambuf_iterator<char>());
+	}
+	config_phase.stop();
+
+	// --- 3c. Whole-Run Output Cache ---
+	// Outputs that also depend on git state or write side files are never memoized.
+	std::unique_ptr<OutputMemo> output_memo;
+	bool memo_racy = false;
+	if (options.cache_output)
+	{
+		if (!options.revision.empty() || options.git_tracked || !options.files_from.empty() || !options.changed_since.empty() || !options.manifest_file.empty() ||
+			!options.index_file.empty())
+		{
+			std::cerr << "Warning: --cache-output does not combine with --rev, --git-tracked, --files-from, --changed-since, --write-manifest or --index-file. Ignoring it." << std::endl;
+		}
+		else
+		{
+			std::uint64_t size_limit = 256ULL << 20;
+			if (!config.output_cache_size.empty() && !parse_byte_count(config.output_cache_size, size_limit))
+			{
+				std::cerr << "Warning: Invalid outputCacheSize '" << config.output_cache_size << "' in config. Using 256M." << std::endl;
+			}
+			PhaseTimer memo_phase("output cache");
+			std::ostringstream tools;
+			tools << config.tree_command << '\n' << config.file_command << '\n' << use_external_tree << use_configured_file_cmd
+				  << use_cat << '\n' << stdout_identity.terminal << ' ' << stdout_identity.dev << ' ' << stdout_identity.inode;
+			std::uint64_t key = output_fingerprint(argc, argv, options.target_paths, options.filters, options.respect_gitignore, tools.str(), options.use_cache,
+												   run_started_at, memo_racy);
+			fs::path cache_dir = default_cache_dir();
+			if (!cache_dir.empty())
+			{
+				output_memo = std::make_unique<OutputMemo>(cache_dir / "output", key, size_limit);
+				OutputMemo::Replay replayed = output_memo->replay(STDOUT_FILENO);
+				if (replayed == OutputMemo::Replay::Failed)
+				{
+					std::cerr << "Error: Failed to write the cached output: " << std::strerror(errno) << std::endl;
+					return 1;
+				}
+				if (replayed == OutputMemo::Replay::Done)
+				{
+					return 0;
+				}
+			}
+		}
+	}
+
+	// --- 3d. Output Layer ---
+	// All listing output goes through a counting buffer and, optionally, a compressor. When
+	// either (or the total byte budget, or the output cache) needs to see every byte, external
+	// tools are piped back through it too.
+	ContentOptions content_options;
+	content_options.stdout_inode = stdout_identity.inode;
+	content_options.stdout_dev = stdout_identity.dev;
+	content_options.use_configured_file_cmd = use_configured_file_cmd;
+	content_options.use_cat = use_cat;
+	content_options.file_command = config.file_command;
+	content_options.indexing = options.write_index || !options.index_file.empty();
+	content_options.capture_children = content_options.indexing || options.compression != Compression::None || options.max_total_bytes != 0 ||
+									   (output_memo && !memo_racy);
+	content_options.dedup = options.dedup;
+	content_options.qualify_paths = options.target_paths.size() > 1;
+	content_options.binary_mode = options.binary_mode;
+	content_options.max_file_bytes = options.max_file_bytes;
+	content_options.max_total_bytes = options.max_total_bytes;
+	content_options.changes = options.changed_since.empty() ? nullptr : &change_filter;
+	content_options.manifest_out = options.manifest_file.empty() ? nullptr : &manifest;
+	FdSink stdout_sink(STDOUT_FILENO);
+	std::unique_ptr<TeeSink> memo_sink;
+	std::unique_ptr<CompressingSink> compressing_sink;
+	OutputSink *sink = &stdout_sink;
+	if (output_memo && !memo_racy)
+	{
+		int capture_fd = output_memo->begin_capture();
+		if (capture_fd >= 0)
+		{
+			memo_sink = std::make_unique<TeeSink>(stdout_sink, capture_fd);
+			sink = memo_sink.get();
+		}
+	}
+	if (options.compression != Compression::None)
+	{
+		compressing_sink = std::make_unique<CompressingSink>(*sink, options.compression, std::thread::hardware_concurrency());
+		sink = compressing_sink.get();
+	}
+	OutputBuffer out_buffer(*sink);
+	std::streambuf *original_cout_buffer = std::cout.rdbuf(&out_buffer);
+	ContentPrinter printer(content_options, out_buffer);
+
+	// --- 4. Resolve the targets, then list each one ---
+	std::vector<ResolvedTarget> targets = resolve_targets(options);
+	if (!options.files_from.empty() && !targets.empty())
+	{
+		targets[0].listed_files = std::make_unique<PathTreeNode>();
+		size_t skipped = build_listed_tree(file_list, targets[0].path, *targets[0].listed_files);
+		if (skipped != 0)
+		{
+			std::cerr << "Warning: --files-from: Skipped " << skipped << " path(s) outside '" << targets[0].path.string() << "'." << std::endl;
+		}
+	}
+	std::vector<WatchTarget> watch_targets;
+	if (options.watch)
+	{
+		for (const auto &target : targets)
+		{
+			watch_targets.push_back({target.path, target.filters});
+		}
+	}
+	// Targets share state only through dedup, the index, the byte budget and change detection
+	bool parallel = targets.size() > 1 && std::thread::hardware_concurrency() > 1 && !content_options.dedup && !content_options.indexing && options.max_total_bytes == 0 &&
+					content_options.changes == nullptr && content_options.manifest_out == nullptr;
+	if (parallel)
+	{
+		PhaseTimer targets_phase("targets");
+		list_targets_parallel(targets, options, config, use_external_tree, content_options, printer);
+	}
+	else
+	{
+		for (const auto &target : targets)
+		{
+			if (output_closed() || !list_target(target, options, config, use_external_tree, content_options, printer, std::cout, true))
+			{
+				break;
+			}
+		}
+	}
+
+	if (output_closed())
+	{
+		// The reader is gone (e.g. `catlr | head`): nothing left to say, exit quietly.
+		std::cout.rdbuf(original_cout_buffer);
+		return 0;
+	}
+
+	PhaseTimer finish_phase("finish");
+	std::cout << "--- End of Listing ---" << std::endl;
+
+	// --- 7. Dump Index ---
+	if (options.write_index)
+	{
+		write_index_trailer(out_buffer, printer.index_entries());
+	}
+	if (!options.index_file.empty())
+	{
+		std::ofstream sidecar(options.index_file);
+		if (sidecar.is_open())
+		{
+			write_index_entries(sidecar, printer.index_entries());
+		}
+		else
+		{
+			std::cerr << "Error: Could not write index file '" << options.index_file << "'." << std::endl;
+		}
+	}
+	if (!options.manifest_file.empty() && !manifest.save(options.manifest_file))
+	{
+		std::cerr << "Error: Could not write manifest '" << options.manifest_file << "'." << std::endl;
+	}
+
+#ifdef __linux__
+	// --- 8. Watch Mode ---
+	if (options.watch)
+	{
+		finish_phase.stop();
+		std::cout.flush();
+		content_options.dedup = false; // "[identical to ...]" would point at content that has since changed
+		run_watch(watch_targets, printer, [&](const WatchTarget &target, DirectoryCache &cache)
+				  {
+					  cache.set_listing_limit(options.sort_memory);
+					  print_walked_tree(target.path, target.filters, config.tree_command, use_external_tree, content_options.capture_children, cache, options.tree);
+				  });
+	}
+#endif
+
+	std::cout.flush();
+	std::cout.rdbuf(original_cout_buffer);
+	if (!sink->finish())
+	{
+		std::cerr << "Error: Failed to write compressed output." << std::endl;
+		return 1;
+	}
+	if (memo_sink && memo_sink->copy_ok() && !output_closed())
+	{
+		output_memo->commit();
+	}
+	return 0;
+}
+
+// --- Server Mode ---
+
+/**
+ * @brief Where --serve listens and --connect connects: $XDG_RUNTIME_DIR/catlr.sock, or
+ * catlr.sock in the cache directory.
+ */
+fs::path default_socket_path()
+{
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+	if (runtime_dir != nullptr && runtime_dir[0] != '\0')
+	{
+		return fs::path(runtime_dir) / "catlr.sock";
+	}
+	return default_cache_dir() / "catlr.sock";
+}
+
+/**
+ * @brief Socket path from "--serve=<path>"/"--connect=<path>", or the default.
+ */
+fs::path socket_path_arg(const std::string &arg)
+{
+	size_t equals = arg.find('=');
+	return equals == std::string::npos ? default_socket_path() : fs::path(arg.substr(equals + 1));
+}
+
+// Wire format. Request: u32 count, then `count` strings (the client's working directory, its
+// stdout as "stdout=<terminal>:<dev>:<inode>", then its arguments), each as u32 length + bytes. Response: frames of u8 channel ('o' stdout,
+// 'e' stderr, 'x' exit status) + u32 length + payload, ending with the 'x' frame.
+
+bool send_all(int fd, const char *data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t sent = send(fd, data, length, MSG_NOSIGNAL); // A vanished peer must not raise SIGPIPE
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return false;
+		data += sent;
+		length -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+
+bool read_exact(int fd, char *data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t got = read(fd, data, length);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			return false;
+		data += got;
+		length -= static_cast<size_t>(got);
+	}
+	return true;
+}
+
+bool send_strings(int fd, const std::vector<std::string> &strings)
+{
+	std::string message;
+	std::uint32_t count = static_cast<std::uint32_t>(strings.size());
+	message.append(reinterpret_cast<const char *>(&count), sizeof(count));
+	for (const auto &value : strings)
+	{
+		std::uint32_t length = static_cast<std::uint32_t>(value.length());
+		message.append(reinterpret_cast<const char *>(&length), sizeof(length));
+		message += value;
+	}
+	return send_all(fd, message.data(), message.size());
+}
+
+bool read_strings(int fd, std::vector<std::string> &strings)
+{
+	std::uint32_t count;
+	if (!read_exact(fd, reinterpret_cast<char *>(&count), sizeof(count)) || count > 65536)
+	{
+		return false;
+	}
+	strings.resize(count);
+	for (auto &value : strings)
+	{
+		std::uint32_t length;
+		if (!read_exact(fd, reinterpret_cast<char *>(&length), sizeof(length)) || length > (1U << 24))
+		{
+			return false;
+		}
+		value.resize(length);
+		if (!read_exact(fd, &value[0], length))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool send_frame(int fd, char channel, const char *data, size_t length)
+{
+	char header[5] = {channel};
+	std::uint32_t length32 = static_cast<std::uint32_t>(length);
+	std::memcpy(header + 1, &length32, sizeof(length32));
+	return send_all(fd, header, sizeof(header)) && send_all(fd, data, length);
+}
+
+/**
+ * @brief Connects to a catlr server's socket.
+ * @return The connected descriptor, or -1.
+ */
+int connect_socket(const fs::path &socket_path)
+{
+	struct sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socket_path.string().length() >= sizeof(address.sun_path))
+	{
+		return -1;
+	}
+	std::strcpy(address.sun_path, socket_path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)
+	{
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief --connect: has a catlr server run the query and streams back its output.
+ * @return false if no server answered, in which case the caller runs the query itself.
+ */
+bool run_client(const fs::path &socket_path, const std::vector<std::string> &args, int &status)
+{
+	int fd = connect_socket(socket_path);
+	if (fd < 0)
+	{
+		return false;
+	}
+	std::error_code ec;
+	StdoutIdentity identity = describe_stdout();
+	std::vector<std::string> request = {fs::current_path(ec).string(), "stdout=" + std::to_string(identity.terminal) + ":" +
+																			std::to_string(identity.dev) + ":" + std::to_string(identity.inode)};
+	request.insert(request.end(), args.begin(), args.end());
+	if (!send_strings(fd, request))
+	{
+		close(fd);
+		return false;
+	}
+
+	status = 1;
+	bool finished = false;
+	std::string payload;
+	char header[5];
+	while (!finished && !output_closed() && read_exact(fd, header, sizeof(header)))
+	{
+		std::uint32_t length;
+		std::memcpy(&length, header + 1, sizeof(length));
+		payload.resize(length);
+		if (!read_exact(fd, &payload[0], length))
+		{
+			break;
+		}
+		if (header[0] == 'o')
+		{
+			write_all(STDOUT_FILENO, payload.data(), payload.size());
+		}
+		else if (header[0] == 'e')
+		{
+			write_all(STDERR_FILENO, payload.data(), payload.size());
+		}
+		else if (header[0] == 'x' && length == sizeof(std::int32_t))
+		{
+			std::int32_t exit_status;
+			std::memcpy(&exit_status, payload.data(), sizeof(exit_status));
+			status = exit_status;
+			finished = true;
+		}
+	}
+	close(fd);
+	if (output_closed())
+	{
+		status = 0; // The reader went away, as in a local run
+	}
+	else if (!finished)
+	{
+		std::cerr << "Error: The catlr server closed the connection before the query finished." << std::endl;
+	}
+	return true;
+}
+
+#ifdef __linux__
+
+/**
+ * @brief --serve: answers --connect queries from a resident process. A query runs in a forked
+ * child exactly as it would from the command line; its complete output is kept in memory and
+ * replayed for identical queries (same working directory, stdout and arguments) until inotify reports
+ * a change in one of the directories it depends on: the filtered directory set of each target,
+ * plus the config directory. Queries whose output depends on git state or that write side
+ * files always run afresh.
+ */
+class CatlrServer
+{
+public:
+	explicit CatlrServer(std::uint64_t size_limit) : size_limit_(size_limit), inotify_fd_(inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) {}
+
+	~CatlrServer()
+	{
+		if (inotify_fd_ >= 0)
+			close(inotify_fd_);
+	}
+
+	int run(const fs::path &socket_path)
+	{
+		if (inotify_fd_ < 0)
+		{
+			std::cerr << "Error: --serve: could not initialise inotify: " << std::strerror(errno) << std::endl;
+			return 1;
+		}
+		int existing = connect_socket(socket_path);
+		if (existing >= 0)
+		{
+			close(existing);
+			std::cerr << "Error: A catlr server is already listening on " << socket_path.string() << "." << std::endl;
+			return 1;
+		}
+		std::error_code ec;
+		fs::create_directories(socket_path.parent_path(), ec);
+		fs::remove(socket_path, ec); // Left behind by a server that did not exit cleanly
+
+		struct sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if (socket_path.string().length() >= sizeof(address.sun_path))
+		{
+			std::cerr << "Error: Socket path is too long: " << socket_path.string() << std::endl;
+			return 1;
+		}
+		std::strcpy(address.sun_path, socket_path.c_str());
+		int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		mode_t old_umask = umask(0077); // Only this user may connect
+		bool bound = listen_fd >= 0 && bind(listen_fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0;
+		umask(old_umask);
+		if (!bound || listen(listen_fd, 16) != 0)
+		{
+			std::cerr << "Error: Could not listen on " << socket_path.string() << ": " << std::strerror(errno) << std::endl;
+			return 1;
+		}
+		std::cerr << "Info: Serving on " << socket_path.string() << " (Ctrl-C to stop)." << std::endl;
+
+		for (;;)
+		{
+			struct pollfd poll_fds[2] = {{listen_fd, POLLIN, 0}, {inotify_fd_, POLLIN, 0}};
+			if (poll(poll_fds, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			if (poll_fds[1].revents & POLLIN)
+			{
+				drain_events();
+			}
+			if (poll_fds[0].revents & POLLIN)
+			{
+				int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+				if (client_fd >= 0)
+				{
+					handle(client_fd, listen_fd);
+					close(client_fd);
+				}
+			}
+		}
+		close(listen_fd);
+		return 1;
+	}
+
+private:
+	static const int REQUEST_TIMEOUT_SECONDS = 2;
+
+	struct Entry
+	{
+		std::string out;
+		std::string err;
+		int status;
+		std::vector<int> wds;
+		std::list<std::string>::iterator lru;
+	};
+
+	void handle(int client_fd, int listen_fd)
+	{
+		// Queries are answered one at a time: a client that connects but never sends its
+		// request must not hold up the rest
+		struct timeval timeout = {REQUEST_TIMEOUT_SECONDS, 0};
+		setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		std::vector<std::string> request;
+		if (!read_strings(client_fd, request) || request.size() < 2)
+		{
+			return;
+		}
+		std::string key;
+		for (const auto &part : request)
+		{
+			key += part;
+			key += '\0';
+		}
+
+		drain_events(); // Apply every change reported so far before trusting the cache
+		auto cached = entries_.find(key);
+		if (cached != entries_.end())
+		{
+			Entry &entry = cached->second;
+			lru_.splice(lru_.end(), lru_, entry.lru);
+			std::int32_t status = entry.status;
+			(entry.err.empty() || send_frame(client_fd, 'e', entry.err.data(), entry.err.size())) &&
+				send_frame(client_fd, 'o', entry.out.data(), entry.out.size()) &&
+				send_frame(client_fd, 'x', reinterpret_cast<const char *>(&status), sizeof(status));
+			return;
+		}
+		run_query(client_fd, listen_fd, request, key);
+	}
+
+	/**
+	 * @brief Runs a query in a child process, streaming its output to the client while keeping
+	 * a copy. The child reports the directories the output depends on before it starts
+	 * reading, and waits until they are watched, so no change can slip in unnoticed.
+	 */
+	void run_query(int client_fd, int listen_fd, const std::vector<std::string> &request, const std::string &key)
+	{
+		int out_pipe[2], err_pipe[2], control[2];
+		if (pipe2(out_pipe, O_CLOEXEC) != 0 || pipe2(err_pipe, O_CLOEXEC) != 0 ||
+			socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, control) != 0)
+		{
+			return;
+		}
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			close(listen_fd);
+			close(client_fd);
+			close(inotify_fd_);
+			close(control[0]);
+			dup2(out_pipe[1], STDOUT_FILENO);
+			dup2(err_pipe[1], STDERR_FILENO);
+			_exit(run_child(request, control[1]));
+		}
+		close(out_pipe[1]);
+		close(err_pipe[1]);
+		close(control[1]);
+		if (pid < 0)
+		{
+			close(out_pipe[0]);
+			close(err_pipe[0]);
+			close(control[0]);
+			return;
+		}
+
+		Entry entry;
+		bool cacheable = false;
+		bool client_gone = false;
+		struct pollfd poll_fds[3] = {{out_pipe[0], POLLIN, 0}, {err_pipe[0], POLLIN, 0}, {control[0], POLLIN, 0}};
+		char buffer[64 * 1024];
+		while (poll_fds[0].fd >= 0 || poll_fds[1].fd >= 0)
+		{
+			if (poll(poll_fds, 3, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			if (poll_fds[2].revents)
+			{
+				// Scope report: the directories to watch, answered with one byte once they are
+				std::vector<std::string> dirs;
+				if (read_strings(control[0], dirs))
+				{
+					cacheable = watch_dirs(dirs, entry.wds);
+					send_all(control[0], "k", 1);
+				}
+				close(control[0]);
+				poll_fds[2].fd = -1;
+			}
+			for (int i = 0; i < 2; ++i)
+			{
+				if (poll_fds[i].revents == 0)
+					continue;
+				ssize_t got = read(poll_fds[i].fd, buffer, sizeof(buffer));
+				if (got < 0 && errno == EINTR)
+					continue;
+				if (got <= 0)
+				{
+					close(poll_fds[i].fd);
+					poll_fds[i].fd = -1;
+					continue;
+				}
+				(i == 0 ? entry.out : entry.err).append(buffer, static_cast<size_t>(got));
+				if (!client_gone && !send_frame(client_fd, i == 0 ? 'o' : 'e', buffer, static_cast<size_t>(got)))
+				{
+					client_gone = true;
+					kill(pid, SIGTERM);
+				}
+			}
+		}
+		if (poll_fds[2].fd >= 0)
+		{
+			close(control[0]);
+		}
+		int wait_status = 0;
+		while (waitpid(pid, &wait_status, 0) < 0 && errno == EINTR)
+		{
+		}
+		entry.status = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : 1;
+		std::int32_t status = entry.status;
+		if (!client_gone)
+		{
+			send_frame(client_fd, 'x', reinterpret_cast<const char *>(&status), sizeof(status));
+		}
+
+		// Keep the output unless it failed, was cut short, or something changed while it ran
+		pending_invalidated_ = false;
+		pending_wds_ = &entry.wds;
+		drain_events();
+		pending_wds_ = nullptr;
+		if (cacheable && !client_gone && entry.status == 0 && !pending_invalidated_ &&
+			entry.out.size() + entry.err.size() <= size_limit_)
+		{
+			store(key, std::move(entry));
+		}
+		else
+		{
+			release_watches(key, entry.wds);
+		}
+	}
+
+	/**
+	 * @brief The query itself, in the forked child. Mirrors main(), plus the scope report.
+	 */
+	static int run_child(const std::vector<std::string> &request, int control_fd)
+	{
+		if (chdir(request[0].c_str()) != 0)
+		{
+			std::cerr << "Error: Could not enter " << request[0] << ": " << std::strerror(errno) << std::endl;
+			return 1;
+		}
+		// The client's stdout, which the terminal and I/O loop checks must see instead of our pipe
+		StdoutIdentity identity;
+		unsigned long long terminal, dev, inode;
+		if (std::sscanf(request[1].c_str(), "stdout=%llu:%llu:%llu", &terminal, &dev, &inode) != 3)
+		{
+			std::cerr << "Error: The catlr client sent a request this server does not understand (different versions?)." << std::endl;
+			return 1;
+		}
+		identity.terminal = terminal != 0;
+		identity.dev = static_cast<dev_t>(dev);
+		identity.inode = static_cast<ino_t>(inode);
+		client_stdout = &identity;
+
+		std::vector<std::string> args = {"catlr"};
+		args.insert(args.end(), request.begin() + 2, request.end());
+		std::vector<char *> argv;
+		for (auto &arg : args)
+		{
+			argv.push_back(&arg[0]);
+		}
+		argv.push_back(nullptr);
+		int argc = static_cast<int>(args.size());
+
+		CliOptions options;
+		int status = parse_cli(argc, argv.data(), options);
+		if (status != CLI_CONTINUE)
+		{
+			std::cout.flush();
+			return status;
+		}
+		if (options.watch)
+		{
+			std::cerr << "Error: --watch is not available through a catlr server." << std::endl;
+			return 1;
+		}
+
+		bool cacheable = options.revision.empty() && !options.git_tracked && options.changed_since.empty() &&
+						 options.manifest_file.empty() && options.index_file.empty() && !options.stats && options.trace_file.empty();
+		if (cacheable)
+		{
+			std::vector<fs::path> dirs;
+			for (const auto &path_entry : options.target_paths)
+			{
+				std::error_code ec;
+				WatchTarget target;
+				target.path = fs::canonical(path_entry, ec);
+				if (ec)
+					continue;
+				target.filters = target_filters(options.filters, target.path, options.respect_gitignore);
+				DirectoryCache cache(target.path, fs::path());
+				collect_watch_dirs(target.path, target, cache, dirs);
+				dirs.push_back(target.path.parent_path()); // A target that is deleted or renamed
+			}
+			fs::path home = get_home_path();
+			if (!home.empty())
+			{
+				dirs.push_back(home / ".config" / "catlr");
+			}
+			std::vector<std::string> dir_strings;
+			for (const auto &dir : dirs)
+			{
+				dir_strings.push_back(dir.string());
+			}
+			char ack;
+			if (send_strings(control_fd, dir_strings))
+			{
+				read_exact(control_fd, &ack, 1);
+			}
+		}
+		close(control_fd);
+
+		status = run_cli(argc, argv.data(), options);
+		std::cout.flush();
+		return status;
+	}
+
+	/**
+	 * @brief Adds watches for a query's directories.
+	 * @return false if some directory could not be watched, so the output cannot be cached.
+	 */
+	bool watch_dirs(const std::vector<std::string> &dirs, std::vector<int> &wds)
+	{
+		bool all_watched = true;
+		for (const auto &dir : dirs)
+		{
+			int wd = inotify_add_watch(inotify_fd_, dir.c_str(), INOTIFY_WATCH_EVENTS);
+			if (wd >= 0)
+			{
+				wds.push_back(wd);
+				wd_refs_[wd]++;
+			}
+			else if (errno != ENOENT) // A missing config directory is fine
+			{
+				all_watched = false;
+			}
+		}
+		return all_watched;
+	}
+
+	void store(const std::string &key, Entry entry)
+	{
+		total_size_ += entry.out.size() + entry.err.size();
+		for (int wd : entry.wds)
+		{
+			wd_keys_[wd].insert(key);
+		}
+		entry.lru = lru_.insert(lru_.end(), key);
+		entries_.emplace(key, std::move(entry));
+		while (total_size_ > size_limit_ && !lru_.empty())
+		{
+			invalidate(lru_.front());
+		}
+	}
+
+	void invalidate(const std::string &key)
+	{
+		auto found = entries_.find(key);
+		if (found == entries_.end())
+		{
+			return;
+		}
+		total_size_ -= found->second.out.size() + found->second.err.size();
+		lru_.erase(found->second.lru);
+		std::vector<int> wds = std::move(found->second.wds);
+		entries_.erase(found);
+		release_watches(key, wds);
+	}
+
+	void release_watches(const std::string &key, const std::vector<int> &wds)
+	{
+		for (int wd : wds)
+		{
+			wd_keys_[wd].erase(key);
+			if (--wd_refs_[wd] == 0)
+			{
+				inotify_rm_watch(inotify_fd_, wd);
+				wd_refs_.erase(wd);
+				wd_keys_.erase(wd);
+			}
+		}
+	}
+
+	/**
+	 * @brief Reads all queued inotify events and drops the outputs they affect.
+	 */
+	void drain_events()
+	{
+		alignas(struct inotify_event) char buffer[64 * 1024];
+		for (;;)
+		{
+			ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+			if (length <= 0)
+			{
+				return; // EAGAIN: nothing more queued
+			}
+			for (ssize_t offset = 0; offset < length;)
+			{
+				const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+				offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					while (!lru_.empty())
+						invalidate(lru_.front());
+					pending_invalidated_ = true;
+					continue;
+				}
+				if (pending_wds_ != nullptr &&
+					std::find(pending_wds_->begin(), pending_wds_->end(), event->wd) != pending_wds_->end())
+				{
+					pending_invalidated_ = true;
+				}
+				auto keys = wd_keys_.find(event->wd);
+				if (keys != wd_keys_.end())
+				{
+					std::set<std::string> affected = keys->second;
+					for (const auto &key : affected)
+					{
+						invalidate(key);
+					}
+				}
+			}
+		}
+	}
+
+	std::uint64_t size_limit_;
+	std::uint64_t total_size_ = 0;
+	int inotify_fd_;
+	std::unordered_map<std::string, Entry> entries_;
+	std::list<std::string> lru_; // Least recently used first
+	std::unordered_map<int, std::set<std::string>> wd_keys_;
+	std::unordered_map<int, int> wd_refs_; // Cached or running queries using each watch
+	const std::vector<int> *pending_wds_ = nullptr;
+	bool pending_invalidated_ = false;
+};
+
+#endif // __linux__
+
+// --- Command Line Entry ---
+
+int cli_main(int argc, char *argv[])
+{
+#ifndef _WIN32
+	install_sigpipe_handler();
+#endif
+
+	// --- Server and Client Modes ---
+	std::vector<char *> args(argv, argv + argc);
+	for (size_t i = 1; i < args.size(); ++i)
+	{
+		std::string arg = args[i];
+		if (arg == "--serve" || arg.rfind("--serve=", 0) == 0)
+		{
+#ifdef __linux__
+			Config config = parse_config();
+			std::uint64_t size_limit = 256ULL << 20;
+			if (!config.output_cache_size.empty() && !parse_byte_count(config.output_cache_size, size_limit))
+			{
+				std::cerr << "Warning: Invalid outputCacheSize '" << config.output_cache_size << "' in config. Using 256M." << std::endl;
+			}
+			CatlrServer server(size_limit);
+			return server.run(socket_path_arg(arg));
+#else
+			std::cerr << "Error: --serve needs inotify, which is only available on Linux." << std::endl;
+			return 1;
+#endif
+		}
+		if (arg == "--connect" || arg.rfind("--connect=", 0) == 0)
+		{
+			args.erase(args.begin() + static_cast<std::ptrdiff_t>(i));
+			std::vector<std::string> query(args.begin() + 1, args.end());
+			// The server can neither read our stdin nor tell when a list file changes
+			bool reads_list = std::find(query.begin(), query.end(), "--files-from") != query.end();
+			int status;
+			if (!reads_list && run_client(socket_path_arg(arg), query, status))
+			{
+				return status;
+			}
+			break; // No server running: answer the query here
+		}
+	}
+	argc = static_cast<int>(args.size());
+	args.push_back(nullptr);
+
+	// --- 1. Argument Parsing ---
+	CliOptions options;
+	int status = parse_cli(argc, args.data(), options);
+	if (status != CLI_CONTINUE)
+	{
+		return status;
+	}
+	return run_cli(argc, args.data(), options);
+}
+
+} // namespace catlr
@@ -0,0 +1,282 @@
+#ifndef CATLR_HPP
+#define CATLR_HPP
+
+// libcatlr: the walker, filters, .gitignore loader and printers behind the catlr command line,
+// for tools that want to run them in-process instead of spawning catlr and parsing its text.
+//
+//     catlr::Filters filters = catlr::target_filters({}, root, true); // Adds root/.gitignore
+//     for (const auto &entry : catlr::walk(root, filters))
+//     {
+//         ...
+//     }
+//
+// Build: compile catlr.cpp with the same flags as the command line (see README) and link it.
+
+#include <cstddef>	  // For size_t
+#include <filesystem> // For std::filesystem::path (Requires C++17)
+#include <iterator>	  // For std::input_iterator_tag
+#include <memory>	  // For std::unique_ptr
+#include <string>	  // For std::string
+#include <string_view> // For std::string_view
+#include <vector>	  // For std::vector
+
+namespace catlr
+{
+
+namespace fs = std::filesystem;
+
+// --- Filters ---
+
+/**
+ * @brief Holds the include/exclude filters for listing and printing.
+ */
+struct Filters
+{
+	std::vector<std::string> print_includes;
+	std::vector<std::string> print_excludes;
+	std::vector<std::string> list_includes;
+	std::vector<std::string> list_excludes;
+};
+
+/**
+ * @brief Applies the command line's pattern sugar: ".cpp" becomes "*.cpp".
+ */
+std::string process_pattern_arg(std::string pattern_arg);
+
+/**
+ * @brief Reads the patterns of a .gitignore file (comments and negations are skipped).
+ */
+std::vector<std::string> parse_gitignore(const fs::path &gitignore_path);
+
+/**
+ * @brief True if a '/'-separated path relative to the root (with final component
+ * `filename_str`) matches one filter pattern.
+ */
+bool pattern_matches(const std::string &rel_path_str, const std::string &filename_str, std::string pattern);
+
+/**
+ * @brief Applies include/exclude patterns to a relative path: includes win, then excludes hide.
+ */
+bool matches_filters_rel(const std::string &rel_path_str, const std::string &filename_str, const std::vector<std::string> &includes, const std::vector<std::string> &excludes);
+
+/**
+ * @brief As matches_filters_rel, for `path` taken relative to `base_path`.
+ */
+bool matches_filters(const fs::path &path, const fs::path &base_path, const std::vector<std::string> &includes, const std::vector<std::string> &excludes);
+
+/**
+ * @brief The filters for one target: `filters` plus, if `respect_gitignore`, the patterns of
+ * the target's .gitignore (added to both list and print excludes).
+ */
+Filters target_filters(const Filters &filters, const fs::path &target_path, bool respect_gitignore);
+
+// --- Sinks ---
+
+/**
+ * @brief True once a write has failed with EPIPE (or, in the command line, SIGPIPE arrived).
+ * Walks and printers stop early from then on.
+ */
+bool output_closed();
+
+/**
+ * @brief Writes a whole buffer to a file descriptor, retrying on short writes and EINTR and
+ * waiting out a full non-blocking descriptor.
+ */
+bool write_all(int fd, const char *data, size_t length);
+
+/**
+ * @brief Destination for the bytes leaving the output layer.
+ */
+class OutputSink
+{
+public:
+	virtual ~OutputSink() = default;
+	virtual bool write(const char *data, size_t length) = 0;
+	/**
+	 * @brief Emits anything the sink still holds. Called once, after the last write.
+	 */
+	virtual bool finish() { return true; }
+};
+
+/**
+ * @brief Sink that writes straight to a file descriptor (normally stdout).
+ */
+class FdSink : public OutputSink
+{
+public:
+	explicit FdSink(int fd) : fd_(fd) {}
+
+	bool write(const char *data, size_t length) override
+	{
+		return write_all(fd_, data, length);
+	}
+
+private:
+	int fd_;
+};
+
+/**
+ * @brief Sink that appends everything to a string, for in-process consumers.
+ */
+class StringSink : public OutputSink
+{
+public:
+	bool write(const char *data, size_t length) override
+	{
+		text.append(data, length);
+		return true;
+	}
+
+	std::string text;
+};
+
+// --- Walking ---
+
+enum class DirEntryType : unsigned char
+{
+	Directory,
+	Regular,
+	Symlink, // Resolved with stat() when used, since the target can change independently
+	Other
+};
+
+struct CachedDirEntry
+{
+	std::string_view name; // Interned by the DirectoryCache that listed it, valid while it lives
+	DirEntryType type;
+};
+
+class DirectoryCache;
+class DirectoryStream;
+
+/**
+ * @brief One directory or file reached by a walk.
+ */
+struct WalkEntry
+{
+	fs::path path;	   // The walk's start directory joined with the entry's names
+	fs::path relative; // Relative to the root, as printed in "--- path ---" headers
+	DirEntryType type; // Directory or Regular, with symlinks followed
+	size_t depth;	   // 0 for entries directly in the start directory
+};
+
+/**
+ * @brief Pull-based walk in the order catlr prints file contents: directory order, depth
+ * first. Yields each directory that passes the list filters before its entries, and each
+ * regular file that passes the print filters. Symlinked and unreadable directories are skipped.
+ *
+ * Single pass: begin() starts the walk, and next()/entry() can be used instead of iterators.
+ */
+class Walker
+{
+public:
+	class iterator
+	{
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = WalkEntry;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const WalkEntry *;
+		using reference = const WalkEntry &;
+
+		explicit iterator(Walker *walker = nullptr) : walker_(walker) {}
+
+		reference operator*() const { return walker_->entry(); }
+		pointer operator->() const { return &walker_->entry(); }
+
+		iterator &operator++()
+		{
+			if (!walker_->next())
+			{
+				walker_ = nullptr;
+			}
+			return *this;
+		}
+
+		bool operator==(const iterator &other) const { return walker_ == other.walker_; }
+		bool operator!=(const iterator &other) const { return walker_ != other.walker_; }
+
+	private:
+		Walker *walker_;
+	};
+
+	/**
+	 * @param root Filters match paths relative to this directory.
+	 * @param cache Listings to read through (e.g. a --cache snapshot); null reads the disk.
+	 * @param start Where the walk begins, `root` or a directory below it; empty means `root`.
+	 */
+	Walker(const fs::path &root, const Filters &filters, DirectoryCache *cache = nullptr, const fs::path &start = fs::path());
+	Walker(Walker &&other) noexcept;
+	~Walker();
+
+	/**
+	 * @brief Advances to the next entry.
+	 * @return false once the walk is over.
+	 */
+	bool next();
+
+	const WalkEntry &entry() const { return entry_; }
+
+	/**
+	 * @brief Do not enter the directory just returned.
+	 */
+	void skip_children() { descend_ = false; }
+
+	iterator begin() { return iterator(next() ? this : nullptr); }
+	iterator end() { return iterator(); }
+
+private:
+	struct Frame
+	{
+		fs::path dir;
+		fs::path relative;
+		const std::vector<CachedDirEntry> *entries;
+		size_t next;
+		double trace_start_us; // For the directory's --trace span
+		double filter_us;
+		size_t pruned;
+		std::unique_ptr<DirectoryStream> stream; // For a directory over the cache's listing limit
+	};
+
+	void enter(const fs::path &dir, const fs::path &relative);
+
+	fs::path root_;
+	Filters filters_;
+	std::unique_ptr<DirectoryCache> owned_cache_;
+	DirectoryCache *cache_;
+	std::vector<Frame> stack_;
+	WalkEntry entry_;
+	bool descend_ = false;
+};
+
+/**
+ * @brief Walks `root` with `filters` (see Walker).
+ */
+Walker walk(const fs::path &root, const Filters &filters);
+
+// --- Printing ---
+
+/**
+ * @brief Writes the built-in tree of `root` ("name/", then "├── " lines) to `sink`.
+ * The sink is not finished, so several prints can share it.
+ * @return false if the sink failed.
+ */
+bool print_tree(const fs::path &root, const Filters &filters, OutputSink &sink);
+
+/**
+ * @brief Writes the raw contents of one file to `sink`.
+ * @return false if the file could not be opened or the sink failed.
+ */
+bool print_file(const fs::path &path, OutputSink &sink);
+
+// --- Command Line ---
+
+/**
+ * @brief Runs the catlr command line (what `main` does).
+ * @return The process exit status.
+ */
+int cli_main(int argc, char *argv[]);
+
+} // namespace catlr
+
+#endif // CATLR_HPP